@@ -0,0 +1,31 @@
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include "allocations.h"
+
+static std::atomic<size_t> allocations(0);
+
+size_t allocation_count()
+{
+    return allocations.load(std::memory_order_relaxed);
+}
+
+// Array and nothrow forms forward to this one in libstdc++ and libc++.
+void *operator new(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    std::free(p);
+}
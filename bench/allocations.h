@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstddef>
+
+#include "benchmark/benchmark.h"
+
+// Number of calls to the global operator new so far, counted by the
+// replacement in allocations.cpp.
+size_t allocation_count();
+
+// Sets the "allocs" counter of `state` to the heap allocations per iteration
+// made since allocation_count() returned `start`.
+inline void report_allocations(benchmark::State &state, size_t start)
+{
+    state.counters["allocs"] = benchmark::Counter(double(allocation_count() - start), benchmark::Counter::kAvgIterations);
+}
@@ -0,0 +1,164 @@
+#include "benchmark/benchmark.h"
+#include <memory>
+#include <string>
+#include <vector>
+#include "allocations.h"
+#include "shapes.pb.h"
+#include "yaml2pb/yaml2pb.h"
+
+// Each builder fills its shape at size `n` and returns the message as YAML.
+typedef std::string (*Builder)(int n);
+
+static std::string make_deep(int n)
+{
+    shapes::Deep deep;
+    shapes::Deep *level = &deep;
+    for (int i = 0; i < n; i++)
+    {
+        if (i > 0)
+            level = level->mutable_child();
+        level->set_name("level_" + std::to_string(i));
+        level->set_level(i);
+    }
+    return yaml2pb::pb2yaml(deep);
+}
+
+static std::string make_wide(int)
+{
+    shapes::Wide wide;
+    const google::protobuf::Reflection *ref = wide.GetReflection();
+    const google::protobuf::Descriptor *descriptor = wide.GetDescriptor();
+    for (int i = 0; i < descriptor->field_count(); i++)
+    {
+        const google::protobuf::FieldDescriptor *field = descriptor->field(i);
+        switch (field->cpp_type())
+        {
+        case google::protobuf::FieldDescriptor::CPPTYPE_INT32:
+            ref->SetInt32(&wide, field, -1000 * i);
+            break;
+        case google::protobuf::FieldDescriptor::CPPTYPE_INT64:
+            ref->SetInt64(&wide, field, -10000000000ll * i);
+            break;
+        case google::protobuf::FieldDescriptor::CPPTYPE_UINT32:
+            ref->SetUInt32(&wide, field, 1000u * i);
+            break;
+        case google::protobuf::FieldDescriptor::CPPTYPE_UINT64:
+            ref->SetUInt64(&wide, field, 10000000000ull * i);
+            break;
+        case google::protobuf::FieldDescriptor::CPPTYPE_DOUBLE:
+            ref->SetDouble(&wide, field, i / 7.0);
+            break;
+        case google::protobuf::FieldDescriptor::CPPTYPE_FLOAT:
+            ref->SetFloat(&wide, field, i / 3.0f);
+            break;
+        case google::protobuf::FieldDescriptor::CPPTYPE_BOOL:
+            ref->SetBool(&wide, field, true);
+            break;
+        default:
+            ref->SetString(&wide, field, "value of " + field->name());
+            break;
+        }
+    }
+    return yaml2pb::pb2yaml(wide);
+}
+
+static std::string make_scalars(int n)
+{
+    shapes::Scalars scalars;
+    for (int i = 0; i < n; i++)
+    {
+        scalars.add_ints(int64_t(i) * 2654435761ll);
+        scalars.add_reals(i * 0.25);
+        scalars.add_words("word_" + std::to_string(i));
+    }
+    return yaml2pb::pb2yaml(scalars);
+}
+
+static std::string make_labels(int n)
+{
+    shapes::Labels labels;
+    for (int i = 0; i < n; i++)
+    {
+        (*labels.mutable_names())["label_" + std::to_string(i)] = "value_" + std::to_string(i);
+        (*labels.mutable_counters())["counter_" + std::to_string(i)] = int64_t(i) * 1000;
+        (*labels.mutable_totals())[int64_t(i) * 7919 - 1000000] = int64_t(i) * 1000;
+    }
+    return yaml2pb::pb2yaml(labels);
+}
+
+static std::string make_blob(int n)
+{
+    shapes::Blob blob;
+    blob.set_name("blob");
+    std::string *data = blob.mutable_data();
+    data->resize(n);
+    for (int i = 0; i < n; i++)
+        (*data)[i] = char(i * 2654435761u >> 13);
+    return yaml2pb::pb2yaml(blob);
+}
+
+static std::string make_enums(int n)
+{
+    shapes::Enums enums;
+    for (int i = 0; i < n; i++)
+        enums.add_codecs(shapes::Enums_Codec(i % shapes::Enums_Codec_Codec_ARRAYSIZE));
+    return yaml2pb::pb2yaml(enums);
+}
+
+// Decodes the shape with the engine given as the second argument.
+static void BM_shape_decode(benchmark::State &state, const google::protobuf::Message *prototype, Builder build)
+{
+    const std::string yaml = build(state.range(0));
+    yaml2pb::DecodeOptions options;
+    options.engine = yaml2pb::Engine(state.range(1));
+
+    const size_t allocs = allocation_count();
+    for (auto _ : state)
+    {
+        std::unique_ptr<google::protobuf::Message> message(prototype->New());
+        yaml2pb::yaml2pb(*message, yaml, options);
+        benchmark::DoNotOptimize(message);
+    }
+    report_allocations(state, allocs);
+    state.SetBytesProcessed(int64_t(state.iterations()) * yaml.size());
+}
+
+// Encodes the shape, through reflection or the generated codec.
+static void BM_shape_encode(benchmark::State &state, const google::protobuf::Message *prototype, Builder build)
+{
+    std::unique_ptr<google::protobuf::Message> message(prototype->New());
+    yaml2pb::yaml2pb(*message, build(state.range(0)));
+    yaml2pb::EncodeOptions options;
+    options.generated = state.range(1);
+
+    size_t bytes = 0;
+    const size_t allocs = allocation_count();
+    for (auto _ : state)
+    {
+        std::string yaml = yaml2pb::pb2yaml(*message, options);
+        bytes += yaml.size();
+        benchmark::DoNotOptimize(yaml);
+    }
+    report_allocations(state, allocs);
+    state.SetBytesProcessed(bytes);
+}
+
+static const std::vector<int64_t> engines = {yaml2pb::ENGINE_EVENT, yaml2pb::ENGINE_TREE, yaml2pb::ENGINE_GENERATED};
+static const std::vector<int64_t> codecs = {false, true};
+
+#define SHAPE_BENCHMARKS(shape, type, from, to)                                                         \
+    BENCHMARK_CAPTURE(BM_shape_decode, shape, &type::default_instance(), make_##shape)                  \
+        ->ArgsProduct({benchmark::CreateRange(from, to, 8), engines})                                   \
+        ->ArgNames({"n", "engine"})                                                                     \
+        ->Unit(benchmark::kMicrosecond);                                                                \
+    BENCHMARK_CAPTURE(BM_shape_encode, shape, &type::default_instance(), make_##shape)                  \
+        ->ArgsProduct({benchmark::CreateRange(from, to, 8), codecs})                                    \
+        ->ArgNames({"n", "generated"})                                                                  \
+        ->Unit(benchmark::kMicrosecond)
+
+SHAPE_BENCHMARKS(deep, shapes::Deep, 8, 256);
+SHAPE_BENCHMARKS(wide, shapes::Wide, 1, 1);
+SHAPE_BENCHMARKS(scalars, shapes::Scalars, 1 << 10, 64 << 10);
+SHAPE_BENCHMARKS(labels, shapes::Labels, 1 << 8, 16 << 10);
+SHAPE_BENCHMARKS(blob, shapes::Blob, 1 << 10, 1 << 20);
+SHAPE_BENCHMARKS(enums, shapes::Enums, 1 << 10, 64 << 10);
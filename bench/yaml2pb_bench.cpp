@@ -0,0 +1,543 @@
+#include "benchmark/benchmark.h"
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <unistd.h>
+#include "yaml-cpp/yaml.h"
+#include "allocations.h"
+#include "base64.h"
+#include "convert.h"
+#include "format.h"
+#include "sample.pb.h"
+#include "yaml2pb/cache.h"
+#include "yaml2pb/executor.h"
+#include "yaml2pb/incremental.h"
+#include "yaml2pb/mask.h"
+#include "yaml2pb/watcher.h"
+#include "yaml2pb/yaml2pb.h"
+
+// A pipeline config with `count` processors of two modules each, roughly
+// 250 bytes of YAML per processor.
+static std::string make_pipeline(int count)
+{
+    Sample sample;
+    sample.set_name("pipeline");
+    (*(sample.mutable_metadata()->mutable_info()))["owner"] = "bench";
+    for (int i = 0; i < count; i++)
+    {
+        std::string name = "processor_" + std::to_string(i);
+
+        Processor *processor = sample.add_processors();
+        processor->set_name(name);
+        processor->set_type(Processor_ProcessMediaType_video);
+        Module *module = processor->add_modules();
+        module->set_type(Module_ModuleType_scaler);
+        module->set_width(1280);
+        module->set_height(720);
+        module = processor->add_modules();
+        module->set_type(Module_ModuleType_h264);
+        module->set_bitrate(1000000 + i);
+        module->set_key_frame_interval(60);
+
+        Drain *drain = sample.add_drains();
+        drain->set_name("drain_" + std::to_string(i));
+        drain->set_type(Drain_DrainType_mp4);
+        drain->add_processors(name);
+    }
+    return yaml2pb::pb2yaml(sample);
+}
+
+static void BM_yaml2pb(benchmark::State &state, yaml2pb::Engine engine)
+{
+    const std::string yaml = make_pipeline(state.range(0));
+    yaml2pb::DecodeOptions options;
+    options.engine = engine;
+
+    const size_t allocs = allocation_count();
+    for (auto _ : state)
+    {
+        Sample sample;
+        yaml2pb::yaml2pb(sample, yaml, options);
+        benchmark::DoNotOptimize(sample);
+    }
+    report_allocations(state, allocs);
+    state.SetBytesProcessed(int64_t(state.iterations()) * yaml.size());
+}
+BENCHMARK_CAPTURE(BM_yaml2pb, tree, yaml2pb::ENGINE_TREE)->Range(16, 4 << 10)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_yaml2pb, event, yaml2pb::ENGINE_EVENT)->Range(16, 4 << 10)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_yaml2pb, generated, yaml2pb::ENGINE_GENERATED)->Range(16, 4 << 10)->Unit(benchmark::kMicrosecond);
+
+// A payload held in a caller's buffer: copied into a std::string first, or
+// parsed where it lies.
+static void BM_yaml2pb_buffer(benchmark::State &state, bool copy)
+{
+    const std::string yaml = make_pipeline(state.range(0));
+    const std::vector<char> buffer(yaml.begin(), yaml.end());
+
+    for (auto _ : state)
+    {
+        Sample sample;
+        if (copy)
+            yaml2pb::yaml2pb(sample, std::string(buffer.data(), buffer.size()));
+        else
+            yaml2pb::yaml2pb(sample, buffer.data(), buffer.size());
+        benchmark::DoNotOptimize(sample);
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * yaml.size());
+}
+BENCHMARK_CAPTURE(BM_yaml2pb_buffer, copy, true)->Range(16, 4 << 10)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_yaml2pb_buffer, in_place, false)->Range(16, 4 << 10)->Unit(benchmark::kMicrosecond);
+
+// Reloading a pipeline where one processor changes between versions:
+// decoded in full each time, or incrementally.
+static void BM_yaml2pb_incremental(benchmark::State &state, bool incremental)
+{
+    std::string yaml[2] = {make_pipeline(state.range(0)), make_pipeline(state.range(0))};
+    const std::string bitrate = "bitrate: " + std::to_string(1000000 + state.range(0) / 2);
+    yaml[1].replace(yaml[1].find(bitrate), bitrate.size(), "bitrate: 1");
+
+    yaml2pb::IncrementalDecoder decoder;
+    Sample sample;
+    decoder.decode(sample, yaml[0], 0);
+    size_t version = 0;
+    for (auto _ : state)
+    {
+        const std::string &next = yaml[++version % 2];
+        if (incremental)
+            decoder.decode(sample, next, 0);
+        else
+        {
+            sample.Clear();
+            yaml2pb::yaml2pb(sample, next);
+        }
+        benchmark::DoNotOptimize(sample);
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * yaml[0].size());
+}
+BENCHMARK_CAPTURE(BM_yaml2pb_incremental, full, false)->Range(16, 4 << 10)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_yaml2pb_incremental, incremental, true)->Range(16, 4 << 10)->Unit(benchmark::kMicrosecond);
+
+// Process start with a warm cache: every decode is a hit.
+static void BM_yaml2pb_cached(benchmark::State &state)
+{
+    const std::string yaml = make_pipeline(state.range(0));
+    char dir[] = "/tmp/yaml2pb_bench_XXXXXX";
+    if (!mkdtemp(dir))
+    {
+        state.SkipWithError("mkdtemp failed");
+        return;
+    }
+
+    yaml2pb::DecodeCache cache(dir);
+    for (auto _ : state)
+    {
+        Sample sample;
+        cache.decode(sample, yaml, 0);
+        benchmark::DoNotOptimize(sample);
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * yaml.size());
+    state.counters["misses"] = double(cache.stats().misses);
+
+    std::vector<std::string> entries;
+    if (DIR *d = opendir(dir))
+    {
+        while (struct dirent *entry = readdir(d))
+            if (entry->d_name[0] != '.')
+                entries.push_back(std::string(dir) + "/" + entry->d_name);
+        closedir(d);
+    }
+    for (size_t i = 0; i < entries.size(); i++)
+        unlink(entries[i].c_str());
+    rmdir(dir);
+}
+BENCHMARK(BM_yaml2pb_cached)->Range(16, 4 << 10)->Unit(benchmark::kMicrosecond);
+
+// Only the name and what each drain reads, out of the whole pipeline.
+static void BM_yaml2pb_masked(benchmark::State &state, yaml2pb::Engine engine, bool masked)
+{
+    const std::string yaml = make_pipeline(state.range(0));
+    google::protobuf::FieldMask paths;
+    paths.add_paths("name");
+    paths.add_paths("drains.processors");
+    yaml2pb::CompiledMask mask;
+    mask.compile(Sample::descriptor(), paths, 0);
+
+    yaml2pb::DecodeOptions options;
+    options.engine = engine;
+    options.mask = (masked) ? &mask : 0;
+    const size_t allocs = allocation_count();
+    for (auto _ : state)
+    {
+        Sample sample;
+        yaml2pb::yaml2pb(sample, yaml, options);
+        benchmark::DoNotOptimize(sample);
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * yaml.size());
+    report_allocations(state, allocs);
+}
+BENCHMARK_CAPTURE(BM_yaml2pb_masked, full, yaml2pb::ENGINE_EVENT, false)->Range(16, 4 << 10)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_yaml2pb_masked, event, yaml2pb::ENGINE_EVENT, true)->Range(16, 4 << 10)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_yaml2pb_masked, tree, yaml2pb::ENGINE_TREE, true)->Range(16, 4 << 10)->Unit(benchmark::kMicrosecond);
+
+// A MetaData.info label map with `count` entries.
+static void BM_yaml2pb_labels(benchmark::State &state, yaml2pb::Engine engine)
+{
+    Sample labels;
+    google::protobuf::Map<std::string, std::string> &info = *labels.mutable_metadata()->mutable_info();
+    for (int i = 0; i < state.range(0); i++)
+        info["label_" + std::to_string(i)] = "value_" + std::to_string(i);
+    const std::string yaml = yaml2pb::pb2yaml(labels);
+    yaml2pb::DecodeOptions options;
+    options.engine = engine;
+
+    for (auto _ : state)
+    {
+        Sample sample;
+        yaml2pb::yaml2pb(sample, yaml, options);
+        benchmark::DoNotOptimize(sample.metadata().info().size());
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * yaml.size());
+}
+BENCHMARK_CAPTURE(BM_yaml2pb_labels, tree, yaml2pb::ENGINE_TREE)->Range(1 << 10, 64 << 10)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_yaml2pb_labels, event, yaml2pb::ENGINE_EVENT)->Range(1 << 10, 64 << 10)->Unit(benchmark::kMicrosecond);
+
+// A config reload that builds a whole Sample and throws it away, on the
+// heap or on an arena that is reset each time.
+static void BM_yaml2pb_reload(benchmark::State &state, bool use_arena)
+{
+    const std::string yaml = make_pipeline(state.range(0));
+    google::protobuf::Arena arena, scratch;
+    yaml2pb::DecodeOptions options;
+    if (use_arena)
+        options.arena = &scratch;
+
+    const size_t allocs = allocation_count();
+    for (auto _ : state)
+    {
+        if (use_arena)
+        {
+            Sample *sample = google::protobuf::Arena::CreateMessage<Sample>(&arena);
+            yaml2pb::yaml2pb(*sample, yaml, options);
+            benchmark::DoNotOptimize(sample);
+            arena.Reset();
+            scratch.Reset();
+        }
+        else
+        {
+            Sample sample;
+            yaml2pb::yaml2pb(sample, yaml, options);
+            benchmark::DoNotOptimize(sample);
+        }
+    }
+    report_allocations(state, allocs);
+    state.SetBytesProcessed(int64_t(state.iterations()) * yaml.size());
+}
+BENCHMARK_CAPTURE(BM_yaml2pb_reload, heap, false)->Range(16, 4 << 10)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_yaml2pb_reload, arena, true)->Range(16, 4 << 10)->Unit(benchmark::kMicrosecond);
+
+// An ingest batch of 256 small configs over `threads` pool workers, or a
+// plain loop on one thread for 0.
+static void BM_decode_batch(benchmark::State &state)
+{
+    const std::vector<std::string> documents(256, make_pipeline(8));
+    std::vector<Sample> samples(documents.size());
+    std::vector<google::protobuf::Message *> messages;
+    for (size_t i = 0; i < samples.size(); i++)
+        messages.push_back(&samples[i]);
+    std::unique_ptr<yaml2pb::Executor> executor;
+    if (state.range(0))
+        executor.reset(new yaml2pb::Executor(state.range(0)));
+
+    for (auto _ : state)
+    {
+        for (size_t i = 0; i < samples.size(); i++)
+            samples[i].Clear();
+        if (executor)
+            yaml2pb::decode_batch(documents, messages, *executor, NULL);
+        else
+            for (size_t i = 0; i < documents.size(); i++)
+                yaml2pb::yaml2pb(samples[i], documents[i]);
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * documents.size() * documents[0].size());
+}
+BENCHMARK(BM_decode_batch)->Arg(0)->RangeMultiplier(2)->Range(1, 64)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// An event log of `count` concatenated small configs.
+static void BM_decode_stream(benchmark::State &state)
+{
+    std::string log;
+    const std::string document = "---\n" + make_pipeline(2);
+    for (int i = 0; i < state.range(0); i++)
+        log += document;
+
+    const size_t allocs = allocation_count();
+    for (auto _ : state)
+    {
+        std::istringstream in(log);
+        size_t documents = yaml2pb::decode_stream(in, Sample::descriptor(), [](google::protobuf::Message &message, const yaml2pb::Error &) {
+            benchmark::DoNotOptimize(message);
+            return true;
+        });
+        benchmark::DoNotOptimize(documents);
+    }
+    report_allocations(state, allocs);
+    state.SetBytesProcessed(int64_t(state.iterations()) * log.size());
+}
+BENCHMARK(BM_decode_stream)->Range(16, 4 << 10)->Unit(benchmark::kMillisecond);
+
+// A pipeline with `count` processors, keeping them all or handing them out
+// one at a time.
+static void BM_decode_elements(benchmark::State &state)
+{
+    const std::string yaml = make_pipeline(state.range(0));
+    yaml2pb::DecodeOptions options;
+    if (state.range(1))
+    {
+        options.element_path = "processors";
+        options.on_element = [](google::protobuf::Message &element, size_t) { benchmark::DoNotOptimize(element); };
+    }
+
+    const size_t allocs = allocation_count();
+    for (auto _ : state)
+    {
+        Sample sample;
+        yaml2pb::yaml2pb(sample, yaml, options);
+        benchmark::DoNotOptimize(sample);
+    }
+    report_allocations(state, allocs);
+    state.SetBytesProcessed(int64_t(state.iterations()) * yaml.size());
+}
+BENCHMARK(BM_decode_elements)->ArgsProduct({{1 << 10, 16 << 10}, {0, 1}})->ArgNames({"count", "streamed"})->Unit(benchmark::kMillisecond);
+
+// Rejecting an invalid config, as request handlers validating untrusted
+// input do, with and without exceptions.
+static void BM_yaml2pb_invalid(benchmark::State &state, bool throwing)
+{
+    const std::string yaml = "name: pipeline\nprocessors:\n  - name: video\n    modules:\n      - type: h266\n";
+
+    for (auto _ : state)
+    {
+        Sample sample;
+        if (throwing)
+        {
+            try
+            {
+                yaml2pb::yaml2pb(sample, yaml);
+            }
+            catch (const std::exception &)
+            {
+            }
+        }
+        else
+        {
+            yaml2pb::Error error;
+            benchmark::DoNotOptimize(yaml2pb::try_yaml2pb(sample, yaml, &error));
+        }
+    }
+}
+BENCHMARK_CAPTURE(BM_yaml2pb_invalid, try_yaml2pb, false);
+BENCHMARK_CAPTURE(BM_yaml2pb_invalid, exception, true);
+
+static void BM_pb2yaml(benchmark::State &state, bool generated)
+{
+    Sample sample;
+    yaml2pb::yaml2pb(sample, make_pipeline(state.range(0)));
+    yaml2pb::EncodeOptions options;
+    options.generated = generated;
+
+    size_t bytes = 0;
+    const size_t allocs = allocation_count();
+    for (auto _ : state)
+    {
+        std::string yaml = yaml2pb::pb2yaml(sample, options);
+        bytes += yaml.size();
+        benchmark::DoNotOptimize(yaml);
+    }
+    report_allocations(state, allocs);
+    state.SetBytesProcessed(bytes);
+}
+BENCHMARK_CAPTURE(BM_pb2yaml, reflection, false)->Range(16, 4 << 10)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_pb2yaml, generated, true)->Range(16, 4 << 10)->Unit(benchmark::kMicrosecond);
+
+// Emission cost should stay linear in the number of repeated elements.
+static void BM_pb2yaml_sources(benchmark::State &state)
+{
+    Sample sample;
+    for (int i = 0; i < state.range(0); i++)
+    {
+        Source *source = sample.add_sources();
+        source->set_name("source_" + std::to_string(i));
+        source->add_processors("audio_mixer_for_mp4");
+    }
+
+    for (auto _ : state)
+    {
+        std::string yaml = yaml2pb::pb2yaml(sample);
+        benchmark::DoNotOptimize(yaml);
+    }
+    state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_pb2yaml_sources)->RangeMultiplier(10)->Range(100, 100000)->Unit(benchmark::kMillisecond)->Complexity(benchmark::oN);
+
+static void BM_pb2yaml_sink(benchmark::State &state)
+{
+    Sample sample;
+    yaml2pb::yaml2pb(sample, make_pipeline(state.range(0)));
+
+    std::string yaml;
+    yaml2pb::BufferSink sink(yaml);
+    size_t bytes = 0;
+    for (auto _ : state)
+    {
+        yaml.clear();
+        yaml2pb::pb2yaml(sample, sink);
+        bytes += yaml.size();
+        benchmark::DoNotOptimize(yaml);
+    }
+    state.SetBytesProcessed(bytes);
+}
+BENCHMARK(BM_pb2yaml_sink)->Range(16, 4 << 10)->Unit(benchmark::kMicrosecond);
+
+// A debug dump of a slice of the pipeline: the top-level scalars only, or
+// the names of the drains too. Empty `paths` dumps everything.
+static void BM_pb2yaml_masked(benchmark::State &state, std::vector<std::string> paths)
+{
+    Sample sample;
+    yaml2pb::yaml2pb(sample, make_pipeline(state.range(0)));
+    google::protobuf::FieldMask field_mask;
+    for (size_t i = 0; i < paths.size(); i++)
+        field_mask.add_paths(paths[i]);
+    yaml2pb::CompiledMask mask;
+    mask.compile(Sample::descriptor(), field_mask, 0);
+    yaml2pb::EncodeOptions options;
+    options.mask = (paths.empty()) ? 0 : &mask;
+
+    std::string yaml;
+    yaml2pb::BufferSink sink(yaml);
+    size_t bytes = 0;
+    for (auto _ : state)
+    {
+        yaml.clear();
+        yaml2pb::pb2yaml(sample, sink, options);
+        bytes += yaml.size();
+        benchmark::DoNotOptimize(yaml);
+    }
+    state.SetBytesProcessed(bytes);
+}
+BENCHMARK_CAPTURE(BM_pb2yaml_masked, full, std::vector<std::string>())->Range(16, 4 << 10)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_pb2yaml_masked, scalars, std::vector<std::string>{"name", "metadata"})->Range(16, 4 << 10)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_pb2yaml_masked, drain_names, std::vector<std::string>{"name", "drains.name"})->Range(16, 4 << 10)->Unit(benchmark::kMicrosecond);
+
+// A certificate-sized to model-blob-sized bytes field.
+static void BM_base64(benchmark::State &state, yaml2pb::Base64Kernel kernel, bool decode)
+{
+    if (kernel > yaml2pb::base64_kernel())
+    {
+        state.SkipWithError("kernel not supported by this CPU");
+        return;
+    }
+
+    std::string data(state.range(0), '\0');
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = char(i * 2654435761u >> 13);
+    const std::string encoded = yaml2pb::base64_encode(data);
+
+    std::string out;
+    for (auto _ : state)
+    {
+        if (decode)
+            yaml2pb::base64_decode(encoded.data(), encoded.size(), out, kernel);
+        else
+            yaml2pb::base64_encode(data.data(), data.size(), out, kernel);
+        benchmark::DoNotOptimize(out);
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * encoded.size());
+}
+BENCHMARK_CAPTURE(BM_base64, encode_scalar, yaml2pb::BASE64_SCALAR, false)->Range(1 << 10, 1 << 20);
+BENCHMARK_CAPTURE(BM_base64, encode_sse4, yaml2pb::BASE64_SSE4, false)->Range(1 << 10, 1 << 20);
+BENCHMARK_CAPTURE(BM_base64, encode_avx2, yaml2pb::BASE64_AVX2, false)->Range(1 << 10, 1 << 20);
+BENCHMARK_CAPTURE(BM_base64, decode_scalar, yaml2pb::BASE64_SCALAR, true)->Range(1 << 10, 1 << 20);
+BENCHMARK_CAPTURE(BM_base64, decode_sse4, yaml2pb::BASE64_SSE4, true)->Range(1 << 10, 1 << 20);
+BENCHMARK_CAPTURE(BM_base64, decode_avx2, yaml2pb::BASE64_AVX2, true)->Range(1 << 10, 1 << 20);
+
+// Scalar text to number, as for a calibration table of doubles or a list
+// of ids.
+template <typename T>
+static void scalar_as(benchmark::State &state, const char *format)
+{
+    std::vector<std::string> scalars;
+    for (int i = 0; i < 1024; i++)
+    {
+        char text[32];
+        snprintf(text, sizeof(text), format, (i * 2654435761u) / 1024.0);
+        scalars.push_back(text);
+    }
+
+    for (auto _ : state)
+    {
+        for (size_t i = 0; i < scalars.size(); i++)
+        {
+            T value;
+            benchmark::DoNotOptimize(yaml2pb::scalar_as(scalars[i], value));
+            benchmark::DoNotOptimize(value);
+        }
+    }
+    state.SetItemsProcessed(int64_t(state.iterations()) * scalars.size());
+}
+static void BM_scalar_as_double(benchmark::State &state, const char *format) { scalar_as<double>(state, format); }
+static void BM_scalar_as_float(benchmark::State &state, const char *format) { scalar_as<float>(state, format); }
+static void BM_scalar_as_int64(benchmark::State &state, const char *format) { scalar_as<int64_t>(state, format); }
+BENCHMARK_CAPTURE(BM_scalar_as_double, short, "%.6g");
+BENCHMARK_CAPTURE(BM_scalar_as_double, round_trip, "%.17g");
+BENCHMARK_CAPTURE(BM_scalar_as_float, short, "%.6g");
+BENCHMARK_CAPTURE(BM_scalar_as_int64, integer, "%.0f");
+
+// Number to text, against yaml-cpp's stream conversion at full precision.
+static void BM_format_number(benchmark::State &state, bool yaml_cpp)
+{
+    std::vector<double> values;
+    for (int i = 0; i < 1024; i++)
+        values.push_back((i * 2654435761u) / 1024.0 + 0.1);
+
+    for (auto _ : state)
+    {
+        for (size_t i = 0; i < values.size(); i++)
+        {
+            if (yaml_cpp)
+                benchmark::DoNotOptimize(YAML::Node(values[i]).Scalar());
+            else
+                benchmark::DoNotOptimize(yaml2pb::number_text(values[i]));
+        }
+    }
+    state.SetItemsProcessed(int64_t(state.iterations()) * values.size());
+}
+BENCHMARK_CAPTURE(BM_format_number, shortest, false);
+BENCHMARK_CAPTURE(BM_format_number, yaml_cpp, true);
+
+// Reading the published config on every thread: SnapshotCell against
+// std::atomic_load on a shared_ptr, which libstdc++ guards with a mutex pool.
+static void BM_snapshot_load(benchmark::State &state, bool cell)
+{
+    static yaml2pb::SnapshotCell snapshot;
+    static std::shared_ptr<const Sample> shared;
+    if (state.thread_index() == 0)
+    {
+        std::shared_ptr<const Sample> sample = std::make_shared<Sample>();
+        snapshot.store(sample);
+        std::atomic_store(&shared, sample);
+    }
+
+    for (auto _ : state)
+    {
+        if (cell)
+            benchmark::DoNotOptimize(snapshot.load());
+        else
+            benchmark::DoNotOptimize(std::atomic_load(&shared));
+    }
+}
+BENCHMARK_CAPTURE(BM_snapshot_load, cell, true)->ThreadRange(1, 8);
+BENCHMARK_CAPTURE(BM_snapshot_load, atomic_load, false)->ThreadRange(1, 8);
+
+BENCHMARK_MAIN();
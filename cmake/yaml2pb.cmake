@@ -0,0 +1,28 @@
+# yaml2pb_generate(<target> <proto>...)
+#
+# Runs protoc with protoc-gen-yaml2pb over each .proto file and compiles the
+# generated FromYaml/ToYaml codecs into <target>. The matching .pb.h headers
+# must be reachable from <target>'s include path; the generated sources are
+# added directly so their static registration is never dropped by the linker.
+function(yaml2pb_generate TARGET)
+    set(OUT_DIR ${CMAKE_CURRENT_BINARY_DIR}/${TARGET}_yaml2pb)
+    foreach(PROTO ${ARGN})
+        get_filename_component(PROTO_PATH ${PROTO} ABSOLUTE)
+        get_filename_component(PROTO_DIR ${PROTO_PATH} DIRECTORY)
+        get_filename_component(PROTO_NAME ${PROTO_PATH} NAME_WE)
+
+        add_custom_command(
+            OUTPUT ${OUT_DIR}/${PROTO_NAME}.yaml2pb.h ${OUT_DIR}/${PROTO_NAME}.yaml2pb.cc
+            COMMAND ${CMAKE_COMMAND} -E make_directory ${OUT_DIR}
+            COMMAND $<TARGET_FILE:protoc>
+                --plugin=protoc-gen-yaml2pb=$<TARGET_FILE:protoc-gen-yaml2pb>
+                --yaml2pb_out=${OUT_DIR}
+                -I ${PROTO_DIR}
+                ${PROTO_PATH}
+            DEPENDS ${PROTO_PATH} protoc protoc-gen-yaml2pb
+            COMMENT "Generating YAML codecs for ${PROTO}"
+        )
+        target_sources(${TARGET} PRIVATE ${OUT_DIR}/${PROTO_NAME}.yaml2pb.cc)
+    endforeach()
+    target_include_directories(${TARGET} PRIVATE ${OUT_DIR})
+endfunction()
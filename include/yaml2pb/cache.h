@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "google/protobuf/message.h"
+#include "yaml2pb/yaml2pb.h"
+
+namespace yaml2pb
+{
+    struct CacheStats
+    {
+        CacheStats()
+            : hits(0), misses(0), stores(0), errors(0)
+        {
+        }
+
+        // Inputs found in the cache, and inputs decoded from YAML.
+        uint64_t hits;
+        uint64_t misses;
+        // Results written to the cache.
+        uint64_t stores;
+        // Entries that could not be written, or were found damaged and
+        // decoded again.
+        uint64_t errors;
+    };
+
+    // Caches decoded messages in a local directory, so that the same input
+    // is parsed as YAML once across processes. An entry is keyed on a hash
+    // of the input bytes and a fingerprint of the message type (every
+    // message and enum reachable from it) and holds the message serialized
+    // as protobuf; a hit parses it back with no YAML parsing. Entries are
+    // written to a temporary file and renamed into place, so concurrent
+    // processes never see a partial one, and damaged entries are detected
+    // and decoded again. Inputs that fail to decode are not cached.
+    //
+    // The cache is safe to use from several threads. Nothing is ever
+    // evicted; clean the directory as needed.
+    class DecodeCache
+    {
+        std::string _directory;
+        DecodeOptions _options;
+        std::atomic<uint64_t> _hits;
+        std::atomic<uint64_t> _misses;
+        std::atomic<uint64_t> _stores;
+        std::atomic<uint64_t> _errors;
+
+        bool fetch(google::protobuf::Message &message, const std::string &path, uint64_t check, uint64_t fingerprint, size_t size);
+        void store(const google::protobuf::Message &message, const std::string &path, uint64_t check, uint64_t fingerprint, size_t size);
+
+    public:
+        // `directory` is created if missing, but not its parents. With
+        // options.element_path set, decoding bypasses the cache, since the
+        // callback has to see every element; and so it does with
+        // options.mask set, which the entries do not account for. So does
+        // decoding on top of a non-empty message: the entries leave out the
+        // zero values the document sets, which would not replace the
+        // message's own.
+        explicit DecodeCache(const std::string &directory, const DecodeOptions &options = DecodeOptions());
+
+        DecodeCache(const DecodeCache &) = delete;
+        DecodeCache &operator=(const DecodeCache &) = delete;
+
+        const std::string &directory() const { return _directory; }
+
+        // As try_yaml2pb() and try_load_file(), through the cache.
+        bool decode(google::protobuf::Message &message, const char *data, size_t size, Error *error);
+        bool decode(google::protobuf::Message &message, const std::string &buf, Error *error);
+        bool load_file(google::protobuf::Message &message, const char *path, Error *error);
+
+        CacheStats stats() const;
+    };
+} // namespace yaml2pb
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace yaml2pb
+{
+    // A fixed pool of worker threads for decode_batch(). Each worker owns a
+    // task deque: it takes work from the back of its own and, once that
+    // runs dry, steals from the front of the others, so uneven documents
+    // even out without a shared queue every worker contends on.
+    class Executor
+    {
+        struct Job;
+
+        struct Task
+        {
+            Job *job;
+            size_t begin;
+            size_t end;
+        };
+
+        struct Queue
+        {
+            std::mutex lock;
+            std::deque<Task> tasks;
+        };
+
+        std::vector<std::unique_ptr<Queue>> _queues;
+        std::vector<std::thread> _threads;
+        std::mutex _lock;
+        std::condition_variable _wake;
+        // Tasks pushed and not yet taken, across all queues.
+        std::atomic<size_t> _queued;
+        std::atomic<size_t> _next;
+        bool _stop;
+
+        bool take(size_t self, Task &task);
+        void run(const Task &task);
+        void work(size_t self);
+
+    public:
+        // `threads` workers, or one per hardware thread when 0.
+        explicit Executor(size_t threads = 0);
+        ~Executor();
+
+        Executor(const Executor &) = delete;
+        Executor &operator=(const Executor &) = delete;
+
+        size_t size() const { return _threads.size(); }
+
+        // Calls task(i) for every i in [0, count) on the workers and the
+        // calling thread, and returns once all calls have. The first
+        // exception a call throws is rethrown here after the rest finish.
+        // Safe to call from several threads, and from inside a task.
+        void parallel_for(size_t count, const std::function<void(size_t)> &task);
+    };
+} // namespace yaml2pb
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_set>
+
+#include "google/protobuf/message.h"
+#include "yaml-cpp/yaml.h"
+#include "yaml2pb/yaml2pb.h"
+
+namespace yaml2pb
+{
+    // Entry points of a codec emitted by protoc-gen-yaml2pb. Both return
+    // false when `message` is not an instance of the generated class, e.g. a
+    // DynamicMessage built from the same descriptor.
+    struct Codec
+    {
+        bool (*from_yaml)(google::protobuf::Message &message, const YAML::Node &node);
+        bool (*to_yaml)(YAML::Node &node, const google::protobuf::Message &message);
+    };
+
+    // Generated sources register their codecs during static initialization,
+    // so they must be linked into the program (not left unreferenced in a
+    // static library) to be picked up by ENGINE_GENERATED.
+    void register_codec(const google::protobuf::Descriptor *descriptor, const Codec &codec);
+
+    // Support routines for generated code.
+    namespace generated
+    {
+        // FNV-1a, usable in case labels.
+        constexpr uint32_t hash(const char *name, uint32_t h = 2166136261u)
+        {
+            return (*name) ? hash(name + 1, (h ^ (unsigned char)*name) * 16777619u) : h;
+        }
+
+        inline uint32_t hash(const std::string &name)
+        {
+            uint32_t h = 2166136261u;
+            for (size_t i = 0; i < name.size(); i++)
+            {
+                h ^= (unsigned char)name[i];
+                h *= 16777619u;
+            }
+            return h;
+        }
+
+        // Throws the failure of the value at `mark`. Decoders complete its
+        // path as it unwinds through them: each passes whatever it catches
+        // from a field, element or map entry to the matching rethrow_*(),
+        // which prepends the name, index or key and throws it on. yaml-cpp
+        // exceptions become ERROR_TYPE on the way. Decoding then reports an
+        // Error as the reflection engines do.
+        [[noreturn]] void fail(const YAML::Mark &mark, ErrorKind kind, const std::string &error);
+        [[noreturn]] void rethrow_field(const std::string &name);
+        [[noreturn]] void rethrow_index(size_t index);
+        [[noreturn]] void rethrow_key(const YAML::Node &key);
+
+        // Same conversions as the reflection decoders.
+        double as_double(const YAML::Node &node);
+        float as_float(const YAML::Node &node);
+        int64_t as_int64(const YAML::Node &node);
+        uint64_t as_uint64(const YAML::Node &node);
+        int32_t as_int32(const YAML::Node &node);
+        uint32_t as_uint32(const YAML::Node &node);
+        bool as_bool(const YAML::Node &node);
+        std::string as_string(const YAML::Node &node);
+        std::string as_bytes(const YAML::Node &node);
+        bool as_number(const std::string &value, int &number);
+
+        template <typename E>
+        E as_enum(const YAML::Node &node, bool (*parse)(const std::string &, E *), bool (*valid)(int))
+        {
+            std::string value = as_string(node);
+            int number;
+            E e;
+            if (as_number(value, number))
+            {
+                if (valid(number))
+                    return static_cast<E>(number);
+            }
+            else if (parse(value, &e))
+            {
+                return e;
+            }
+            fail(node.Mark(), ERROR_VALUE, "Enum value not found:" + value);
+        }
+
+        // The entries one YAML mapping puts into a map field. A key the
+        // mapping gives twice is an ERROR_DUPLICATE_KEY, while keys the field
+        // held before are replaced. Starting from an empty field the map
+        // itself tells which keys were given; otherwise those are kept apart.
+        template <typename Map>
+        class MapEntries
+        {
+            Map &_map;
+            std::unique_ptr<std::unordered_set<typename Map::key_type>> _seen;
+
+        public:
+            explicit MapEntries(Map &map)
+                : _map(map), _seen((map.empty()) ? 0 : new std::unordered_set<typename Map::key_type>)
+            {
+            }
+
+            // Where the value for `key`, the key of the entry at `node`, goes:
+            // a new value, or the one the field held.
+            typename Map::mapped_type &operator()(const YAML::Node &node, const typename Map::key_type &key)
+            {
+                if (_seen ? !_seen->insert(key).second : _map.count(key))
+                    fail(node.Mark(), ERROR_DUPLICATE_KEY, "duplicate key '" + node.Scalar() + "'");
+                return _map[key];
+            }
+        };
+
+        template <typename Map>
+        MapEntries<Map> map_entries(Map &map)
+        {
+            return MapEntries<Map>(map);
+        }
+
+        std::string bytes_to_yaml(const std::string &value);
+        std::string enum_to_yaml(const std::string &name, int number);
+        // Shortest text that reads back as the same number.
+        std::string number_to_yaml(double value);
+        std::string number_to_yaml(float value);
+        std::string number_to_yaml(int64_t value);
+        std::string number_to_yaml(uint64_t value);
+        std::string number_to_yaml(int32_t value);
+        std::string number_to_yaml(uint32_t value);
+
+        // Whether an implicit-presence float is reported by ListFields.
+        inline bool is_set(double value) { return value != 0 || std::signbit(value); }
+        inline bool is_set(float value) { return value != 0 || std::signbit(value); }
+
+        // Fallbacks through reflection, for message types without generated
+        // codecs and for extensions.
+        void from_yaml(google::protobuf::Message &message, const YAML::Node &node);
+        void to_yaml(YAML::Node &node, const google::protobuf::Message &message);
+        void field_from_yaml(google::protobuf::Message &message, const std::string &name, const YAML::Mark &mark, const YAML::Node &node);
+        void extensions_to_yaml(YAML::Node &node, const google::protobuf::Message &message);
+
+        template <typename T>
+        bool from_yaml(google::protobuf::Message &message, const YAML::Node &node)
+        {
+            T *typed = google::protobuf::DynamicCastToGenerated<T>(&message);
+            if (!typed)
+                return false;
+            FromYaml(*typed, node);
+            return true;
+        }
+
+        template <typename T>
+        bool to_yaml(YAML::Node &node, const google::protobuf::Message &message)
+        {
+            const T *typed = google::protobuf::DynamicCastToGenerated<T>(&message);
+            if (!typed)
+                return false;
+            ToYaml(node, *typed);
+            return true;
+        }
+
+        template <typename T>
+        void register_codec()
+        {
+            Codec codec = {&from_yaml<T>, &to_yaml<T>};
+            ::yaml2pb::register_codec(T::descriptor(), codec);
+        }
+    } // namespace generated
+} // namespace yaml2pb
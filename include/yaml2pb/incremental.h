@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+#include "google/protobuf/message.h"
+#include "yaml2pb/yaml2pb.h"
+
+namespace yaml2pb
+{
+    struct IncrementalStats
+    {
+        IncrementalStats()
+            : full(false), reused(0), decoded(0)
+        {
+        }
+
+        // The whole document went through the decoder: on the first call,
+        // and whenever the previous version could not be built on.
+        bool full;
+        // Keys and sequence elements kept from the previous version, and
+        // those decoded anew.
+        size_t reused;
+        size_t decoded;
+    };
+
+    // Decodes successive versions of one document into the same message,
+    // re-decoding only the parts that changed. Each version is split along
+    // its lines into the keys of the top-level mapping, and the text of each
+    // is hashed. Singular message fields written as block mappings are split
+    // the same way, recursively. Repeated message fields written as block
+    // sequences are split into their elements.
+    //
+    // On the next version, keys with unchanged text keep their fields
+    // untouched; changed keys are decoded on their own and swapped in.
+    // Elements are matched to the previous ones by hash, so untouched
+    // elements are reused even when others are added, removed or reordered
+    // around them. Every version is still scanned and hashed in full, which
+    // is far cheaper than parsing it.
+    //
+    // Documents the split cannot follow (flow style, quoted keys,
+    // extensions, aliases, directives, tabs) are decoded in full, and so are
+    // versions where a changed part does not decode on its own. Results and
+    // errors are therefore always those of try_yaml2pb() into an empty
+    // message.
+    class IncrementalDecoder
+    {
+        struct Node;
+
+        DecodeOptions _options;
+        // The split of the last version decoded, and the message it went
+        // into; null when there is nothing to build on.
+        std::unique_ptr<Node> _root;
+        const google::protobuf::Message *_message;
+        IncrementalStats _stats;
+
+        bool prepare(const google::protobuf::Message &target, const Node *old, Node &fresh);
+        void apply(google::protobuf::Message &target, const Node *old, Node &fresh);
+
+    public:
+        // options.element_path and options.mask are not supported: with
+        // either set, every version is decoded in full.
+        explicit IncrementalDecoder(const DecodeOptions &options = DecodeOptions());
+        ~IncrementalDecoder();
+
+        IncrementalDecoder(const IncrementalDecoder &) = delete;
+        IncrementalDecoder &operator=(const IncrementalDecoder &) = delete;
+
+        // Decodes the next version into `message`, which must be the message
+        // of the previous call, unchanged since; any other message is decoded
+        // in full. On failure `message` and the decoder are left as they
+        // were.
+        bool decode(google::protobuf::Message &message, const char *data, size_t size, Error *error);
+        bool decode(google::protobuf::Message &message, const std::string &buf, Error *error);
+
+        // Forgets the previous version, so the next call decodes in full.
+        void reset();
+
+        // What the last call did.
+        const IncrementalStats &stats() const { return _stats; }
+    };
+} // namespace yaml2pb
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/field_mask.pb.h"
+#include "google/protobuf/message.h"
+#include "yaml2pb/yaml2pb.h"
+
+namespace yaml2pb
+{
+    // A FieldMask resolved against a message type, for decoding or encoding
+    // only the fields it selects (see DecodeOptions::mask and
+    // EncodeOptions::mask). Compile it once and reuse it; it is read-only
+    // once compiled and safe to share between threads.
+    //
+    // Each path names fields joined by dots, as in "name" or
+    // "drains.processors". Unlike the FieldMask spec, paths may go through
+    // repeated message fields and then select within every element. A map
+    // field can only end a path, and selects its entries whole. Selecting a
+    // message field selects everything below it, so "drains" wins over
+    // "drains.name". A mask without paths selects nothing. Extensions are
+    // never selected.
+    class CompiledMask
+    {
+    public:
+        // What is selected within one message, see src/mask.h.
+        struct Node;
+
+    private:
+        const google::protobuf::Descriptor *_descriptor;
+        std::vector<std::unique_ptr<Node>> _nodes;
+
+        Node *add(const google::protobuf::Descriptor *descriptor);
+
+    public:
+        CompiledMask();
+        ~CompiledMask();
+
+        CompiledMask(const CompiledMask &) = delete;
+        CompiledMask &operator=(const CompiledMask &) = delete;
+
+        // Resolves `mask` against `descriptor`, replacing what was compiled
+        // before. A path that does not name a field is an
+        // ERROR_UNKNOWN_FIELD with the path as `error->path`, and leaves the
+        // mask empty.
+        bool compile(const google::protobuf::Descriptor *descriptor, const google::protobuf::FieldMask &mask, Error *error);
+
+        // The type compiled for, null before the first successful compile().
+        const google::protobuf::Descriptor *descriptor() const { return _descriptor; }
+        // What is selected within that type.
+        const Node *root() const { return (_nodes.empty()) ? 0 : _nodes[0].get(); }
+    };
+
+    // Decode only what `mask` selects, compiling it for the message type
+    // first; an invalid mask fails as CompiledMask::compile() does. To decode
+    // with the same mask repeatedly, compile it once and set
+    // DecodeOptions::mask instead.
+    bool try_yaml2pb(google::protobuf::Message &message, const std::string &buf, const google::protobuf::FieldMask &mask, Error *error);
+    bool try_yaml2pb(google::protobuf::Message &message, const std::string &buf, const google::protobuf::FieldMask &mask, const DecodeOptions &options, Error *error);
+    void yaml2pb(google::protobuf::Message &message, const std::string &buf, const google::protobuf::FieldMask &mask);
+    void yaml2pb(google::protobuf::Message &message, const std::string &buf, const google::protobuf::FieldMask &mask, const DecodeOptions &options);
+
+    // Encode only what `mask` selects, compiling it for the message type
+    // first; an invalid mask throws. Set EncodeOptions::mask to reuse a
+    // compiled one.
+    std::string pb2yaml(const google::protobuf::Message &message, const google::protobuf::FieldMask &mask);
+    void pb2yaml(const google::protobuf::Message &message, const google::protobuf::FieldMask &mask, Sink &sink);
+} // namespace yaml2pb
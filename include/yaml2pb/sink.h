@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+
+namespace yaml2pb
+{
+    // Destination of the YAML streamed by pb2yaml(message, sink).
+    class Sink
+    {
+    public:
+        virtual ~Sink() {}
+
+        virtual void write(const char *data, size_t size) = 0;
+        // Called once the whole document has been written.
+        virtual void flush() {}
+    };
+
+    class OstreamSink : public Sink
+    {
+        std::ostream &_out;
+
+    public:
+        explicit OstreamSink(std::ostream &out)
+            : _out(out)
+        {
+        }
+
+        virtual void write(const char *data, size_t size);
+        virtual void flush();
+    };
+
+    // Writes to a file descriptor through a fixed-size buffer. The
+    // descriptor is not closed; pending output is flushed on destruction,
+    // but only flush() reports write errors.
+    class FdSink : public Sink
+    {
+        int _fd;
+        size_t _used;
+        char _buffer[16384];
+
+    public:
+        explicit FdSink(int fd)
+            : _fd(fd), _used(0)
+        {
+        }
+        virtual ~FdSink();
+
+        virtual void write(const char *data, size_t size);
+        virtual void flush();
+    };
+
+    // Appends to a caller-owned buffer; reusing the buffer across calls
+    // (after clear()) keeps its capacity and avoids reallocation.
+    class BufferSink : public Sink
+    {
+        std::string &_buffer;
+
+    public:
+        explicit BufferSink(std::string &buffer)
+            : _buffer(buffer)
+        {
+        }
+
+        virtual void write(const char *data, size_t size) { _buffer.append(data, size); }
+    };
+} // namespace yaml2pb
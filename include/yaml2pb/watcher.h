@@ -0,0 +1,168 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "yaml2pb/yaml2pb.h"
+
+namespace yaml2pb
+{
+    // Publishes an immutable value to any number of reader threads. load()
+    // takes no lock and never waits for store(): a reader counts itself in
+    // the current epoch while it copies the value out. store() swaps the
+    // new value in, moves to the next epoch and waits for the readers of the
+    // previous one to leave before it drops the old value (a minimal RCU).
+    class SnapshotCell
+    {
+        struct Holder;
+
+        // Each counter on a cache line of its own.
+        struct Readers
+        {
+            std::atomic<size_t> count;
+            char pad[64 - sizeof(std::atomic<size_t>)];
+        };
+
+        std::atomic<Holder *> _current;
+        std::atomic<uint64_t> _epoch;
+        mutable Readers _readers[2];
+        std::mutex _store;
+
+    public:
+        SnapshotCell();
+        ~SnapshotCell();
+
+        SnapshotCell(const SnapshotCell &) = delete;
+        SnapshotCell &operator=(const SnapshotCell &) = delete;
+
+        std::shared_ptr<const void> load() const;
+        // Safe to call from several threads; stores are serialized.
+        void store(std::shared_ptr<const void> value);
+    };
+
+    struct ReloadStats
+    {
+        ReloadStats()
+            : reloads(0), failures(0), last_latency(0), max_latency(0), total_latency(0)
+        {
+        }
+
+        // Snapshots published, the initial load included.
+        uint64_t reloads;
+        // Reloads that failed to read, decode or validate the file. The
+        // previous snapshot stays published.
+        uint64_t failures;
+        // From noticing the change to publishing or rejecting it.
+        std::chrono::nanoseconds last_latency;
+        std::chrono::nanoseconds max_latency;
+        std::chrono::nanoseconds total_latency;
+        // Why the last failed reload failed.
+        Error last_error;
+    };
+
+    // The file watching and reloading behind ConfigWatcher<T>.
+    class WatcherBase
+    {
+        std::string _path;
+        // Name of the file within its directory, which is what is watched.
+        std::string _name;
+        DecodeOptions _options;
+        SnapshotCell _snapshot;
+        // Serializes reloads; never taken by readers.
+        std::mutex _reload;
+        mutable std::mutex _lock;
+        ReloadStats _stats;
+        int _inotify;
+        int _wake[2];
+        std::thread _thread;
+
+        void watch();
+
+    protected:
+        // Decodes and validates a new snapshot, or returns null and says why
+        // in `error`.
+        virtual std::shared_ptr<const void> decode(const char *data, size_t size, const DecodeOptions &options, Error &error) = 0;
+
+        std::shared_ptr<const void> current() const { return _snapshot.load(); }
+
+        // Stops watching. Derived classes call it from their destructor, so
+        // that the thread never calls decode() on a half-destroyed object.
+        void stop();
+
+    public:
+        WatcherBase(const std::string &path, const DecodeOptions &options);
+        virtual ~WatcherBase();
+
+        WatcherBase(const WatcherBase &) = delete;
+        WatcherBase &operator=(const WatcherBase &) = delete;
+
+        const std::string &path() const { return _path; }
+
+        // Loads the file and starts watching it; call once. Fails, with
+        // nothing published, if the first load fails or the file cannot be
+        // watched.
+        bool start(Error *error);
+        void start();
+
+        // Reloads the file now, as a change to it would. On failure the
+        // previous snapshot stays published.
+        bool reload(Error *error);
+
+        ReloadStats stats() const;
+    };
+
+    // Keeps the latest valid version of a YAML config file decoded into a
+    // T. A background thread watches the file's directory with inotify and
+    // reloads when the file is written and closed, or renamed into place as
+    // editors and deployment tools do. Each reload decodes into a fresh T,
+    // validates it and publishes it as an immutable snapshot; a file that
+    // fails either keeps the previous snapshot. Changes made through a
+    // symlink's target elsewhere are not seen.
+    //
+    // snapshot() is safe from any thread and never blocks on a reload. A
+    // snapshot stays valid for as long as the caller holds it.
+    template <typename T>
+    class ConfigWatcher : public WatcherBase
+    {
+    public:
+        // Returns false to reject a decoded config, saying why in `reason`.
+        typedef std::function<bool(const T &config, std::string &reason)> Validator;
+
+        explicit ConfigWatcher(const std::string &path, const DecodeOptions &options = DecodeOptions(), const Validator &validate = Validator())
+            : WatcherBase(path, options), _validate(validate)
+        {
+        }
+
+        ~ConfigWatcher() { stop(); }
+
+        // The latest published config, or null before start().
+        std::shared_ptr<const T> snapshot() const { return std::static_pointer_cast<const T>(current()); }
+
+    protected:
+        virtual std::shared_ptr<const void> decode(const char *data, size_t size, const DecodeOptions &options, Error &error)
+        {
+            std::shared_ptr<T> config = std::make_shared<T>();
+            if (!try_yaml2pb(*config, data, size, options, &error))
+                return std::shared_ptr<const void>();
+
+            std::string reason;
+            if (_validate && !_validate(*config, reason))
+            {
+                error.kind = ERROR_INVALID;
+                error.message = (reason.empty()) ? "rejected by validator" : reason;
+                return std::shared_ptr<const void>();
+            }
+            return config;
+        }
+
+    private:
+        Validator _validate;
+    };
+} // namespace yaml2pb
@@ -1,8 +1,249 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <istream>
 #include <string>
+#include <vector>
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
+#include "google/protobuf/arena.h"
 #include "google/protobuf/message.h"
+#include "yaml2pb/sink.h"
 
 namespace yaml2pb
 {
+    class CompiledMask;
+    class Executor;
+
+    enum Engine
+    {
+        // Drives reflection straight from yaml-cpp parser events. Documents
+        // using aliases transparently fall back to ENGINE_TREE.
+        ENGINE_EVENT,
+        // Loads the whole YAML::Node tree first, then walks it.
+        ENGINE_TREE,
+        // Like ENGINE_TREE, but walks the tree with the codec generated by
+        // protoc-gen-yaml2pb when the message type has one linked in.
+        ENGINE_GENERATED,
+    };
+
+    // Receives the elements of a streamed repeated field one at a time;
+    // `index` counts them from 0 within the document.
+    typedef std::function<void(google::protobuf::Message &element, size_t index)> ElementCallback;
+
+    struct DecodeOptions
+    {
+        DecodeOptions()
+            : engine(ENGINE_EVENT), arena(0), underscores(false), mask(0)
+        {
+        }
+
+        Engine engine;
+        // Scratch arena for the decoder's own transient messages (the side
+        // copy made when decoding on top of a non-empty message); the heap
+        // when null. What ends up in the message follows the message itself:
+        // create it on an arena and all its submessages, map entries
+        // included, are allocated there too.
+        google::protobuf::Arena *arena;
+        // Accept '_' between the digits of numbers, as in 1_000_000 (YAML
+        // 1.1). ENGINE_GENERATED falls back to reflection with this set.
+        bool underscores;
+        // Streams one repeated message field instead of storing it: each
+        // element of the field at `element_path`, field names joined by dots
+        // through singular messages ("processors", "metadata.items"), is
+        // decoded into a reused message, passed to `on_element` and cleared,
+        // and the field is left empty. ENGINE_EVENT keeps only that one
+        // element in memory; the other engines, and documents that fall back
+        // to them, decode the whole document first and pass nothing on if it
+        // is invalid. An empty `on_element` drops the elements. Exceptions it
+        // throws end decoding and propagate to the caller.
+        std::string element_path;
+        ElementCallback on_element;
+        // Decodes only the fields selected by `mask` (see yaml2pb/mask.h),
+        // which must be compiled for the message type and outlive decoding.
+        // Other fields are left as they were. ENGINE_EVENT cuts the text of
+        // unselected top-level keys before parsing when the document is
+        // plain block style, and skips the values of other unselected keys
+        // as the parser reports them, without converting anything or
+        // creating messages for them; the tree engines still load it all.
+        // Skipped values are not checked, beyond YAML syntax for those
+        // that are parsed. ENGINE_GENERATED falls back to reflection with a
+        // mask set.
+        const CompiledMask *mask;
+    };
+
+    struct EncodeOptions
+    {
+        EncodeOptions()
+            : generated(false), mask(0)
+        {
+        }
+
+        // Use the codec generated by protoc-gen-yaml2pb when the message type
+        // has one linked in. Not used with a mask.
+        bool generated;
+        // Writes only the fields selected by `mask` (see yaml2pb/mask.h),
+        // which must be compiled for the message type. Only the selected
+        // fields are looked at, so a small selection out of a huge message
+        // costs little; unselected submessages are never visited.
+        const CompiledMask *mask;
+    };
+
+    enum ErrorKind
+    {
+        ERROR_NONE,
+        // The input is not well-formed YAML.
+        ERROR_SYNTAX,
+        // A mapping, sequence or scalar where the field wants something else.
+        ERROR_TYPE,
+        // A scalar that does not convert to the field type or enum.
+        ERROR_VALUE,
+        // A key that names neither a field nor a known extension.
+        ERROR_UNKNOWN_FIELD,
+        // A key that appears twice in the same map field.
+        ERROR_DUPLICATE_KEY,
+        // The message has no descriptor or reflection, or is not of the type
+        // DecodeOptions::mask was compiled for.
+        ERROR_DESCRIPTOR,
+        // The input file could not be opened or read.
+        ERROR_IO,
+        // The message decoded, but a validator rejected it.
+        ERROR_INVALID,
+    };
+
+    struct Error
+    {
+        Error()
+            : kind(ERROR_NONE), line(0), column(0)
+        {
+        }
+
+        ErrorKind kind;
+        // Where in the message the error is, e.g. "processors[1].modules[0].type",
+        // with map entries as "info[key]". Empty for the message itself.
+        std::string path;
+        // 1-based position in the input, 0 when unknown.
+        int line;
+        int column;
+        std::string message;
+
+        // "path: message (line L, column C)", leaving out what is unknown.
+        std::string to_string() const;
+    };
+
+    // Same as yaml2pb(), but reports failures through `error` (which may be
+    // null) and returns false instead of throwing. The default engine never
+    // throws internally; ENGINE_GENERATED codecs still do and are caught,
+    // with the same kinds, paths and positions as the other engines.
+    bool try_yaml2pb(google::protobuf::Message &message, const std::string &buf, Error *error);
+    bool try_yaml2pb(google::protobuf::Message &message, const std::string &buf, const DecodeOptions &options, Error *error);
+    // Decode the `size` bytes at `data` in place, without copying them into
+    // a std::string first; they need not be NUL-terminated.
+    bool try_yaml2pb(google::protobuf::Message &message, const char *data, size_t size, Error *error);
+    bool try_yaml2pb(google::protobuf::Message &message, const char *data, size_t size, const DecodeOptions &options, Error *error);
+
+    // Decodes the file at `path`. A regular file is mapped into memory and
+    // parsed in place, so the input is never copied (and must not be
+    // truncated meanwhile); pipes and other special files are read into a
+    // buffer first. Failing to open or read the file is an ERROR_IO.
+    bool try_load_file(google::protobuf::Message &message, const char *path, Error *error);
+    bool try_load_file(google::protobuf::Message &message, const char *path, const DecodeOptions &options, Error *error);
+    void load_file(google::protobuf::Message &message, const char *path);
+    void load_file(google::protobuf::Message &message, const char *path, const DecodeOptions &options);
+
+    // Decodes documents[i] into *messages[i] for every i < count on the
+    // threads of `executor` (see yaml2pb/executor.h), as try_yaml2pb() would.
+    // A failing document does not stop the others; errors[i] says what went
+    // wrong with each when `errors` is not null. Returns the number of
+    // documents that failed. options.arena, if set, is shared by all threads.
+    size_t decode_batch(const std::string *documents, google::protobuf::Message *const *messages, size_t count, Executor &executor, const DecodeOptions &options, Error *errors);
+    // Same, resizing `errors` to the batch. The vectors must be the same size.
+    size_t decode_batch(const std::vector<std::string> &documents, const std::vector<google::protobuf::Message *> &messages, Executor &executor, std::vector<Error> *errors);
+
+    // Receives each document of a stream: the decoded message, and the error
+    // that stopped decoding it (kind ERROR_NONE if none). The message is
+    // cleared and reused for the next document; Swap() it out to keep it.
+    // Returning false stops the stream.
+    typedef std::function<bool(google::protobuf::Message &message, const Error &error)> DocumentCallback;
+
+    // Decodes the documents of `in` one at a time into messages of type
+    // `descriptor`. The stream is split at its `---` and `...` lines, which
+    // YAML keeps out of document content, and only the current document is
+    // held in memory, so memory use is bounded by the largest document, not
+    // the stream. Documents without content are skipped.
+    // Errors carry lines counted from the start of the stream, and a bad
+    // document does not stop the ones after it. Returns the number of
+    // documents passed to `callback`.
+    size_t decode_stream(std::istream &in, const google::protobuf::Descriptor *descriptor, const DocumentCallback &callback);
+    size_t decode_stream(std::istream &in, const google::protobuf::Descriptor *descriptor, const DocumentCallback &callback, const DecodeOptions &options);
+
     void yaml2pb(google::protobuf::Message &message, const std::string &buf);
+    void yaml2pb(google::protobuf::Message &message, const std::string &buf, const DecodeOptions &options);
+    void yaml2pb(google::protobuf::Message &message, const char *data, size_t size);
+    void yaml2pb(google::protobuf::Message &message, const char *data, size_t size, const DecodeOptions &options);
     std::string pb2yaml(const google::protobuf::Message &message);
-}
\ No newline at end of file
+    std::string pb2yaml(const google::protobuf::Message &message, const EncodeOptions &options);
+    // Streams the YAML for `message` into `sink` straight from reflection,
+    // without building a YAML::Node tree. Empty messages are written as {}.
+    // options.generated does not apply.
+    void pb2yaml(const google::protobuf::Message &message, Sink &sink);
+    void pb2yaml(const google::protobuf::Message &message, Sink &sink, const EncodeOptions &options);
+
+    // What the decoders work out about a message type is compiled on first
+    // use and kept, keyed by descriptor, for the life of the process. Before
+    // destroying a DescriptorPool (or the DynamicMessageFactory holding one)
+    // whose types were decoded, release it here: otherwise a later pool
+    // whose descriptors land at the same addresses is decoded with what was
+    // kept for the freed ones. No message of the pool may be decoded or
+    // encoded meanwhile, and pools with types referring to its types must
+    // be released first. Types of the generated pool need no releasing.
+    void release_pool(const google::protobuf::DescriptorPool *pool);
+
+#if __cplusplus >= 201703L
+    // C++17 builds can pass any contiguous buffer as a std::string_view; the
+    // input is parsed in place like the (data, size) overloads.
+    inline bool try_yaml2pb(google::protobuf::Message &message, std::string_view buf, Error *error)
+    {
+        return try_yaml2pb(message, buf.data(), buf.size(), error);
+    }
+
+    inline bool try_yaml2pb(google::protobuf::Message &message, std::string_view buf, const DecodeOptions &options, Error *error)
+    {
+        return try_yaml2pb(message, buf.data(), buf.size(), options, error);
+    }
+
+    inline void yaml2pb(google::protobuf::Message &message, std::string_view buf)
+    {
+        yaml2pb(message, buf.data(), buf.size());
+    }
+
+    inline void yaml2pb(google::protobuf::Message &message, std::string_view buf, const DecodeOptions &options)
+    {
+        yaml2pb(message, buf.data(), buf.size(), options);
+    }
+
+    // NUL-terminated text, which would otherwise be ambiguous between the
+    // std::string and std::string_view overloads.
+    inline bool try_yaml2pb(google::protobuf::Message &message, const char *buf, Error *error)
+    {
+        return try_yaml2pb(message, std::string_view(buf), error);
+    }
+
+    inline bool try_yaml2pb(google::protobuf::Message &message, const char *buf, const DecodeOptions &options, Error *error)
+    {
+        return try_yaml2pb(message, std::string_view(buf), options, error);
+    }
+
+    inline void yaml2pb(google::protobuf::Message &message, const char *buf)
+    {
+        yaml2pb(message, std::string_view(buf));
+    }
+
+    inline void yaml2pb(google::protobuf::Message &message, const char *buf, const DecodeOptions &options)
+    {
+        yaml2pb(message, std::string_view(buf), options);
+    }
+#endif
+}
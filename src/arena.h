@@ -0,0 +1,22 @@
+#pragma once
+
+#include <memory>
+
+#include "google/protobuf/arena.h"
+#include "google/protobuf/message.h"
+
+namespace yaml2pb
+{
+    // Deletes heap messages and leaves arena ones to their arena.
+    struct arena_delete
+    {
+        void operator()(google::protobuf::Message *message) const
+        {
+            if (!message->GetArena())
+                delete message;
+        }
+    };
+
+    // A temporary message created with New(arena), arena possibly null.
+    typedef std::unique_ptr<google::protobuf::Message, arena_delete> message_ptr;
+} // namespace yaml2pb
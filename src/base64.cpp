@@ -0,0 +1,317 @@
+#include <cstdint>
+
+#include "base64.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define YAML2PB_BASE64_X86
+#include <cpuid.h>
+#include <immintrin.h>
+#define YAML2PB_TARGET_SSE4 __attribute__((target("ssse3,sse4.1")))
+#define YAML2PB_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace yaml2pb
+{
+    static const char encode_table[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+        "abcdefghijklmnopqrstuvwxyz"
+        "0123456789+/";
+
+    // 255 marks characters outside the alphabet, including '='.
+    static const uint8_t decode_table[256] = {
+        255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+        255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+        255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 62, 255, 255, 255, 63,
+        52, 53, 54, 55, 56, 57, 58, 59, 60, 61, 255, 255, 255, 255, 255, 255,
+        255, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14,
+        15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 255, 255, 255, 255, 255,
+        255, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+        41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, 255, 255, 255, 255, 255,
+        255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+        255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+        255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+        255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+        255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+        255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+        255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+        255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    };
+
+    static void encode_scalar(const uint8_t *&in, const uint8_t *end, char *&out)
+    {
+        for (; end - in >= 3; in += 3, out += 4)
+        {
+            uint32_t v = (uint32_t(in[0]) << 16) | (uint32_t(in[1]) << 8) | in[2];
+            out[0] = encode_table[v >> 18];
+            out[1] = encode_table[(v >> 12) & 0x3f];
+            out[2] = encode_table[(v >> 6) & 0x3f];
+            out[3] = encode_table[v & 0x3f];
+        }
+
+        if (in == end)
+            return;
+
+        uint32_t v = uint32_t(in[0]) << 16;
+        if (end - in == 2)
+            v |= uint32_t(in[1]) << 8;
+        out[0] = encode_table[v >> 18];
+        out[1] = encode_table[(v >> 12) & 0x3f];
+        out[2] = (end - in == 2) ? encode_table[(v >> 6) & 0x3f] : '=';
+        out[3] = '=';
+        in = end;
+        out += 4;
+    }
+
+    static void decode_scalar(const uint8_t *&in, const uint8_t *end, char *&out)
+    {
+        for (; end - in >= 4; in += 4, out += 3)
+        {
+            uint8_t a = decode_table[in[0]], b = decode_table[in[1]], c = decode_table[in[2]], d = decode_table[in[3]];
+            if ((a | b | c | d) & 0x80)
+                break;
+
+            uint32_t v = (uint32_t(a) << 18) | (uint32_t(b) << 12) | (uint32_t(c) << 6) | d;
+            out[0] = char(v >> 16);
+            out[1] = char(v >> 8);
+            out[2] = char(v);
+        }
+
+        // Whatever is left of the last group, up to the first invalid
+        // character, contributes its whole bytes.
+        uint32_t v = 0;
+        int count = 0;
+        for (; in != end && count < 3 && !(decode_table[*in] & 0x80); in++, count++)
+            v = (v << 6) | decode_table[*in];
+        v <<= 6 * (4 - count);
+        for (int i = 0; i < count - 1; i++)
+            *out++ = char(v >> (16 - 8 * i));
+        in = end;
+    }
+
+#ifdef YAML2PB_BASE64_X86
+    // Vector kernels after Wojciech Muła and Daniel Lemire, "Faster Base64
+    // Encoding and Decoding Using AVX2 Instructions".
+
+    // Spreads each 3-byte group of `in` over four 6-bit indices.
+    YAML2PB_TARGET_SSE4 static inline __m128i encode_split_sse4(__m128i in)
+    {
+        in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+        const __m128i t0 = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+        const __m128i t1 = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+        return _mm_or_si128(t0, t1);
+    }
+
+    // Maps 6-bit indices to alphabet characters by adding a per-range offset.
+    YAML2PB_TARGET_SSE4 static inline __m128i encode_lookup_sse4(__m128i indices)
+    {
+        __m128i range = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+        const __m128i upper = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+        range = _mm_or_si128(range, _mm_and_si128(upper, _mm_set1_epi8(13)));
+        const __m128i offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                              '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+        return _mm_add_epi8(_mm_shuffle_epi8(offsets, range), indices);
+    }
+
+    YAML2PB_TARGET_SSE4 static void encode_sse4(const uint8_t *&in, const uint8_t *end, char *&out)
+    {
+        // Each step loads 16 bytes but only consumes 12.
+        for (; end - in >= 16; in += 12, out += 16)
+        {
+            const __m128i v = _mm_loadu_si128((const __m128i *)in);
+            _mm_storeu_si128((__m128i *)out, encode_lookup_sse4(encode_split_sse4(v)));
+        }
+    }
+
+    // Turns 16 characters into 6-bit values; false if any of them is
+    // outside the alphabet.
+    YAML2PB_TARGET_SSE4 static inline bool decode_lookup_sse4(__m128i in, __m128i &values)
+    {
+        const __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(in, 4), _mm_set1_epi8(0x0f));
+        const __m128i lo_nibbles = _mm_and_si128(in, _mm_set1_epi8(0x0f));
+        const __m128i lo_classes = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                                 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+        const __m128i hi_classes = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                                 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+        if (!_mm_testz_si128(_mm_shuffle_epi8(lo_classes, lo_nibbles), _mm_shuffle_epi8(hi_classes, hi_nibbles)))
+            return false;
+
+        const __m128i slash = _mm_cmpeq_epi8(in, _mm_set1_epi8('/'));
+        const __m128i offsets = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+        values = _mm_add_epi8(in, _mm_shuffle_epi8(offsets, _mm_add_epi8(slash, hi_nibbles)));
+        return true;
+    }
+
+    // Packs four 6-bit values per dword into three bytes, in the low 12
+    // bytes of the result.
+    YAML2PB_TARGET_SSE4 static inline __m128i decode_pack_sse4(__m128i values)
+    {
+        const __m128i pairs = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+        const __m128i dwords = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000));
+        return _mm_shuffle_epi8(dwords, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+    }
+
+    YAML2PB_TARGET_SSE4 static void decode_sse4(const uint8_t *&in, const uint8_t *end, char *&out)
+    {
+        // Each step stores 16 bytes but only produces 12; keeping 32 input
+        // bytes in reserve keeps the store inside the output buffer.
+        for (; end - in >= 32; in += 16, out += 12)
+        {
+            __m128i values;
+            if (!decode_lookup_sse4(_mm_loadu_si128((const __m128i *)in), values))
+                return;
+            _mm_storeu_si128((__m128i *)out, decode_pack_sse4(values));
+        }
+    }
+
+    YAML2PB_TARGET_AVX2 static void encode_avx2(const uint8_t *&in, const uint8_t *end, char *&out)
+    {
+        const __m256i shuffle = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+                                                 1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+        const __m256i offsets = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                                 '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+                                                 'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                                 '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+
+        // The upper lane loads 16 bytes from in + 12.
+        for (; end - in >= 28; in += 24, out += 32)
+        {
+            const __m128i lo = _mm_loadu_si128((const __m128i *)in);
+            const __m128i hi = _mm_loadu_si128((const __m128i *)(in + 12));
+            __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+
+            v = _mm256_shuffle_epi8(v, shuffle);
+            const __m256i t0 = _mm256_mulhi_epu16(_mm256_and_si256(v, _mm256_set1_epi32(0x0fc0fc00)), _mm256_set1_epi32(0x04000040));
+            const __m256i t1 = _mm256_mullo_epi16(_mm256_and_si256(v, _mm256_set1_epi32(0x003f03f0)), _mm256_set1_epi32(0x01000010));
+            const __m256i indices = _mm256_or_si256(t0, t1);
+
+            __m256i range = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+            const __m256i upper = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+            range = _mm256_or_si256(range, _mm256_and_si256(upper, _mm256_set1_epi8(13)));
+            _mm256_storeu_si256((__m256i *)out, _mm256_add_epi8(_mm256_shuffle_epi8(offsets, range), indices));
+        }
+    }
+
+    YAML2PB_TARGET_AVX2 static void decode_avx2(const uint8_t *&in, const uint8_t *end, char *&out)
+    {
+        const __m256i lo_classes = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a,
+                                                    0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+        const __m256i hi_classes = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+                                                    0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+        const __m256i offsets = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+                                                 0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+        const __m256i pack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                              2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+        // Each step stores 32 bytes but only produces 24.
+        for (; end - in >= 64; in += 32, out += 24)
+        {
+            const __m256i v = _mm256_loadu_si256((const __m256i *)in);
+            const __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(v, 4), _mm256_set1_epi8(0x0f));
+            const __m256i lo_nibbles = _mm256_and_si256(v, _mm256_set1_epi8(0x0f));
+            if (!_mm256_testz_si256(_mm256_shuffle_epi8(lo_classes, lo_nibbles), _mm256_shuffle_epi8(hi_classes, hi_nibbles)))
+                return;
+
+            const __m256i slash = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('/'));
+            const __m256i values = _mm256_add_epi8(v, _mm256_shuffle_epi8(offsets, _mm256_add_epi8(slash, hi_nibbles)));
+
+            const __m256i pairs = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+            const __m256i dwords = _mm256_madd_epi16(pairs, _mm256_set1_epi32(0x00011000));
+            const __m256i bytes = _mm256_shuffle_epi8(dwords, pack);
+            _mm256_storeu_si256((__m256i *)out, _mm256_permutevar8x32_epi32(bytes, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7)));
+        }
+    }
+
+    static Base64Kernel detect_kernel()
+    {
+        unsigned int eax, ebx, ecx, edx;
+        if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+            return BASE64_SCALAR;
+        if (!(ecx & bit_SSSE3) || !(ecx & bit_SSE4_1))
+            return BASE64_SCALAR;
+
+        // AVX2 also needs the OS to save the YMM registers.
+        if ((ecx & bit_OSXSAVE) && (ecx & bit_AVX) && __get_cpuid_max(0, 0) >= 7)
+        {
+            unsigned int xcr0_lo, xcr0_hi;
+            __asm__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+            __cpuid_count(7, 0, eax, ebx, ecx, edx);
+            if ((xcr0_lo & 0x6) == 0x6 && (ebx & bit_AVX2))
+                return BASE64_AVX2;
+        }
+        return BASE64_SSE4;
+    }
+#else
+    static Base64Kernel detect_kernel()
+    {
+        return BASE64_SCALAR;
+    }
+#endif
+
+    Base64Kernel base64_kernel()
+    {
+        static const Base64Kernel kernel = detect_kernel();
+        return kernel;
+    }
+
+    void base64_encode(const char *data, size_t size, std::string &out)
+    {
+        base64_encode(data, size, out, base64_kernel());
+    }
+
+    void base64_encode(const char *data, size_t size, std::string &out, Base64Kernel kernel)
+    {
+        out.resize((size + 2) / 3 * 4);
+        if (!size)
+            return;
+
+        const uint8_t *in = (const uint8_t *)data;
+        const uint8_t *end = in + size;
+        char *dst = &out[0];
+
+        switch (kernel)
+        {
+#ifdef YAML2PB_BASE64_X86
+        case BASE64_AVX2:
+            encode_avx2(in, end, dst);
+            // fall through
+        case BASE64_SSE4:
+            encode_sse4(in, end, dst);
+            break;
+#endif
+        default:
+            break;
+        }
+        encode_scalar(in, end, dst);
+    }
+
+    void base64_decode(const char *data, size_t size, std::string &out)
+    {
+        base64_decode(data, size, out, base64_kernel());
+    }
+
+    void base64_decode(const char *data, size_t size, std::string &out, Base64Kernel kernel)
+    {
+        // A trailing group of three characters yields two more bytes.
+        out.resize(size / 4 * 3 + 2);
+
+        const uint8_t *in = (const uint8_t *)data;
+        const uint8_t *end = in + size;
+        char *dst = &out[0];
+
+        switch (kernel)
+        {
+#ifdef YAML2PB_BASE64_X86
+        case BASE64_AVX2:
+            decode_avx2(in, end, dst);
+            // fall through
+        case BASE64_SSE4:
+            decode_sse4(in, end, dst);
+            break;
+#endif
+        default:
+            break;
+        }
+        decode_scalar(in, end, dst);
+        out.resize(dst - out.data());
+    }
+} // namespace yaml2pb
@@ -1,108 +1,43 @@
 #pragma once
 
-#include <vector>
-#include <iostream>
+#include <cstddef>
+#include <string>
 
-typedef unsigned char BYTE;
-
-static const std::string base64_chars =
-    "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
-    "abcdefghijklmnopqrstuvwxyz"
-    "0123456789+/";
-
-static inline bool is_base64(BYTE c)
-{
-    return (isalnum(c) || (c == '+') || (c == '/'));
-}
-
-std::string base64_encode(BYTE const *buf, unsigned int bufLen)
+namespace yaml2pb
 {
-    std::string ret;
-    int i = 0;
-    int j = 0;
-    BYTE char_array_3[3];
-    BYTE char_array_4[4];
-
-    while (bufLen--)
-    {
-        char_array_3[i++] = *(buf++);
-        if (i == 3)
-        {
-            char_array_4[0] = (char_array_3[0] & 0xfc) >> 2;
-            char_array_4[1] = ((char_array_3[0] & 0x03) << 4) + ((char_array_3[1] & 0xf0) >> 4);
-            char_array_4[2] = ((char_array_3[1] & 0x0f) << 2) + ((char_array_3[2] & 0xc0) >> 6);
-            char_array_4[3] = char_array_3[2] & 0x3f;
-
-            for (i = 0; (i < 4); i++)
-                ret += base64_chars[char_array_4[i]];
-            i = 0;
-        }
-    }
-
-    if (i)
+    enum Base64Kernel
     {
-        for (j = i; j < 3; j++)
-            char_array_3[j] = '\0';
-
-        char_array_4[0] = (char_array_3[0] & 0xfc) >> 2;
-        char_array_4[1] = ((char_array_3[0] & 0x03) << 4) + ((char_array_3[1] & 0xf0) >> 4);
-        char_array_4[2] = ((char_array_3[1] & 0x0f) << 2) + ((char_array_3[2] & 0xc0) >> 6);
-        char_array_4[3] = char_array_3[2] & 0x3f;
-
-        for (j = 0; (j < i + 1); j++)
-            ret += base64_chars[char_array_4[j]];
-
-        while ((i++ < 3))
-            ret += '=';
-    }
-
-    return ret;
-}
-
-std::vector<BYTE> base64_decode(std::string const &encoded_string)
-{
-    int in_len = encoded_string.size();
-    int i = 0;
-    int j = 0;
-    int in_ = 0;
-    BYTE char_array_4[4], char_array_3[3];
-    std::vector<BYTE> ret;
-
-    while (in_len-- && (encoded_string[in_] != '=') && is_base64(encoded_string[in_]))
+        BASE64_SCALAR,
+        // SSSE3 shuffles with SSE4.1 validation, 12 bytes per step.
+        BASE64_SSE4,
+        // 24 bytes per step.
+        BASE64_AVX2,
+    };
+
+    // Fastest kernel this CPU supports, detected once through CPUID.
+    Base64Kernel base64_kernel();
+
+    // Replaces `out` with the base64 encoding of data[0, size).
+    void base64_encode(const char *data, size_t size, std::string &out);
+    void base64_encode(const char *data, size_t size, std::string &out, Base64Kernel kernel);
+
+    // Replaces `out` with the decoded bytes. Decoding stops at the first '='
+    // or character outside the base64 alphabet, and a trailing partial group
+    // yields as many whole bytes as it holds.
+    void base64_decode(const char *data, size_t size, std::string &out);
+    void base64_decode(const char *data, size_t size, std::string &out, Base64Kernel kernel);
+
+    inline std::string base64_encode(const std::string &data)
     {
-        char_array_4[i++] = encoded_string[in_];
-        in_++;
-        if (i == 4)
-        {
-            for (i = 0; i < 4; i++)
-                char_array_4[i] = base64_chars.find(char_array_4[i]);
-
-            char_array_3[0] = (char_array_4[0] << 2) + ((char_array_4[1] & 0x30) >> 4);
-            char_array_3[1] = ((char_array_4[1] & 0xf) << 4) + ((char_array_4[2] & 0x3c) >> 2);
-            char_array_3[2] = ((char_array_4[2] & 0x3) << 6) + char_array_4[3];
-
-            for (i = 0; (i < 3); i++)
-                ret.push_back(char_array_3[i]);
-            i = 0;
-        }
+        std::string out;
+        base64_encode(data.data(), data.size(), out);
+        return out;
     }
 
-    if (i)
+    inline std::string base64_decode(const std::string &data)
     {
-        for (j = i; j < 4; j++)
-            char_array_4[j] = 0;
-
-        for (j = 0; j < 4; j++)
-            char_array_4[j] = base64_chars.find(char_array_4[j]);
-
-        char_array_3[0] = (char_array_4[0] << 2) + ((char_array_4[1] & 0x30) >> 4);
-        char_array_3[1] = ((char_array_4[1] & 0xf) << 4) + ((char_array_4[2] & 0x3c) >> 2);
-        char_array_3[2] = ((char_array_4[2] & 0x3) << 6) + char_array_4[3];
-
-        for (j = 0; (j < i - 1); j++)
-            ret.push_back(char_array_3[j]);
+        std::string out;
+        base64_decode(data.data(), data.size(), out);
+        return out;
     }
-
-    return ret;
-}
-
+} // namespace yaml2pb
@@ -0,0 +1,262 @@
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "google/protobuf/descriptor.pb.h"
+#include "google/protobuf/io/coded_stream.h"
+
+#include "yaml2pb/cache.h"
+#include "decoder.h"
+#include "error.h"
+#include "file.h"
+#include "hash.h"
+#include "plan.h"
+
+namespace yaml2pb
+{
+    namespace
+    {
+        // Bumped whenever what an input decodes to may change, which leaves
+        // older entries unused.
+        const uint32_t cache_version = 1;
+        const char cache_magic[4] = {'y', '2', 'p', 'b'};
+
+        // Precedes the serialized message in every entry.
+        struct Header
+        {
+            char magic[4];
+            uint32_t version;
+            // The size of the input and a second hash of it, independent of
+            // the one naming the entry.
+            uint64_t size;
+            uint64_t check;
+            uint64_t fingerprint;
+            // Size of the serialized message after the header.
+            uint64_t payload;
+        };
+
+        void describe(const google::protobuf::EnumDescriptor *descriptor, std::unordered_set<const void *> &seen, std::string &text)
+        {
+            if (!seen.insert(descriptor).second)
+                return;
+            google::protobuf::EnumDescriptorProto proto;
+            descriptor->CopyTo(&proto);
+            text += descriptor->full_name();
+            proto.AppendToString(&text);
+        }
+
+        // Appends the definition of `descriptor` and of every type its
+        // fields refer to, once each.
+        void describe(const google::protobuf::Descriptor *descriptor, std::unordered_set<const void *> &seen, std::string &text)
+        {
+            if (!seen.insert(descriptor).second)
+                return;
+            google::protobuf::DescriptorProto proto;
+            descriptor->CopyTo(&proto);
+            text += descriptor->full_name();
+            proto.AppendToString(&text);
+
+            for (int i = 0; i < descriptor->field_count(); i++)
+            {
+                const google::protobuf::FieldDescriptor *field = descriptor->field(i);
+                if (field->message_type())
+                    describe(field->message_type(), seen, text);
+                else if (field->enum_type())
+                    describe(field->enum_type(), seen, text);
+            }
+        }
+
+        // Computed once per descriptor, and again after release_pool(),
+        // which may let another type reuse the address.
+        uint64_t fingerprint(const google::protobuf::Descriptor *descriptor)
+        {
+            static std::mutex lock;
+            static std::unordered_map<const google::protobuf::Descriptor *, uint64_t> fingerprints;
+            static uint64_t generation = 0;
+
+            std::lock_guard<std::mutex> guard(lock);
+            if (generation != plan_generation())
+            {
+                fingerprints.clear();
+                generation = plan_generation();
+            }
+            std::unordered_map<const google::protobuf::Descriptor *, uint64_t>::iterator it = fingerprints.find(descriptor);
+            if (it != fingerprints.end())
+                return it->second;
+
+            std::unordered_set<const void *> seen;
+            std::string text;
+            describe(descriptor, seen, text);
+            return fingerprints[descriptor] = hash_bytes(text.data(), text.size());
+        }
+    } // namespace
+
+    DecodeCache::DecodeCache(const std::string &directory, const DecodeOptions &options)
+        : _directory(directory), _options(options), _hits(0), _misses(0), _stores(0), _errors(0)
+    {
+    }
+
+    bool DecodeCache::decode(google::protobuf::Message &message, const char *data, size_t size, Error *error)
+    {
+        // Entries hold the document alone, serialized, which drops the zero
+        // values it sets; decoding on top of a non-empty message needs them.
+        const google::protobuf::Descriptor *descriptor = message.GetDescriptor();
+        if (!descriptor || !_options.element_path.empty() || _options.mask || !is_empty(message))
+            return try_yaml2pb(message, data, size, _options, error);
+
+        Error scratch;
+        Error &e = (error) ? *error : scratch;
+        e = Error();
+
+        // Options that change the result are part of the fingerprint.
+        const uint64_t type[2] = {fingerprint(descriptor), uint64_t(_options.underscores)};
+        const uint64_t fp = hash_bytes(reinterpret_cast<const char *>(type), sizeof(type));
+        const uint64_t key[2] = {hash_bytes(data, size), fp};
+        char name[32];
+        snprintf(name, sizeof(name), "/%016llx.pb", (unsigned long long)hash_bytes(reinterpret_cast<const char *>(key), sizeof(key)));
+        const std::string path = _directory + name;
+        const uint64_t check = hash_bytes(data, size, 1);
+
+        if (fetch(message, path, check, fp, size))
+        {
+            _hits++;
+            return true;
+        }
+        _misses++;
+
+        if (!try_yaml2pb(message, data, size, _options, &e))
+            return false;
+        store(message, path, check, fp, size);
+        return true;
+    }
+
+    bool DecodeCache::decode(google::protobuf::Message &message, const std::string &buf, Error *error)
+    {
+        return decode(message, buf.data(), buf.size(), error);
+    }
+
+    bool DecodeCache::load_file(google::protobuf::Message &message, const char *path, Error *error)
+    {
+        FileInput input;
+        if (int err = input.open(path))
+        {
+            Error scratch;
+            Error &e = (error) ? *error : scratch;
+            e = Error();
+            set_error(e, ERROR_IO, YAML::Mark::null_mark(), std::string(path) + ": " + strerror(err));
+            return false;
+        }
+        return decode(message, input.data(), input.size(), error);
+    }
+
+    // Parses the entry at `path` into the empty `message` if it holds the
+    // same input for the same type. Entries are only ever replaced by rename, so
+    // mapping them is safe.
+    bool DecodeCache::fetch(google::protobuf::Message &message, const std::string &path, uint64_t check, uint64_t fingerprint, size_t size)
+    {
+        FileInput entry;
+        if (int err = entry.open(path.c_str()))
+        {
+            if (err != ENOENT)
+                _errors++;
+            return false;
+        }
+
+        Header header;
+        if (entry.size() < sizeof(header))
+        {
+            _errors++;
+            return false;
+        }
+        memcpy(&header, entry.data(), sizeof(header));
+        if (memcmp(header.magic, cache_magic, sizeof(cache_magic)) != 0 || header.version != cache_version || header.payload != entry.size() - sizeof(header) || header.payload > INT_MAX)
+        {
+            _errors++;
+            return false;
+        }
+        // Another input whose hash names the same entry.
+        if (header.size != size || header.check != check || header.fingerprint != fingerprint)
+            return false;
+
+        google::protobuf::io::CodedInputStream input(reinterpret_cast<const uint8_t *>(entry.data() + sizeof(header)), int(header.payload));
+        if (!message.MergePartialFromCodedStream(&input) || !input.ConsumedEntireMessage())
+        {
+            message.Clear();
+            _errors++;
+            return false;
+        }
+        return true;
+    }
+
+    // Writes the entry to a temporary file next to it and renames it into
+    // place. Writers racing on one entry write the same bytes, so whichever
+    // rename lands last is as good as the others.
+    void DecodeCache::store(const google::protobuf::Message &message, const std::string &path, uint64_t check, uint64_t fingerprint, size_t size)
+    {
+        std::string data(sizeof(Header), '\0');
+        if (!message.AppendPartialToString(&data) || data.size() - sizeof(Header) > INT_MAX)
+        {
+            _errors++;
+            return;
+        }
+        Header header;
+        memcpy(header.magic, cache_magic, sizeof(cache_magic));
+        header.version = cache_version;
+        header.size = size;
+        header.check = check;
+        header.fingerprint = fingerprint;
+        header.payload = data.size() - sizeof(Header);
+        memcpy(&data[0], &header, sizeof(header));
+
+        std::string temporary = path + ".XXXXXX";
+        int fd = mkostemp(&temporary[0], O_CLOEXEC);
+        if (fd < 0 && errno == ENOENT && (mkdir(_directory.c_str(), 0777) == 0 || errno == EEXIST))
+        {
+            temporary = path + ".XXXXXX";
+            fd = mkostemp(&temporary[0], O_CLOEXEC);
+        }
+        if (fd < 0)
+        {
+            _errors++;
+            return;
+        }
+
+        // mkostemp() makes the file private; entries are meant to be shared.
+        bool ok = fchmod(fd, 0644) == 0;
+        for (size_t written = 0; ok && written < data.size();)
+        {
+            ssize_t n = write(fd, data.data() + written, data.size() - written);
+            if (n > 0)
+                written += n;
+            else if (n < 0 && errno != EINTR)
+                ok = false;
+        }
+        ok = (close(fd) == 0) && ok;
+        if (!ok || rename(temporary.c_str(), path.c_str()) != 0)
+        {
+            unlink(temporary.c_str());
+            _errors++;
+            return;
+        }
+        _stores++;
+    }
+
+    CacheStats DecodeCache::stats() const
+    {
+        CacheStats stats;
+        stats.hits = _hits;
+        stats.misses = _misses;
+        stats.stores = _stores;
+        stats.errors = _errors;
+        return stats;
+    }
+} // namespace yaml2pb
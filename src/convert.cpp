@@ -0,0 +1,381 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <locale.h>
+#include <stdlib.h>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "google/protobuf/message.h"
+#include "google/protobuf/reflection.h"
+#include "google/protobuf/descriptor.h"
+
+#include "convert.h"
+#include "exception.h"
+#include "base64.h"
+#include "plan.h"
+
+namespace yaml2pb
+{
+    // Mirrors YAML::convert<T>::decode for scalars, so the tree and the event
+    // engines accept exactly the same spellings.
+    static bool is_flexible_case(const std::string &str)
+    {
+        if (str.empty())
+            return true;
+
+        bool first_upper = str[0] >= 'A' && str[0] <= 'Z';
+        bool rest_upper = true, rest_lower = true;
+        for (size_t i = 1; i < str.size(); i++)
+        {
+            if (str[i] >= 'a' && str[i] <= 'z')
+                rest_upper = false;
+            else if (str[i] >= 'A' && str[i] <= 'Z')
+                rest_lower = false;
+        }
+        return rest_lower || (first_upper && rest_upper);
+    }
+
+    bool scalar_as(const std::string &input, bool &value, bool)
+    {
+        static const struct
+        {
+            const char *truename, *falsename;
+        } names[] = {
+            {"y", "n"},
+            {"yes", "no"},
+            {"true", "false"},
+            {"on", "off"},
+        };
+
+        if (!is_flexible_case(input))
+            return false;
+
+        std::string lower(input);
+        for (size_t i = 0; i < lower.size(); i++)
+            if (lower[i] >= 'A' && lower[i] <= 'Z')
+                lower[i] = lower[i] - 'A' + 'a';
+
+        for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+        {
+            if (lower == names[i].truename)
+            {
+                value = true;
+                return true;
+            }
+            if (lower == names[i].falsename)
+            {
+                value = false;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Value of `c` as a digit in `base`, or -1.
+    static int digit(char c, int base)
+    {
+        int d;
+        if (c >= '0' && c <= '9')
+            d = c - '0';
+        else if (c >= 'a' && c <= 'f')
+            d = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            d = c - 'A' + 10;
+        else
+            return -1;
+        return (d < base) ? d : -1;
+    }
+
+    // Whether `p` is a '_' separating two digits, when separators are allowed.
+    static bool is_separator(const char *p, const char *begin, const char *end, int base, bool underscores)
+    {
+        return underscores && *p == '_' && p > begin && p + 1 < end && digit(p[-1], base) >= 0 && digit(p[1], base) >= 0;
+    }
+
+    // End of `input` without the trailing whitespace std::ws would skip.
+    static const char *trim(const std::string &input)
+    {
+        const char *end = input.data() + input.size();
+        while (end > input.data() && (end[-1] == ' ' || (end[-1] >= '\t' && end[-1] <= '\r')))
+            end--;
+        return end;
+    }
+
+    // Integers as C literals: decimal, "0x" hex, "0" octal, plus the YAML 1.2
+    // "0o" octal, with an optional sign. Values outside the range of T are
+    // rejected rather than wrapped or clamped.
+    template <typename T>
+    static bool parse_integer(const std::string &input, T &value, bool underscores)
+    {
+        const char *p = input.data(), *end = trim(input);
+        const bool negative = p < end && *p == '-';
+        if (p < end && (*p == '-' || *p == '+'))
+            p++;
+        if (negative && std::is_unsigned<T>::value)
+            return false;
+
+        int base = 10;
+        if (end - p >= 2 && p[0] == '0')
+        {
+            if (p[1] == 'x' || p[1] == 'X')
+                base = 16, p += 2;
+            else if (p[1] == 'o')
+                base = 8, p += 2;
+            else
+                base = 8, p += 1;
+        }
+
+        const char *digits = p;
+        uint64_t n = 0;
+        for (; p < end; p++)
+        {
+            if (is_separator(p, digits, end, base, underscores))
+                continue;
+            const int d = digit(*p, base);
+            if (d < 0 || n > (std::numeric_limits<uint64_t>::max() - d) / base)
+                return false;
+            n = n * base + d;
+        }
+        if (p == digits)
+            return false;
+
+        const uint64_t max = uint64_t(std::numeric_limits<T>::max());
+        if (n > max + ((negative) ? 1 : 0))
+            return false;
+        value = (negative && n) ? T(-int64_t(n - 1) - 1) : T(n);
+        return true;
+    }
+
+    // strtod() alone would follow the global locale, whose decimal point may
+    // be a comma.
+    static locale_t c_locale()
+    {
+        static const locale_t locale = newlocale(LC_ALL_MASK, "C", (locale_t)0);
+        return locale;
+    }
+
+    static double parse_slow(const char *text, double) { return strtod_l(text, 0, c_locale()); }
+    static float parse_slow(const char *text, float) { return strtof_l(text, 0, c_locale()); }
+
+    // Decimal reals, ".inf" and ".nan". Up to 19 significant digits with a
+    // small exponent convert exactly with one multiplication or division
+    // (Clinger's fast path); anything else goes to strtod in the C locale.
+    // Overflow is rejected, underflow rounds towards zero.
+    template <typename T>
+    static bool parse_real(const std::string &input, T &value, bool underscores)
+    {
+        static const double powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+        // Largest exact mantissa and power of ten of T.
+        const uint64_t max_mantissa = uint64_t(1) << std::numeric_limits<T>::digits;
+        const int max_power = (std::numeric_limits<T>::digits > 24) ? 22 : 10;
+
+        const char *begin = input.data(), *end = trim(input), *p = begin;
+        const bool negative = p < end && *p == '-';
+        if (p < end && (*p == '-' || *p == '+'))
+            p++;
+
+        if (p < end && *p == '.' && end - p == 4)
+        {
+            const std::string word(p, end);
+            if (word == ".inf" || word == ".Inf" || word == ".INF")
+            {
+                value = (negative) ? -std::numeric_limits<T>::infinity() : std::numeric_limits<T>::infinity();
+                return true;
+            }
+            if ((word == ".nan" || word == ".NaN" || word == ".NAN") && p == begin)
+            {
+                value = std::numeric_limits<T>::quiet_NaN();
+                return true;
+            }
+        }
+
+        uint64_t mantissa = 0;
+        int significant = 0, exponent = 0;
+        bool digits = false, truncated = false, separated = false;
+        for (bool fraction = false; p < end; p++)
+        {
+            if (*p == '.' && !fraction)
+            {
+                fraction = true;
+                continue;
+            }
+            if (is_separator(p, begin, end, 10, underscores))
+            {
+                separated = true;
+                continue;
+            }
+            const int d = digit(*p, 10);
+            if (d < 0)
+                break;
+            digits = true;
+            if (significant < 19)
+            {
+                if (mantissa || d)
+                {
+                    mantissa = mantissa * 10 + d;
+                    significant++;
+                }
+                exponent -= fraction;
+            }
+            else
+            {
+                truncated = truncated || d;
+                exponent += !fraction;
+            }
+        }
+        if (!digits)
+            return false;
+
+        if (p < end && (*p == 'e' || *p == 'E'))
+        {
+            p++;
+            const bool negative_exponent = p < end && *p == '-';
+            if (p < end && (*p == '-' || *p == '+'))
+                p++;
+            const char *start = p;
+            int n = 0;
+            for (; p < end; p++)
+            {
+                if (is_separator(p, start, end, 10, underscores))
+                {
+                    separated = true;
+                    continue;
+                }
+                const int d = digit(*p, 10);
+                if (d < 0)
+                    break;
+                n = std::min(n * 10 + d, 100000);
+            }
+            if (p == start)
+                return false;
+            exponent += (negative_exponent) ? -n : n;
+        }
+        if (p != end)
+            return false;
+
+        if (!truncated && mantissa <= max_mantissa && exponent >= -max_power && exponent <= max_power)
+        {
+            // T holds both factors exactly, so the result is correctly rounded.
+            T result = T(mantissa);
+            if (exponent < 0)
+                result /= T(powers[-exponent]);
+            else
+                result *= T(powers[exponent]);
+            value = (negative) ? -result : result;
+            return true;
+        }
+
+        T result;
+        if (separated)
+        {
+            std::string text;
+            for (const char *c = begin; c < end; c++)
+                if (*c != '_')
+                    text += *c;
+            result = parse_slow(text.c_str(), T());
+        }
+        else
+            result = parse_slow(begin, T());
+        if (std::isinf(result))
+            return false;
+        value = result;
+        return true;
+    }
+
+    bool scalar_as(const std::string &input, double &value, bool underscores) { return parse_real(input, value, underscores); }
+    bool scalar_as(const std::string &input, float &value, bool underscores) { return parse_real(input, value, underscores); }
+    bool scalar_as(const std::string &input, int64_t &value, bool underscores) { return parse_integer(input, value, underscores); }
+    bool scalar_as(const std::string &input, uint64_t &value, bool underscores) { return parse_integer(input, value, underscores); }
+    bool scalar_as(const std::string &input, int32_t &value, bool underscores) { return parse_integer(input, value, underscores); }
+    bool scalar_as(const std::string &input, uint32_t &value, bool underscores) { return parse_integer(input, value, underscores); }
+
+    template <typename T, void (google::protobuf::Reflection::*store)(google::protobuf::Message *, const google::protobuf::FieldDescriptor *, T) const>
+    static bool set_number(google::protobuf::Message &msg, const google::protobuf::FieldDescriptor *field, const std::string &value, bool underscores)
+    {
+        T number;
+        if (!scalar_as(value, number, underscores))
+            return false;
+        (msg.GetReflection()->*store)(&msg, field, number);
+        return true;
+    }
+
+    template <void (google::protobuf::Reflection::*store)(google::protobuf::Message *, const google::protobuf::FieldDescriptor *, std::string) const>
+    static bool set_string(google::protobuf::Message &msg, const google::protobuf::FieldDescriptor *field, const std::string &value, bool)
+    {
+        (msg.GetReflection()->*store)(&msg, field, value);
+        return true;
+    }
+
+    template <void (google::protobuf::Reflection::*store)(google::protobuf::Message *, const google::protobuf::FieldDescriptor *, std::string) const>
+    static bool set_bytes(google::protobuf::Message &msg, const google::protobuf::FieldDescriptor *field, const std::string &value, bool)
+    {
+        std::string data;
+        base64_decode(value.data(), value.size(), data);
+        (msg.GetReflection()->*store)(&msg, field, std::move(data));
+        return true;
+    }
+
+    template <void (google::protobuf::Reflection::*store)(google::protobuf::Message *, const google::protobuf::FieldDescriptor *, const google::protobuf::EnumValueDescriptor *) const>
+    static bool set_enum(google::protobuf::Message &msg, const google::protobuf::FieldDescriptor *field, const std::string &value, bool)
+    {
+        const google::protobuf::EnumValueDescriptor *ev = EnumTable::get(field->enum_type())->find(value);
+        if (!ev)
+            return false;
+        (msg.GetReflection()->*store)(&msg, field, ev);
+        return true;
+    }
+
+    scalar_setter resolve_setter(const google::protobuf::FieldDescriptor *field)
+    {
+        const bool repeated = field->is_repeated();
+
+        switch (field->cpp_type())
+        {
+#define _CONVERT(pbtype, ctype, setfunc, addfunc)                                                 \
+    case google::protobuf::FieldDescriptor::pbtype:                                               \
+        return (repeated) ? set_number<ctype, &google::protobuf::Reflection::addfunc>             \
+                          : set_number<ctype, &google::protobuf::Reflection::setfunc>;
+
+            _CONVERT(CPPTYPE_DOUBLE, double, SetDouble, AddDouble);
+            _CONVERT(CPPTYPE_FLOAT, float, SetFloat, AddFloat);
+            _CONVERT(CPPTYPE_INT64, int64_t, SetInt64, AddInt64);
+            _CONVERT(CPPTYPE_UINT64, uint64_t, SetUInt64, AddUInt64);
+            _CONVERT(CPPTYPE_INT32, int32_t, SetInt32, AddInt32);
+            _CONVERT(CPPTYPE_UINT32, uint32_t, SetUInt32, AddUInt32);
+            _CONVERT(CPPTYPE_BOOL, bool, SetBool, AddBool);
+
+#undef _CONVERT
+
+        case google::protobuf::FieldDescriptor::CPPTYPE_STRING:
+            if (field->type() == google::protobuf::FieldDescriptor::TYPE_BYTES)
+                return (repeated) ? set_bytes<&google::protobuf::Reflection::AddString> : set_bytes<&google::protobuf::Reflection::SetString>;
+            return (repeated) ? set_string<&google::protobuf::Reflection::AddString> : set_string<&google::protobuf::Reflection::SetString>;
+
+        case google::protobuf::FieldDescriptor::CPPTYPE_ENUM:
+            return (repeated) ? set_enum<&google::protobuf::Reflection::AddEnum> : set_enum<&google::protobuf::Reflection::SetEnum>;
+
+        default:
+            return 0;
+        }
+    }
+
+    void scalar2field(google::protobuf::Message &msg, const google::protobuf::FieldDescriptor *field, const std::string &value)
+    {
+        scalar_setter set = resolve_setter(field);
+        if (!set)
+            throw exception(field, "not a scalar field");
+        if (!set(msg, field, value, false))
+            throw exception(field, invalid_value(field, value));
+    }
+
+    std::string invalid_value(const google::protobuf::FieldDescriptor *field, const std::string &value)
+    {
+        if (field->cpp_type() == google::protobuf::FieldDescriptor::CPPTYPE_ENUM)
+            return "Enum value not found:" + value;
+        return "invalid value '" + value + "'";
+    }
+} // namespace yaml2pb
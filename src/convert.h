@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "google/protobuf/message.h"
+#include "google/protobuf/descriptor.h"
+
+namespace yaml2pb
+{
+    // Parse the text of a YAML scalar the way YAML::Node::as<T>() does,
+    // without its stringstream: integers in decimal, "0x" hex, "0" or "0o"
+    // octal, reals in decimal or as ".inf" and ".nan". Values out of the
+    // range of the type are rejected. With `underscores`, '_' may separate
+    // digits of a number, as in 1_000_000.
+    bool scalar_as(const std::string &input, double &value, bool underscores = false);
+    bool scalar_as(const std::string &input, float &value, bool underscores = false);
+    bool scalar_as(const std::string &input, int64_t &value, bool underscores = false);
+    bool scalar_as(const std::string &input, uint64_t &value, bool underscores = false);
+    bool scalar_as(const std::string &input, int32_t &value, bool underscores = false);
+    bool scalar_as(const std::string &input, uint32_t &value, bool underscores = false);
+    bool scalar_as(const std::string &input, bool &value, bool underscores = false);
+
+    // Converts the text of a YAML scalar and stores it into `field` of `msg`,
+    // appending when the field is repeated. Returns false, leaving `msg`
+    // untouched, when the text does not convert. `underscores` is passed on
+    // to scalar_as() for numbers.
+    typedef bool (*scalar_setter)(google::protobuf::Message &msg, const google::protobuf::FieldDescriptor *field, const std::string &value, bool underscores);
+
+    // Resolves once the setter matching the type and label of `field`, or 0
+    // for message-typed fields.
+    scalar_setter resolve_setter(const google::protobuf::FieldDescriptor *field);
+
+    // Sets `field` of `msg` (appends to it when repeated) from the text of a
+    // YAML scalar. Message-typed fields are left to the caller.
+    void scalar2field(google::protobuf::Message &msg, const google::protobuf::FieldDescriptor *field, const std::string &value);
+
+    // Describes why a scalar_setter rejected `value`.
+    std::string invalid_value(const google::protobuf::FieldDescriptor *field, const std::string &value);
+} // namespace yaml2pb
@@ -0,0 +1,543 @@
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/message.h"
+#include "google/protobuf/reflection.h"
+#include "google/protobuf/descriptor.h"
+#include "yaml-cpp/eventhandler.h"
+#include "yaml-cpp/exceptions.h"
+#include "yaml-cpp/parser.h"
+
+#include "arena.h"
+#include "decoder.h"
+#include "error.h"
+#include "mapkeys.h"
+#include "mask.h"
+#include "plan.h"
+
+namespace yaml2pb
+{
+    namespace
+    {
+        struct alias_found
+        {
+        };
+
+        // Mirrors the tree walk in yaml2pb.cpp: each open YAML collection is a
+        // frame, and scalars are converted as soon as the parser reports them.
+        // The first error is recorded and every later event ignored, so a bad
+        // document costs no exception.
+        class EventDecoder : public YAML::EventHandler
+        {
+            struct Frame
+            {
+                enum Kind
+                {
+                    MESSAGE,  // mapping of field names to values
+                    SEQUENCE, // elements of a repeated field
+                    MAP,      // entries of a map field
+                    SKIP,     // a value outside DecodeOptions::mask
+                };
+
+                Kind kind;
+                google::protobuf::Message *message;
+                // MESSAGE: plan of `message`.
+                // SEQUENCE / MAP: unused, `field->child` describes the elements.
+                const Plan *plan;
+                // MESSAGE: field whose value is expected next, 0 while expecting a key.
+                // SEQUENCE / MAP: the repeated or map field being filled.
+                const FieldPlan *field;
+                // Field of the enclosing MESSAGE frame this frame belongs to.
+                const FieldPlan *via;
+                // SEQUENCE: elements started so far.
+                // SKIP: collections opened within the skipped one.
+                size_t count;
+                // MAP: entry whose key has been read and which awaits its value,
+                // appended to the map field in place; the text of that key; and
+                // the keys seen so far.
+                google::protobuf::Message *entry;
+                std::string key;
+                MapKeys keys;
+                // MESSAGE: how many fields of the element path lead here, or
+                // -1 if it is off the path.
+                int depth;
+                // SEQUENCE: elements go to the element callback.
+                bool streamed;
+                // MESSAGE: what is selected within `message`.
+                // SEQUENCE / MAP: what is selected within each element.
+                // 0 selects everything.
+                const MaskNode *mask;
+
+                Frame(Kind k, google::protobuf::Message *m, const Plan *p, const FieldPlan *f, const FieldPlan *v)
+                    : kind(k), message(m), plan(p), field(f), via(v), count(0), entry(0), depth(-1), streamed(false), mask(0)
+                {
+                }
+            };
+
+            google::protobuf::Message &_root;
+            std::vector<Frame> _stack;
+            // Plans of extensions met in this document; a deque keeps them in place.
+            std::deque<FieldPlan> _extensions;
+            bool _seen_root;
+            // Position of the event being handled.
+            YAML::Mark _mark;
+            Error &_error;
+            ElementStream *_stream;
+            bool _underscores;
+            const MaskNode *_mask;
+            // Reused for every element of the streamed field. It lives on the
+            // heap even with an arena, which would keep every element's
+            // allocations until the end of the document.
+            std::unique_ptr<google::protobuf::Message> _element;
+
+        public:
+            EventDecoder(google::protobuf::Message &root, ElementStream *stream, bool underscores, const MaskNode *mask, Error &error)
+                : _root(root), _seen_root(false), _error(error), _stream(stream), _underscores(underscores), _mask(mask)
+            {
+            }
+
+            bool failed() const { return _error.kind != ERROR_NONE; }
+
+            void finish()
+            {
+                if (!failed() && !_seen_root)
+                    fail(ERROR_TYPE, "", "invalid node");
+            }
+
+            virtual void OnDocumentStart(const YAML::Mark &) {}
+            virtual void OnDocumentEnd() {}
+
+            virtual void OnNull(const YAML::Mark &mark, YAML::anchor_t)
+            {
+                // yaml-cpp reads a null node as the string "null".
+                static const std::string null_value("null");
+                if (failed())
+                    return;
+                _mark = mark;
+                scalar(null_value);
+            }
+
+            virtual void OnAlias(const YAML::Mark &, YAML::anchor_t)
+            {
+                if (!failed())
+                    throw alias_found();
+            }
+
+            virtual void OnScalar(const YAML::Mark &mark, const std::string &, YAML::anchor_t, const std::string &value)
+            {
+                if (failed())
+                    return;
+                _mark = mark;
+                scalar(value);
+            }
+
+            virtual void OnSequenceStart(const YAML::Mark &mark, const std::string &, YAML::anchor_t, YAML::EmitterStyle::value)
+            {
+                if (failed())
+                    return;
+                _mark = mark;
+                if (_stack.empty())
+                    return fail(ERROR_TYPE, "", "invalid node");
+
+                Frame &top = _stack.back();
+                switch (top.kind)
+                {
+                case Frame::MESSAGE: {
+                    const FieldPlan *field = take_field(top);
+                    if (!field)
+                        return;
+                    const MaskNode *within;
+                    if (!MaskNode::select(top.mask, field->field, within))
+                        return skip();
+                    if (field->is(FieldPlan::MAP))
+                        return fail(ERROR_TYPE, field_key(field->field), "invalid map");
+                    if (!field->is(FieldPlan::REPEATED))
+                        return fail(ERROR_TYPE, field_key(field->field), "invalid value");
+                    const bool streamed = on_path(top, field) && top.depth + 1 == int(_stream->path.size());
+                    _stack.push_back(Frame(Frame::SEQUENCE, top.message, 0, field, field));
+                    _stack.back().streamed = streamed;
+                    _stack.back().mask = within;
+                    break;
+                }
+                case Frame::SEQUENCE:
+                    top.count++;
+                    return fail(ERROR_TYPE, "", "invalid array");
+                case Frame::MAP:
+                    return fail(ERROR_TYPE, "", "invalid map");
+                case Frame::SKIP:
+                    top.count++;
+                    break;
+                }
+            }
+
+            virtual void OnSequenceEnd()
+            {
+                if (!failed())
+                    end_collection();
+            }
+
+            virtual void OnMapStart(const YAML::Mark &mark, const std::string &, YAML::anchor_t, YAML::EmitterStyle::value)
+            {
+                if (failed())
+                    return;
+                _mark = mark;
+                if (_stack.empty())
+                {
+                    if (_seen_root)
+                        return fail(ERROR_TYPE, "", "invalid node");
+                    _seen_root = true;
+                    _stack.push_back(Frame(Frame::MESSAGE, &_root, Plan::get(_root.GetDescriptor()), 0, 0));
+                    _stack.back().depth = (_stream) ? 0 : -1;
+                    _stack.back().mask = _mask;
+                    return;
+                }
+
+                Frame &top = _stack.back();
+                switch (top.kind)
+                {
+                case Frame::MESSAGE: {
+                    const FieldPlan *field = take_field(top);
+                    if (!field)
+                        return;
+                    const MaskNode *within;
+                    if (!MaskNode::select(top.mask, field->field, within))
+                        return skip();
+                    google::protobuf::Message *message = top.message;
+                    if (field->is(FieldPlan::MAP))
+                        _stack.push_back(Frame(Frame::MAP, message, 0, field, field));
+                    else if (field->is(FieldPlan::REPEATED))
+                        return fail(ERROR_TYPE, field_key(field->field), "invalid array");
+                    else if (field->is(FieldPlan::MESSAGE))
+                    {
+                        const int depth = (on_path(top, field)) ? top.depth + 1 : -1;
+                        _stack.push_back(Frame(Frame::MESSAGE, message->GetReflection()->MutableMessage(message, field->field), field->child, 0, field));
+                        _stack.back().depth = depth;
+                        _stack.back().mask = within;
+                    }
+                    else
+                        return fail(ERROR_TYPE, field_key(field->field), "invalid value");
+                    break;
+                }
+                case Frame::SEQUENCE: {
+                    const FieldPlan *field = top.field;
+                    top.count++;
+                    if (!field->is(FieldPlan::MESSAGE))
+                        return fail(ERROR_TYPE, "", "invalid value");
+                    google::protobuf::Message *message = (top.streamed) ? &element(top) : top.message->GetReflection()->AddMessage(top.message, field->field);
+                    _stack.push_back(Frame(Frame::MESSAGE, message, field->child, 0, 0));
+                    _stack.back().mask = top.mask;
+                    break;
+                }
+                case Frame::MAP: {
+                    if (!top.entry)
+                        return fail(ERROR_TYPE, "", "invalid map key");
+                    const FieldPlan &value_field = map_value(top);
+                    if (!value_field.is(FieldPlan::MESSAGE))
+                        return fail(ERROR_TYPE, "", "invalid map value");
+                    google::protobuf::Message *message = top.entry->GetReflection()->MutableMessage(top.entry, value_field.field);
+                    _stack.push_back(Frame(Frame::MESSAGE, message, value_field.child, 0, 0));
+                    break;
+                }
+                case Frame::SKIP:
+                    top.count++;
+                    break;
+                }
+            }
+
+            virtual void OnMapEnd()
+            {
+                if (!failed())
+                    end_collection();
+            }
+
+        private:
+            void fail(ErrorKind kind, const std::string &last, const std::string &message)
+            {
+                if (failed())
+                    return;
+                set_error(_error, kind, _mark, message);
+                _error.path = path(last);
+            }
+
+            // Path of what is being decoded, `last` naming the field of the
+            // innermost message if there is one.
+            std::string path(const std::string &last) const
+            {
+                std::string path;
+                for (size_t i = 0; i < _stack.size(); i++)
+                {
+                    const Frame &frame = _stack[i];
+                    const bool innermost = i + 1 == _stack.size();
+                    switch (frame.kind)
+                    {
+                    case Frame::MESSAGE:
+                        if (innermost && !last.empty())
+                            append_field(path, last);
+                        else if (!innermost && _stack[i + 1].via)
+                            append_field(path, field_key(_stack[i + 1].via->field));
+                        break;
+                    case Frame::SEQUENCE:
+                        if (frame.count)
+                            append_index(path, frame.count - 1);
+                        break;
+                    case Frame::MAP:
+                        if (frame.entry)
+                            append_key(path, frame.key);
+                        break;
+                    case Frame::SKIP:
+                        break;
+                    }
+                }
+                return path;
+            }
+
+            const FieldPlan *take_field(Frame &top)
+            {
+                const FieldPlan *field = top.field;
+                if (!field)
+                {
+                    fail(ERROR_TYPE, "", "invalid key");
+                    return 0;
+                }
+                top.field = 0;
+                return field;
+            }
+
+            static const FieldPlan &map_key(const Frame &frame)
+            {
+                const Plan *entry = frame.field->child;
+                return entry->field(entry->descriptor()->map_key()->index());
+            }
+
+            static const FieldPlan &map_value(const Frame &frame)
+            {
+                const Plan *entry = frame.field->child;
+                return entry->field(entry->descriptor()->map_value()->index());
+            }
+
+            const FieldPlan *find_field(const Frame &frame, const std::string &name)
+            {
+                const FieldPlan *field = frame.plan->find(name);
+                if (field)
+                    return field;
+
+                const google::protobuf::FieldDescriptor *extension = frame.message->GetReflection()->FindKnownExtensionByName(name);
+                if (!extension)
+                {
+                    fail(ERROR_UNKNOWN_FIELD, name, "unknown field '" + name + "'");
+                    return 0;
+                }
+                _extensions.push_back(FieldPlan::compile(extension));
+                return &_extensions.back();
+            }
+
+            // The value of a key outside the mask: a collection to pass over
+            // whole.
+            void skip()
+            {
+                _stack.push_back(Frame(Frame::SKIP, 0, 0, 0, 0));
+            }
+
+            void end_collection()
+            {
+                Frame &top = _stack.back();
+                if (top.kind == Frame::SKIP && top.count)
+                {
+                    top.count--;
+                    return;
+                }
+                const Frame::Kind kind = top.kind;
+                _stack.pop_back();
+                if (_stack.empty())
+                    return;
+                if (_stack.back().kind == Frame::MAP)
+                    _stack.back().entry = 0;
+                else if (_stack.back().streamed && kind == Frame::MESSAGE)
+                    deliver();
+            }
+
+            // Whether `field` of the MESSAGE frame `top` is the next one on
+            // the element path.
+            bool on_path(const Frame &top, const FieldPlan *field) const
+            {
+                return top.depth >= 0 && top.depth < int(_stream->path.size()) && _stream->path[top.depth] == field->field;
+            }
+
+            // The element message, cleared for the next element of `frame`.
+            google::protobuf::Message &element(const Frame &frame)
+            {
+                if (!_element)
+                {
+                    const google::protobuf::Message &parent = *frame.message;
+                    _element.reset(parent.GetReflection()->GetMessageFactory()->GetPrototype(frame.field->field->message_type())->New());
+                }
+                else
+                    _element->Clear();
+                return *_element;
+            }
+
+            void deliver()
+            {
+                if (*_stream->callback)
+                    (*_stream->callback)(*_element, _stream->delivered);
+                _stream->delivered++;
+            }
+
+            bool set(google::protobuf::Message &message, const FieldPlan &field, const std::string &value, const std::string &last)
+            {
+                if (field.set(message, field.field, value, _underscores))
+                    return true;
+                fail(ERROR_VALUE, last, invalid_value(field.field, value));
+                return false;
+            }
+
+            void scalar(const std::string &value)
+            {
+                if (_stack.empty())
+                    return fail(ERROR_TYPE, "", "invalid node");
+
+                Frame &top = _stack.back();
+                switch (top.kind)
+                {
+                case Frame::MESSAGE: {
+                    if (!top.field)
+                    {
+                        top.field = find_field(top, value);
+                        break;
+                    }
+                    const FieldPlan *field = take_field(top);
+                    const MaskNode *within;
+                    if (!MaskNode::select(top.mask, field->field, within))
+                        break;
+                    if (field->is(FieldPlan::MAP))
+                        return fail(ERROR_TYPE, field_key(field->field), "invalid map");
+                    if (field->is(FieldPlan::REPEATED))
+                        return fail(ERROR_TYPE, field_key(field->field), "invalid array");
+                    if (field->is(FieldPlan::MESSAGE))
+                        top.message->GetReflection()->MutableMessage(top.message, field->field);
+                    else
+                        set(*top.message, *field, value, field_key(field->field));
+                    break;
+                }
+                case Frame::SEQUENCE: {
+                    const FieldPlan *field = top.field;
+                    top.count++;
+                    if (top.streamed)
+                    {
+                        element(top);
+                        deliver();
+                    }
+                    else if (field->is(FieldPlan::MESSAGE))
+                        top.message->GetReflection()->AddMessage(top.message, field->field);
+                    else
+                        set(*top.message, *field, value, "");
+                    break;
+                }
+                case Frame::MAP: {
+                    if (!top.entry)
+                    {
+                        // Entries go straight into the map field's repeated
+                        // representation: reflection has no way to insert
+                        // into the map itself. Each is allocated as a
+                        // message, and protobuf copies them into map nodes
+                        // on first map access.
+                        const google::protobuf::Reflection *ref = top.message->GetReflection();
+                        top.entry = ref->AddMessage(top.message, top.field->field);
+                        top.key = value;
+                        if (!set(*top.entry, map_key(top), value, ""))
+                            break;
+                        if (!top.keys.insert(*top.message, top.field->field, ref->FieldSize(*top.message, top.field->field) - 1))
+                            fail(ERROR_DUPLICATE_KEY, "", "duplicate key '" + value + "'");
+                        break;
+                    }
+                    const FieldPlan &value_field = map_value(top);
+                    if (value_field.is(FieldPlan::MESSAGE))
+                        top.entry->GetReflection()->MutableMessage(top.entry, value_field.field);
+                    else if (!set(*top.entry, value_field, value, ""))
+                        break;
+                    top.entry = 0;
+                    break;
+                }
+                case Frame::SKIP:
+                    break;
+                }
+            }
+        };
+    } // namespace
+
+    bool is_empty(const google::protobuf::Message &message)
+    {
+        const google::protobuf::Reflection *ref = message.GetReflection();
+        std::vector<const google::protobuf::FieldDescriptor *> fields;
+        ref->ListFields(message, &fields);
+        return fields.empty() && ref->GetUnknownFields(message).empty();
+    }
+
+    bool ElementStream::resolve(const google::protobuf::Message &message, const DecodeOptions &options)
+    {
+        path.clear();
+        callback = &options.on_element;
+        const google::protobuf::Descriptor *descriptor = message.GetDescriptor();
+        for (size_t begin = 0; descriptor;)
+        {
+            size_t end = options.element_path.find('.', begin);
+            const google::protobuf::FieldDescriptor *field = descriptor->FindFieldByName(options.element_path.substr(begin, end - begin));
+            if (!field || field->cpp_type() != google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE || field->is_map())
+                return false;
+            path.push_back(field);
+            if (end == std::string::npos)
+                return field->is_repeated();
+            if (field->is_repeated())
+                return false;
+            descriptor = field->message_type();
+            begin = end + 1;
+        }
+        return false;
+    }
+
+    EventStatus decode_events(google::protobuf::Message &message, std::istream &in, const DecodeOptions &options, ElementStream *stream, Error &error)
+    {
+        if (!message.GetDescriptor() || !message.GetReflection())
+        {
+            set_error(error, ERROR_DESCRIPTOR, YAML::Mark::null_mark(), "No descriptor or reflection");
+            return EVENTS_FAILED;
+        }
+
+        // A fallback must start from the original message, so a copy of a
+        // non-empty one is kept until the document is known to be
+        // alias-free. Decoding still happens in place: merging a separate
+        // result in would drop proto3 fields set to zero or empty, which
+        // MergeFrom() takes for unset.
+        message_ptr original;
+        if (!is_empty(message))
+        {
+            original.reset(message.New(options.arena));
+            original->CopyFrom(message);
+        }
+
+        EventDecoder decoder(message, stream, options.underscores, (options.mask) ? options.mask->root() : 0, error);
+        YAML::Parser parser(in);
+        try
+        {
+            parser.HandleNextDocument(decoder);
+        }
+        catch (const alias_found &)
+        {
+            if (original)
+                message.CopyFrom(*original);
+            else
+                message.Clear();
+            return EVENTS_ALIASED;
+        }
+        catch (const YAML::ParserException &e)
+        {
+            // yaml-cpp itself only reports syntax errors by throwing.
+            if (!decoder.failed())
+                set_error(error, ERROR_SYNTAX, e.mark, e.msg);
+        }
+        decoder.finish();
+        return (decoder.failed()) ? EVENTS_FAILED : EVENTS_DECODED;
+    }
+} // namespace yaml2pb
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <istream>
+#include <vector>
+
+#include "google/protobuf/arena.h"
+#include "google/protobuf/message.h"
+
+#include "yaml2pb/yaml2pb.h"
+
+namespace yaml2pb
+{
+    enum EventStatus
+    {
+        EVENTS_DECODED,
+        // `error` says why.
+        EVENTS_FAILED,
+        // The document uses aliases, which can only be resolved against a
+        // tree; `message` is left untouched.
+        EVENTS_ALIASED,
+    };
+
+    // DecodeOptions::element_path resolved against a message type, and how
+    // far streaming it has got.
+    struct ElementStream
+    {
+        ElementStream()
+            : callback(0), existing(0), delivered(0)
+        {
+        }
+
+        // Singular message fields leading to the streamed repeated field,
+        // which comes last.
+        std::vector<const google::protobuf::FieldDescriptor *> path;
+        const ElementCallback *callback;
+        // Elements the field already held before decoding.
+        int existing;
+        // Elements passed to `callback` so far.
+        size_t delivered;
+
+        // Resolves options.element_path for `message`; false if it does not
+        // name a repeated message field.
+        bool resolve(const google::protobuf::Message &message, const DecodeOptions &options);
+    };
+
+    // Decodes the first document of `in` into `message` straight from
+    // yaml-cpp parser events, without building a YAML::Node tree. Transient
+    // messages are created on `options.arena`, or on the heap if it is null.
+    // With a `stream`, its elements go to the callback as soon as each is
+    // complete.
+    EventStatus decode_events(google::protobuf::Message &message, std::istream &in, const DecodeOptions &options, ElementStream *stream, Error &error);
+
+    // No fields set and no unknown fields.
+    bool is_empty(const google::protobuf::Message &message);
+
+    // What every entry point comes down to: decodes data[0, size) with the
+    // engine chosen in `options`, reading the input in place.
+    bool decode_buffer(google::protobuf::Message &message, const char *data, size_t size, const DecodeOptions &options, Error &error);
+} // namespace yaml2pb
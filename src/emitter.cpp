@@ -0,0 +1,212 @@
+#include <cstring>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/message.h"
+#include "google/protobuf/reflection.h"
+#include "google/protobuf/descriptor.h"
+#include "yaml-cpp/yaml.h"
+
+#include "yaml2pb/yaml2pb.h"
+#include "base64.h"
+#include "format.h"
+#include "exception.h"
+#include "mask.h"
+
+namespace yaml2pb
+{
+    namespace
+    {
+        // Collects what YAML::Emitter writes in a small buffer and hands it
+        // to the Sink in chunks.
+        class sinkbuf : public std::streambuf
+        {
+            Sink &_sink;
+            char _buffer[4096];
+
+        public:
+            explicit sinkbuf(Sink &sink)
+                : _sink(sink)
+            {
+                setp(_buffer, _buffer + sizeof(_buffer));
+            }
+
+        protected:
+            virtual int_type overflow(int_type ch)
+            {
+                sync();
+                if (!traits_type::eq_int_type(ch, traits_type::eof()))
+                {
+                    *pptr() = traits_type::to_char_type(ch);
+                    pbump(1);
+                }
+                return traits_type::not_eof(ch);
+            }
+
+            virtual std::streamsize xsputn(const char *s, std::streamsize n)
+            {
+                if (n > epptr() - pptr())
+                {
+                    sync();
+                    if (n >= epptr() - pptr())
+                    {
+                        _sink.write(s, n);
+                        return n;
+                    }
+                }
+                memcpy(pptr(), s, n);
+                pbump(n);
+                return n;
+            }
+
+            virtual int sync()
+            {
+                if (pptr() > pbase())
+                    _sink.write(pbase(), pptr() - pbase());
+                setp(_buffer, _buffer + sizeof(_buffer));
+                return 0;
+            }
+        };
+    } // namespace
+
+    static void message2emitter(YAML::Emitter &out, const google::protobuf::Message &message, const MaskNode *mask);
+
+    // `mask` is what is selected within message values.
+    static void field2emitter(YAML::Emitter &out, const google::protobuf::Message &message, const google::protobuf::FieldDescriptor *field, int index, const MaskNode *mask)
+    {
+        const google::protobuf::Reflection *ref = message.GetReflection();
+        const bool repeated = field->is_repeated();
+
+        switch (field->cpp_type())
+        {
+#define _CONVERT(type, ctype, setfunc, addfunc)                                                             \
+    case google::protobuf::FieldDescriptor::type:                                                           \
+        out << number_text((repeated) ? ref->addfunc(message, field, index) : ref->setfunc(message, field)); \
+        break;
+
+            _CONVERT(CPPTYPE_DOUBLE, double, GetDouble, GetRepeatedDouble);
+            _CONVERT(CPPTYPE_FLOAT, float, GetFloat, GetRepeatedFloat);
+            _CONVERT(CPPTYPE_INT64, int64_t, GetInt64, GetRepeatedInt64);
+            _CONVERT(CPPTYPE_UINT64, uint64_t, GetUInt64, GetRepeatedUInt64);
+            _CONVERT(CPPTYPE_INT32, int32_t, GetInt32, GetRepeatedInt32);
+            _CONVERT(CPPTYPE_UINT32, uint32_t, GetUInt32, GetRepeatedUInt32);
+#undef _CONVERT
+
+        case google::protobuf::FieldDescriptor::CPPTYPE_BOOL:
+            out << ((repeated) ? ref->GetRepeatedBool(message, field, index) : ref->GetBool(message, field));
+            break;
+
+        case google::protobuf::FieldDescriptor::CPPTYPE_STRING: {
+            std::string scratch;
+            const std::string &value = (repeated) ? ref->GetRepeatedStringReference(message, field, index, &scratch) : ref->GetStringReference(message, field, &scratch);
+            if (field->type() == google::protobuf::FieldDescriptor::TYPE_BYTES)
+                out << base64_encode(value);
+            else
+                out << value;
+            break;
+        }
+
+        case google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE: {
+            const google::protobuf::Message &mf = (repeated) ? ref->GetRepeatedMessage(message, field, index) : ref->GetMessage(message, field);
+            message2emitter(out, mf, mask);
+            break;
+        }
+
+        case google::protobuf::FieldDescriptor::CPPTYPE_ENUM: {
+            const google::protobuf::EnumValueDescriptor *ef = (repeated) ? ref->GetRepeatedEnum(message, field, index) : ref->GetEnum(message, field);
+            out << enum_text(ef);
+            break;
+        }
+
+        default:
+            throw exception(field, "Fail to convert to yaml");
+        }
+    }
+
+    static void message2emitter(YAML::Emitter &out, const google::protobuf::Message &message, const MaskNode *mask)
+    {
+        const google::protobuf::Descriptor *d = message.GetDescriptor();
+        const google::protobuf::Reflection *ref = message.GetReflection();
+        if (!d || !ref)
+            throw exception("No descriptor or reflection");
+
+        // With a mask, only the selected fields are looked at.
+        std::vector<const google::protobuf::FieldDescriptor *> listed;
+        const std::vector<const google::protobuf::FieldDescriptor *> *fields = &listed;
+        if (mask)
+            fields = &mask->selected;
+        else
+            ref->ListFields(message, &listed);
+
+        out << YAML::BeginMap;
+        for (std::vector<const google::protobuf::FieldDescriptor *>::const_iterator it = fields->begin(); it != fields->end(); it++)
+        {
+            const google::protobuf::FieldDescriptor *field = *it;
+            const MaskNode *within;
+            MaskNode::select(mask, field, within);
+
+            const std::string &name = (field->is_extension()) ? field->full_name() : field->name();
+            if (field->is_map())
+            {
+                int count = ref->FieldSize(message, field);
+                if (!count)
+                    continue;
+
+                out << YAML::Key << name << YAML::Value << YAML::BeginMap;
+                for (int j = 0; j < count; j++)
+                {
+                    const google::protobuf::Message &mf = ref->GetRepeatedMessage(message, field, j);
+                    const google::protobuf::Descriptor *df = mf.GetDescriptor();
+                    out << YAML::Key;
+                    field2emitter(out, mf, df->map_key(), 0, 0);
+                    out << YAML::Value;
+                    field2emitter(out, mf, df->map_value(), 0, 0);
+                }
+                out << YAML::EndMap;
+            }
+            else if (field->is_repeated())
+            {
+                int count = ref->FieldSize(message, field);
+                if (!count)
+                    continue;
+
+                out << YAML::Key << name << YAML::Value << YAML::BeginSeq;
+                for (int j = 0; j < count; j++)
+                    field2emitter(out, message, field, j, within);
+                out << YAML::EndSeq;
+            }
+            else if (ref->HasField(message, field))
+            {
+                out << YAML::Key << name << YAML::Value;
+                field2emitter(out, message, field, 0, within);
+            }
+        }
+        out << YAML::EndMap;
+    }
+
+    void pb2yaml(const google::protobuf::Message &message, Sink &sink)
+    {
+        pb2yaml(message, sink, EncodeOptions());
+    }
+
+    void pb2yaml(const google::protobuf::Message &message, Sink &sink, const EncodeOptions &options)
+    {
+        if (options.mask && options.mask->descriptor() != message.GetDescriptor())
+            throw exception("field mask is not for this message type");
+
+        sinkbuf buf(sink);
+        std::ostream os(&buf);
+        // Let Sink errors propagate instead of turning into a bad stream.
+        os.exceptions(std::ios::badbit);
+
+        YAML::Emitter out(os);
+        message2emitter(out, message, (options.mask) ? options.mask->root() : 0);
+        if (!out.good())
+            throw exception(out.GetLastError());
+        os << '\n';
+        os.flush();
+        sink.flush();
+    }
+} // namespace yaml2pb
@@ -0,0 +1,83 @@
+#include <string>
+#include <utility>
+
+#include "error.h"
+
+namespace yaml2pb
+{
+    std::string Error::to_string() const
+    {
+        std::string text = path;
+        if (!text.empty())
+            text += ": ";
+        text += message;
+        if (line > 0)
+            text += " (line " + std::to_string(line) + ", column " + std::to_string(column) + ")";
+        return text;
+    }
+
+    void set_error(Error &error, ErrorKind kind, const YAML::Mark &mark, const std::string &message)
+    {
+        if (error.kind != ERROR_NONE)
+            return;
+        error.kind = kind;
+        error.message = message;
+        if (!mark.is_null())
+        {
+            error.line = mark.line + 1;
+            error.column = mark.column + 1;
+        }
+    }
+
+    const std::string &field_key(const google::protobuf::FieldDescriptor *field)
+    {
+        return (field->is_extension()) ? field->full_name() : field->name();
+    }
+
+    void append_field(std::string &path, const std::string &name)
+    {
+        if (!path.empty())
+            path += '.';
+        path += name;
+    }
+
+    void append_index(std::string &path, size_t index)
+    {
+        path += '[';
+        path += std::to_string(index);
+        path += ']';
+    }
+
+    void append_key(std::string &path, const std::string &key)
+    {
+        path += '[';
+        path += key;
+        path += ']';
+    }
+
+    static void prepend(Error &error, std::string &&head)
+    {
+        if (!error.path.empty() && error.path[0] != '[')
+            head += '.';
+        error.path = head + error.path;
+    }
+
+    void prepend_field(Error &error, const std::string &name)
+    {
+        prepend(error, std::string(name));
+    }
+
+    void prepend_index(Error &error, size_t index)
+    {
+        std::string head;
+        append_index(head, index);
+        prepend(error, std::move(head));
+    }
+
+    void prepend_key(Error &error, const std::string &key)
+    {
+        std::string head;
+        append_key(head, key);
+        prepend(error, std::move(head));
+    }
+} // namespace yaml2pb
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#include "google/protobuf/descriptor.h"
+#include "yaml-cpp/mark.h"
+
+#include "yaml2pb/yaml2pb.h"
+
+namespace yaml2pb
+{
+    // Records the first failure only; whatever reports later is a
+    // consequence of it.
+    void set_error(Error &error, ErrorKind kind, const YAML::Mark &mark, const std::string &message);
+
+    // Key of `field` in YAML documents: the name, or the full name for
+    // extensions.
+    const std::string &field_key(const google::protobuf::FieldDescriptor *field);
+
+    // Path segments, appended by decoders that know the path up front and
+    // prepended by those that only learn it while unwinding.
+    void append_field(std::string &path, const std::string &name);
+    void append_index(std::string &path, size_t index);
+    void append_key(std::string &path, const std::string &key);
+    void prepend_field(Error &error, const std::string &name);
+    void prepend_index(Error &error, size_t index);
+    void prepend_key(Error &error, const std::string &key);
+} // namespace yaml2pb
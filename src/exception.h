@@ -0,0 +1,55 @@
+#pragma once
+
+#include <exception>
+#include <string>
+
+#include "google/protobuf/descriptor.h"
+
+#include "yaml2pb/yaml2pb.h"
+
+namespace yaml2pb
+{
+    class exception : public std::exception
+    {
+        std::string _error;
+
+    public:
+        exception(const std::string &e)
+            : _error(e)
+        {
+        }
+        exception(const google::protobuf::FieldDescriptor *field, const std::string &e)
+            : _error(field->name() + ": " + e)
+        {
+        }
+        explicit exception(const Error &error)
+            : _error(error.to_string())
+        {
+        }
+        virtual ~exception() throw(){};
+
+        virtual const char *what() const throw() { return _error.c_str(); };
+    };
+
+    // Thrown by generated codecs and the reflection fallbacks they call, so
+    // that enclosing codecs can complete the path (see generated::fail()).
+    class decode_error : public exception
+    {
+        mutable std::string _text;
+
+    public:
+        Error error;
+
+        explicit decode_error(const Error &e)
+            : exception(e), error(e)
+        {
+        }
+        virtual ~decode_error() throw(){};
+
+        virtual const char *what() const throw()
+        {
+            _text = error.to_string();
+            return _text.c_str();
+        }
+    };
+} // namespace yaml2pb
@@ -0,0 +1,151 @@
+#include <algorithm>
+#include <exception>
+
+#include "yaml2pb/executor.h"
+
+namespace yaml2pb
+{
+    struct Executor::Job
+    {
+        const std::function<void(size_t)> *task;
+        // Tasks not yet finished, decremented under `lock`.
+        std::atomic<size_t> pending;
+        std::mutex lock;
+        std::condition_variable done;
+        std::exception_ptr error;
+    };
+
+    Executor::Executor(size_t threads)
+        : _queued(0), _next(0), _stop(false)
+    {
+        if (!threads)
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        for (size_t i = 0; i < threads; i++)
+            _queues.emplace_back(new Queue);
+        for (size_t i = 0; i < threads; i++)
+            _threads.emplace_back(&Executor::work, this, i);
+    }
+
+    Executor::~Executor()
+    {
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            _stop = true;
+        }
+        _wake.notify_all();
+        for (size_t i = 0; i < _threads.size(); i++)
+            _threads[i].join();
+    }
+
+    // Workers pass their own index; other threads pass size() and only steal.
+    bool Executor::take(size_t self, Task &task)
+    {
+        if (!_queued.load(std::memory_order_acquire))
+            return false;
+
+        if (self < _queues.size())
+        {
+            Queue &own = *_queues[self];
+            std::lock_guard<std::mutex> guard(own.lock);
+            if (!own.tasks.empty())
+            {
+                task = own.tasks.back();
+                own.tasks.pop_back();
+                _queued--;
+                return true;
+            }
+        }
+        for (size_t i = 1; i <= _queues.size(); i++)
+        {
+            Queue &victim = *_queues[(self + i) % _queues.size()];
+            std::lock_guard<std::mutex> guard(victim.lock);
+            if (!victim.tasks.empty())
+            {
+                task = victim.tasks.front();
+                victim.tasks.pop_front();
+                _queued--;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Executor::run(const Task &task)
+    {
+        Job &job = *task.job;
+        for (size_t i = task.begin; i < task.end; i++)
+        {
+            try
+            {
+                (*job.task)(i);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> guard(job.lock);
+                if (!job.error)
+                    job.error = std::current_exception();
+            }
+        }
+
+        std::lock_guard<std::mutex> guard(job.lock);
+        if (--job.pending == 0)
+            job.done.notify_all();
+    }
+
+    void Executor::work(size_t self)
+    {
+        for (;;)
+        {
+            Task task;
+            if (take(self, task))
+            {
+                run(task);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> guard(_lock);
+            _wake.wait(guard, [this]() { return _stop || _queued.load() > 0; });
+            if (_stop)
+                return;
+        }
+    }
+
+    void Executor::parallel_for(size_t count, const std::function<void(size_t)> &task)
+    {
+        if (!count)
+            return;
+
+        // A few tasks per thread, so that stealing can even out documents of
+        // uneven size, but never less than one index per task.
+        const size_t workers = _queues.size();
+        const size_t grain = std::max<size_t>(1, count / (4 * (workers + 1)));
+
+        Job job;
+        job.task = &task;
+        job.pending = (count + grain - 1) / grain;
+        {
+            // Counted before the tasks are visible, so take() never sees
+            // more tasks than _queued says.
+            std::lock_guard<std::mutex> guard(_lock);
+            _queued += job.pending;
+        }
+        for (size_t begin = 0; begin < count; begin += grain)
+        {
+            Task t = {&job, begin, std::min(begin + grain, count)};
+            Queue &queue = *_queues[_next++ % workers];
+            std::lock_guard<std::mutex> guard(queue.lock);
+            queue.tasks.push_back(t);
+        }
+        _wake.notify_all();
+
+        // Help out instead of idling until the workers are done.
+        Task t;
+        while (job.pending.load() && take(workers, t))
+            run(t);
+
+        std::unique_lock<std::mutex> guard(job.lock);
+        job.done.wait(guard, [&job]() { return job.pending.load() == 0; });
+        if (job.error)
+            std::rethrow_exception(job.error);
+    }
+} // namespace yaml2pb
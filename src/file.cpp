@@ -0,0 +1,114 @@
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "yaml2pb/yaml2pb.h"
+#include "decoder.h"
+#include "error.h"
+#include "exception.h"
+#include "file.h"
+
+namespace yaml2pb
+{
+    FileInput::FileInput()
+        : _map(MAP_FAILED), _size(0)
+    {
+    }
+
+    FileInput::~FileInput()
+    {
+        if (_map != MAP_FAILED)
+            munmap(_map, _size);
+    }
+
+    const char *FileInput::data() const
+    {
+        return (_map != MAP_FAILED) ? static_cast<const char *>(_map) : _buffer.data();
+    }
+
+    size_t FileInput::size() const
+    {
+        return (_map != MAP_FAILED) ? _size : _buffer.size();
+    }
+
+    int FileInput::open(const char *path, bool map)
+    {
+        int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return errno;
+
+        struct stat st;
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+        {
+            if (map)
+            {
+                _map = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (_map != MAP_FAILED)
+                {
+                    _size = st.st_size;
+                    madvise(_map, _size, MADV_SEQUENTIAL);
+                    ::close(fd);
+                    return 0;
+                }
+            }
+            _buffer.reserve(st.st_size);
+        }
+
+        // Pipes, character devices and files that cannot or should not be
+        // mapped.
+        int result = 0;
+        char chunk[65536];
+        for (;;)
+        {
+            ssize_t n = ::read(fd, chunk, sizeof(chunk));
+            if (n > 0)
+                _buffer.append(chunk, n);
+            else if (n == 0)
+                break;
+            else if (errno != EINTR)
+            {
+                result = errno;
+                break;
+            }
+        }
+        ::close(fd);
+        return result;
+    }
+
+    bool try_load_file(google::protobuf::Message &message, const char *path, Error *error)
+    {
+        return try_load_file(message, path, DecodeOptions(), error);
+    }
+
+    bool try_load_file(google::protobuf::Message &message, const char *path, const DecodeOptions &options, Error *error)
+    {
+        Error scratch;
+        Error &e = (error) ? *error : scratch;
+        e = Error();
+
+        FileInput input;
+        if (int err = input.open(path))
+        {
+            set_error(e, ERROR_IO, YAML::Mark::null_mark(), std::string(path) + ": " + strerror(err));
+            return false;
+        }
+        return decode_buffer(message, input.data(), input.size(), options, e);
+    }
+
+    void load_file(google::protobuf::Message &message, const char *path)
+    {
+        load_file(message, path, DecodeOptions());
+    }
+
+    void load_file(google::protobuf::Message &message, const char *path, const DecodeOptions &options)
+    {
+        Error error;
+        if (!try_load_file(message, path, options, &error))
+            throw exception(error);
+    }
+} // namespace yaml2pb
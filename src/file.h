@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace yaml2pb
+{
+    // The contents of a file: mapped if it is a regular file, read into a
+    // buffer otherwise.
+    class FileInput
+    {
+        void *_map;
+        size_t _size;
+        std::string _buffer;
+
+    public:
+        FileInput();
+        ~FileInput();
+
+        FileInput(const FileInput &) = delete;
+        FileInput &operator=(const FileInput &) = delete;
+
+        const char *data() const;
+        size_t size() const;
+
+        // Returns 0, or the errno value of the call that failed. With `map`
+        // unset the file is always read, for files that may be truncated
+        // while the contents are in use.
+        int open(const char *path, bool map = true);
+    };
+} // namespace yaml2pb
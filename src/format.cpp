@@ -0,0 +1,358 @@
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include "format.h"
+
+namespace yaml2pb
+{
+    namespace
+    {
+        // Grisu2 (Loitsch, "Printing Floating-Point Numbers Quickly and
+        // Accurately with Integers"), with the boundaries of float values
+        // computed in single precision so that floats come out short too.
+
+        // f * 2^e
+        struct diyfp
+        {
+            uint64_t f;
+            int e;
+
+            diyfp(uint64_t f_, int e_)
+                : f(f_), e(e_)
+            {
+            }
+        };
+
+        // x - y, for x.e == y.e and x.f >= y.f.
+        diyfp sub(const diyfp &x, const diyfp &y)
+        {
+            return diyfp(x.f - y.f, x.e);
+        }
+
+        // x * y rounded to the upper 64 bits.
+        diyfp mul(const diyfp &x, const diyfp &y)
+        {
+            const uint64_t u_lo = x.f & 0xffffffffu, u_hi = x.f >> 32;
+            const uint64_t v_lo = y.f & 0xffffffffu, v_hi = y.f >> 32;
+            const uint64_t p0 = u_lo * v_lo, p1 = u_lo * v_hi, p2 = u_hi * v_lo, p3 = u_hi * v_hi;
+            uint64_t q = (p0 >> 32) + (p1 & 0xffffffffu) + (p2 & 0xffffffffu);
+            q += uint64_t(1) << 31;
+            return diyfp(p3 + (p2 >> 32) + (p1 >> 32) + (q >> 32), x.e + y.e + 64);
+        }
+
+        diyfp normalize(diyfp x)
+        {
+            while (!(x.f >> 63))
+            {
+                x.f <<= 1;
+                x.e--;
+            }
+            return x;
+        }
+
+        diyfp normalize_to(const diyfp &x, int e)
+        {
+            return diyfp(x.f << (x.e - e), e);
+        }
+
+        template <typename T>
+        uint64_t bits_of(T value);
+
+        template <>
+        uint64_t bits_of(double value)
+        {
+            uint64_t bits;
+            memcpy(&bits, &value, sizeof(bits));
+            return bits;
+        }
+
+        template <>
+        uint64_t bits_of(float value)
+        {
+            uint32_t bits;
+            memcpy(&bits, &value, sizeof(bits));
+            return bits;
+        }
+
+        // The positive finite `value` and the midpoints to its neighbours,
+        // all three on the exponent of the upper one.
+        struct boundaries
+        {
+            diyfp w, minus, plus;
+        };
+
+        template <typename T>
+        boundaries compute_boundaries(T value)
+        {
+            const int precision = std::numeric_limits<T>::digits;
+            const int bias = std::numeric_limits<T>::max_exponent - 1 + (precision - 1);
+            const uint64_t hidden = uint64_t(1) << (precision - 1);
+
+            const uint64_t bits = bits_of(value);
+            const uint64_t exponent = bits >> (precision - 1);
+            const uint64_t fraction = bits & (hidden - 1);
+
+            const diyfp v = (exponent) ? diyfp(fraction + hidden, int(exponent) - bias) : diyfp(fraction, 1 - bias);
+            // At a power of two the lower neighbour is half as far away.
+            const bool closer = !fraction && exponent > 1;
+            const diyfp m_plus(2 * v.f + 1, v.e - 1);
+            const diyfp m_minus = (closer) ? diyfp(4 * v.f - 1, v.e - 2) : diyfp(2 * v.f - 1, v.e - 1);
+
+            const diyfp w_plus = normalize(m_plus);
+            boundaries b = {normalize(v), normalize_to(m_minus, w_plus.e), w_plus};
+            return b;
+        }
+
+        // Powers of ten c = f * 2^e ~= 10^k, every 8th from 10^-300.
+        struct cached_power
+        {
+            uint64_t f;
+            int e;
+            int k;
+        };
+
+        // The scaled upper boundary lands in [2^alpha, 2^gamma].
+        const int alpha = -60;
+
+        cached_power cached_power_for(int e)
+        {
+            static const cached_power powers[] = {
+                {0xAB70FE17C79AC6CAull, -1060, -300}, {0xFF77B1FCBEBCDC4Full, -1034, -292}, {0xBE5691EF416BD60Cull, -1007, -284},
+                {0x8DD01FAD907FFC3Cull, -980, -276}, {0xD3515C2831559A83ull, -954, -268}, {0x9D71AC8FADA6C9B5ull, -927, -260},
+                {0xEA9C227723EE8BCBull, -901, -252}, {0xAECC49914078536Dull, -874, -244}, {0x823C12795DB6CE57ull, -847, -236},
+                {0xC21094364DFB5637ull, -821, -228}, {0x9096EA6F3848984Full, -794, -220}, {0xD77485CB25823AC7ull, -768, -212},
+                {0xA086CFCD97BF97F4ull, -741, -204}, {0xEF340A98172AACE5ull, -715, -196}, {0xB23867FB2A35B28Eull, -688, -188},
+                {0x84C8D4DFD2C63F3Bull, -661, -180}, {0xC5DD44271AD3CDBAull, -635, -172}, {0x936B9FCEBB25C996ull, -608, -164},
+                {0xDBAC6C247D62A584ull, -582, -156}, {0xA3AB66580D5FDAF6ull, -555, -148}, {0xF3E2F893DEC3F126ull, -529, -140},
+                {0xB5B5ADA8AAFF80B8ull, -502, -132}, {0x87625F056C7C4A8Bull, -475, -124}, {0xC9BCFF6034C13053ull, -449, -116},
+                {0x964E858C91BA2655ull, -422, -108}, {0xDFF9772470297EBDull, -396, -100}, {0xA6DFBD9FB8E5B88Full, -369, -92},
+                {0xF8A95FCF88747D94ull, -343, -84}, {0xB94470938FA89BCFull, -316, -76}, {0x8A08F0F8BF0F156Bull, -289, -68},
+                {0xCDB02555653131B6ull, -263, -60}, {0x993FE2C6D07B7FACull, -236, -52}, {0xE45C10C42A2B3B06ull, -210, -44},
+                {0xAA242499697392D3ull, -183, -36}, {0xFD87B5F28300CA0Eull, -157, -28}, {0xBCE5086492111AEBull, -130, -20},
+                {0x8CBCCC096F5088CCull, -103, -12}, {0xD1B71758E219652Cull, -77, -4}, {0x9C40000000000000ull, -50, 4},
+                {0xE8D4A51000000000ull, -24, 12}, {0xAD78EBC5AC620000ull, 3, 20}, {0x813F3978F8940984ull, 30, 28},
+                {0xC097CE7BC90715B3ull, 56, 36}, {0x8F7E32CE7BEA5C70ull, 83, 44}, {0xD5D238A4ABE98068ull, 109, 52},
+                {0x9F4F2726179A2245ull, 136, 60}, {0xED63A231D4C4FB27ull, 162, 68}, {0xB0DE65388CC8ADA8ull, 189, 76},
+                {0x83C7088E1AAB65DBull, 216, 84}, {0xC45D1DF942711D9Aull, 242, 92}, {0x924D692CA61BE758ull, 269, 100},
+                {0xDA01EE641A708DEAull, 295, 108}, {0xA26DA3999AEF774Aull, 322, 116}, {0xF209787BB47D6B85ull, 348, 124},
+                {0xB454E4A179DD1877ull, 375, 132}, {0x865B86925B9BC5C2ull, 402, 140}, {0xC83553C5C8965D3Dull, 428, 148},
+                {0x952AB45CFA97A0B3ull, 455, 156}, {0xDE469FBD99A05FE3ull, 481, 164}, {0xA59BC234DB398C25ull, 508, 172},
+                {0xF6C69A72A3989F5Cull, 534, 180}, {0xB7DCBF5354E9BECEull, 561, 188}, {0x88FCF317F22241E2ull, 588, 196},
+                {0xCC20CE9BD35C78A5ull, 614, 204}, {0x98165AF37B2153DFull, 641, 212}, {0xE2A0B5DC971F303Aull, 667, 220},
+                {0xA8D9D1535CE3B396ull, 694, 228}, {0xFB9B7CD9A4A7443Cull, 720, 236}, {0xBB764C4CA7A44410ull, 747, 244},
+                {0x8BAB8EEFB6409C1Aull, 774, 252}, {0xD01FEF10A657842Cull, 800, 260}, {0x9B10A4E5E9913129ull, 827, 268},
+                {0xE7109BFBA19C0C9Dull, 853, 276}, {0xAC2820D9623BF429ull, 880, 284}, {0x80444B5E7AA7CF85ull, 907, 292},
+                {0xBF21E44003ACDD2Dull, 933, 300}, {0x8E679C2F5E44FF8Full, 960, 308}, {0xD433179D9C8CB841ull, 986, 316},
+                {0x9E19DB92B4E31BA9ull, 1013, 324}
+            };
+
+            // ceil(log10(2^(alpha - e - 1))), rounded to the table's step.
+            const int f = alpha - e - 1;
+            const int k = (f * 78913) / (1 << 18) + (f > 0);
+            return powers[(300 + k + 7) / 8];
+        }
+
+        // Number of decimal digits of n, and 10^(digits - 1).
+        int largest_pow10(uint32_t n, uint32_t &pow10)
+        {
+            int digits = 10;
+            for (pow10 = 1000000000; digits > 1 && n < pow10; digits--)
+                pow10 /= 10;
+            return digits;
+        }
+
+        // Moves the last digit towards w while that stays in range.
+        void round_weed(char *buffer, int length, uint64_t dist, uint64_t delta, uint64_t rest, uint64_t ten_k)
+        {
+            while (rest < dist && delta - rest >= ten_k && (rest + ten_k < dist || dist - rest > rest + ten_k - dist))
+            {
+                buffer[length - 1]--;
+                rest += ten_k;
+            }
+        }
+
+        // Generates the shortest digits of a number within (M_minus, M_plus),
+        // choosing the one closest to w.
+        void digit_gen(char *buffer, int &length, int &exponent, const diyfp &m_minus, const diyfp &w, const diyfp &m_plus)
+        {
+            uint64_t delta = sub(m_plus, m_minus).f;
+            uint64_t dist = sub(m_plus, w).f;
+
+            const int shift = -m_plus.e;
+            const uint64_t one = uint64_t(1) << shift;
+            uint32_t p1 = uint32_t(m_plus.f >> shift);
+            uint64_t p2 = m_plus.f & (one - 1);
+
+            uint32_t pow10;
+            for (int n = largest_pow10(p1, pow10); n > 0; pow10 /= 10)
+            {
+                buffer[length++] = char('0' + p1 / pow10);
+                p1 %= pow10;
+                n--;
+                const uint64_t rest = (uint64_t(p1) << shift) + p2;
+                if (rest <= delta)
+                {
+                    exponent += n;
+                    round_weed(buffer, length, dist, delta, rest, uint64_t(pow10) << shift);
+                    return;
+                }
+            }
+
+            int m = 0;
+            for (;;)
+            {
+                p2 *= 10;
+                buffer[length++] = char('0' + (p2 >> shift));
+                p2 &= one - 1;
+                m++;
+                delta *= 10;
+                dist *= 10;
+                if (p2 <= delta)
+                    break;
+            }
+            exponent -= m;
+            round_weed(buffer, length, dist, delta, p2, one);
+        }
+
+        // Digits of the positive finite `value`, which equals
+        // digits * 10^exponent.
+        template <typename T>
+        int grisu2(char *buffer, int &exponent, T value)
+        {
+            const boundaries b = compute_boundaries(value);
+            const cached_power cached = cached_power_for(b.plus.e);
+            const diyfp c(cached.f, cached.e);
+            const diyfp w = mul(b.w, c);
+            const diyfp w_minus = mul(b.minus, c);
+            const diyfp w_plus = mul(b.plus, c);
+
+            // Products are off by at most one unit; stay safely inside.
+            int length = 0;
+            exponent = -cached.k;
+            digit_gen(buffer, length, exponent, diyfp(w_minus.f + 1, w_minus.e), w, diyfp(w_plus.f - 1, w_plus.e));
+            return length;
+        }
+
+        // Lays out digits * 10^exponent the way %g with `precision` would.
+        size_t layout(char *out, const char *digits, int length, int exponent, int precision)
+        {
+            char *p = out;
+            const int point = length + exponent; // position of the decimal point
+            if (point > -4 && point <= precision)
+            {
+                if (point <= 0)
+                {
+                    // 0.00ddd
+                    *p++ = '0';
+                    *p++ = '.';
+                    for (int i = point; i < 0; i++)
+                        *p++ = '0';
+                    memcpy(p, digits, length);
+                    p += length;
+                }
+                else if (point >= length)
+                {
+                    // ddd000
+                    memcpy(p, digits, length);
+                    p += length;
+                    for (int i = length; i < point; i++)
+                        *p++ = '0';
+                }
+                else
+                {
+                    // dd.ddd
+                    memcpy(p, digits, point);
+                    p += point;
+                    *p++ = '.';
+                    memcpy(p, digits + point, length - point);
+                    p += length - point;
+                }
+                return p - out;
+            }
+
+            // d.ddde+XX
+            *p++ = digits[0];
+            if (length > 1)
+            {
+                *p++ = '.';
+                memcpy(p, digits + 1, length - 1);
+                p += length - 1;
+            }
+            int e = point - 1;
+            *p++ = 'e';
+            *p++ = (e < 0) ? '-' : '+';
+            if (e < 0)
+                e = -e;
+            if (e >= 100)
+                *p++ = char('0' + e / 100);
+            *p++ = char('0' + e / 10 % 10);
+            *p++ = char('0' + e % 10);
+            return p - out;
+        }
+
+        template <typename T>
+        size_t format_real(T value, char *buffer)
+        {
+            if (std::isnan(value))
+            {
+                memcpy(buffer, ".nan", 4);
+                return 4;
+            }
+
+            char *p = buffer;
+            if (std::signbit(value))
+            {
+                *p++ = '-';
+                value = -value;
+            }
+            if (std::isinf(value))
+            {
+                memcpy(p, ".inf", 4);
+                return p + 4 - buffer;
+            }
+            if (value == 0)
+            {
+                *p++ = '0';
+                return p - buffer;
+            }
+
+            char digits[20];
+            int exponent;
+            const int length = grisu2(digits, exponent, value);
+            return p + layout(p, digits, length, exponent, std::numeric_limits<T>::max_digits10) - buffer;
+        }
+    } // namespace
+
+    size_t format_number(double value, char *buffer) { return format_real(value, buffer); }
+    size_t format_number(float value, char *buffer) { return format_real(value, buffer); }
+
+    size_t format_number(uint64_t value, char *buffer)
+    {
+        char digits[20];
+        char *p = digits + sizeof(digits);
+        do
+        {
+            *--p = char('0' + value % 10);
+            value /= 10;
+        } while (value);
+        const size_t length = digits + sizeof(digits) - p;
+        memcpy(buffer, p, length);
+        return length;
+    }
+
+    size_t format_number(int64_t value, char *buffer)
+    {
+        if (value >= 0)
+            return format_number(uint64_t(value), buffer);
+        buffer[0] = '-';
+        return 1 + format_number(uint64_t(0) - uint64_t(value), buffer + 1);
+    }
+
+    std::string enum_text(const google::protobuf::EnumValueDescriptor *value)
+    {
+        if (value->type()->FindValueByNumber(value->number()))
+            return value->name();
+        return number_text(int64_t(value->number()));
+    }
+} // namespace yaml2pb
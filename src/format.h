@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "google/protobuf/descriptor.h"
+
+namespace yaml2pb
+{
+    // Enough for the text of any number format_number() writes.
+    static const size_t number_capacity = 32;
+
+    // Writes the text of `value` to `buffer`, which must hold
+    // number_capacity chars, and returns its length; no terminating NUL.
+    // Reals come out as the shortest digits that scalar_as() reads back as
+    // exactly `value` (Grisu2: shortest for all but a few values, exact for
+    // all), in fixed notation when the exponent is in [-4, max_digits10)
+    // and as "1.5e+20" otherwise, like %g. Infinities and NaN are ".inf",
+    // "-.inf" and ".nan".
+    size_t format_number(double value, char *buffer);
+    size_t format_number(float value, char *buffer);
+    size_t format_number(int64_t value, char *buffer);
+    size_t format_number(uint64_t value, char *buffer);
+
+    inline size_t format_number(int32_t value, char *buffer) { return format_number(int64_t(value), buffer); }
+    inline size_t format_number(uint32_t value, char *buffer) { return format_number(uint64_t(value), buffer); }
+
+    template <typename T>
+    inline std::string number_text(T value)
+    {
+        char buffer[number_capacity];
+        return std::string(buffer, format_number(value, buffer));
+    }
+
+    // The name of an enum value, or its number when the enum type does not
+    // define it (an open enum holding a number from a newer schema). The
+    // placeholder names protobuf makes up for those, like
+    // "UNKNOWN_ENUM_VALUE_ModuleType_14", are never written. The generated
+    // encoders do the same through generated::enum_to_yaml().
+    std::string enum_text(const google::protobuf::EnumValueDescriptor *value);
+} // namespace yaml2pb
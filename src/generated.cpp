@@ -0,0 +1,167 @@
+#include <string>
+#include <vector>
+
+#include "google/protobuf/message.h"
+#include "google/protobuf/reflection.h"
+#include "google/protobuf/descriptor.h"
+#include "yaml-cpp/yaml.h"
+
+#include "yaml2pb/generated.h"
+#include "base64.h"
+#include "convert.h"
+#include "error.h"
+#include "exception.h"
+#include "format.h"
+#include "plan.h"
+#include "tree.h"
+
+namespace yaml2pb
+{
+    namespace generated
+    {
+        void fail(const YAML::Mark &mark, ErrorKind kind, const std::string &error)
+        {
+            Error e;
+            set_error(e, kind, mark, error);
+            throw decode_error(e);
+        }
+
+        // The failure being handled, as a decode_error.
+        static decode_error current_error()
+        {
+            try
+            {
+                throw;
+            }
+            catch (const decode_error &e)
+            {
+                return e;
+            }
+            catch (const YAML::Exception &e)
+            {
+                Error error;
+                set_error(error, ERROR_TYPE, e.mark, e.msg);
+                return decode_error(error);
+            }
+        }
+
+        void rethrow_field(const std::string &name)
+        {
+            decode_error e = current_error();
+            prepend_field(e.error, name);
+            throw e;
+        }
+
+        void rethrow_index(size_t index)
+        {
+            decode_error e = current_error();
+            prepend_index(e.error, index);
+            throw e;
+        }
+
+        void rethrow_key(const YAML::Node &key)
+        {
+            decode_error e = current_error();
+            if (key.IsScalar())
+                prepend_key(e.error, key.Scalar());
+            throw e;
+        }
+
+        // Text of a scalar the way the reflection decoders read it.
+        static std::string scalar(const YAML::Node &node)
+        {
+            if (!node.IsScalar() && !node.IsNull())
+                fail(node.Mark(), ERROR_TYPE, "invalid value");
+            return node.as<std::string>();
+        }
+
+#define _CONVERT(name, ctype)                                             \
+    ctype name(const YAML::Node &node)                                    \
+    {                                                                     \
+        std::string value = scalar(node);                                 \
+        ctype number;                                                     \
+        if (!scalar_as(value, number))                                    \
+            fail(node.Mark(), ERROR_VALUE, "invalid value '" + value + "'"); \
+        return number;                                                    \
+    }
+
+        _CONVERT(as_double, double)
+        _CONVERT(as_float, float)
+        _CONVERT(as_int64, int64_t)
+        _CONVERT(as_uint64, uint64_t)
+        _CONVERT(as_int32, int32_t)
+        _CONVERT(as_uint32, uint32_t)
+        _CONVERT(as_bool, bool)
+
+#undef _CONVERT
+
+        std::string as_string(const YAML::Node &node)
+        {
+            return scalar(node);
+        }
+
+        std::string as_bytes(const YAML::Node &node)
+        {
+            std::string value = scalar(node);
+            std::string data;
+            base64_decode(value.data(), value.size(), data);
+            return data;
+        }
+
+        bool as_number(const std::string &value, int &number)
+        {
+            // Enum names never start like a number; skip the parse for them.
+            if (value.empty() || !((value[0] >= '0' && value[0] <= '9') || value[0] == '-' || value[0] == '+'))
+                return false;
+            return scalar_as(value, number);
+        }
+
+        std::string bytes_to_yaml(const std::string &value)
+        {
+            return base64_encode(value);
+        }
+
+        std::string enum_to_yaml(const std::string &name, int number)
+        {
+            // Values the enum does not define are written as numbers, as
+            // enum_text() does for the reflection encoders.
+            return (name.empty()) ? number_text(int64_t(number)) : name;
+        }
+
+        std::string number_to_yaml(double value) { return number_text(value); }
+        std::string number_to_yaml(float value) { return number_text(value); }
+        std::string number_to_yaml(int64_t value) { return number_text(value); }
+        std::string number_to_yaml(uint64_t value) { return number_text(value); }
+        std::string number_to_yaml(int32_t value) { return number_text(value); }
+        std::string number_to_yaml(uint32_t value) { return number_text(value); }
+
+        void from_yaml(google::protobuf::Message &message, const YAML::Node &node)
+        {
+            const Codec *codec = Plan::get(message.GetDescriptor())->codec();
+            if (!codec || !codec->from_yaml(message, node))
+                decode_tree(message, node);
+        }
+
+        void to_yaml(YAML::Node &node, const google::protobuf::Message &message)
+        {
+            const Codec *codec = Plan::get(message.GetDescriptor())->codec();
+            if (!codec || !codec->to_yaml(node, message))
+                encode_tree(node, message);
+        }
+
+        void field_from_yaml(google::protobuf::Message &message, const std::string &name, const YAML::Mark &mark, const YAML::Node &node)
+        {
+            decode_tree_field(message, name, mark, node);
+        }
+
+        void extensions_to_yaml(YAML::Node &node, const google::protobuf::Message &message)
+        {
+            const google::protobuf::Reflection *ref = message.GetReflection();
+            std::vector<const google::protobuf::FieldDescriptor *> fields;
+            ref->ListFields(message, &fields);
+            for (size_t i = 0; i < fields.size(); i++)
+                if (fields[i]->is_extension())
+                    encode_tree_field(node, message, fields[i]);
+        }
+    } // namespace generated
+} // namespace yaml2pb
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace yaml2pb
+{
+    // Hashes bytes eight at a time; different seeds give independent
+    // enough hashes. Fast, but not meant to resist crafted input.
+    inline uint64_t hash_bytes(const char *p, size_t size, uint64_t seed = 0)
+    {
+        uint64_t h = (0x9e3779b97f4a7c15ull + seed) ^ size;
+        for (; size >= 8; p += 8, size -= 8)
+        {
+            uint64_t word;
+            memcpy(&word, p, 8);
+            h = (h ^ word) * 0xff51afd7ed558ccdull;
+            h ^= h >> 32;
+        }
+        uint64_t tail = 0;
+        memcpy(&tail, p, size);
+        h = (h ^ tail) * 0xc4ceb9fe1a85ec53ull;
+        return h ^ (h >> 29);
+    }
+} // namespace yaml2pb
@@ -0,0 +1,392 @@
+#include <cctype>
+#include <cstring>
+#include <numeric>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "google/protobuf/reflection.h"
+
+#include "yaml2pb/incremental.h"
+#include "arena.h"
+#include "hash.h"
+#include "lines.h"
+#include "plan.h"
+
+namespace yaml2pb
+{
+    // The split of one block mapping. The text pointers are into the input
+    // of the call that made it, and only valid during that call; later
+    // calls only compare the hashes.
+    struct IncrementalDecoder::Node
+    {
+        enum Action
+        {
+            REUSE,
+            WHOLE,
+            ELEMENTS,
+            CHILD,
+        };
+
+        struct Element
+        {
+            const char *begin;
+            const char *end;
+            uint64_t hash;
+            // Index of the previous element it reuses, -1 if decoded.
+            int source;
+            message_ptr scratch;
+        };
+
+        struct Entry
+        {
+            const google::protobuf::FieldDescriptor *field;
+            // The key line and everything up to the next key.
+            const char *begin;
+            const char *end;
+            uint64_t hash;
+            // Set for repeated message fields written as a block sequence.
+            bool sequence;
+            std::vector<Element> elements;
+            // Set for singular message fields written as a block mapping.
+            std::unique_ptr<Node> child;
+
+            Action action;
+            const Entry *before;
+            message_ptr scratch;
+        };
+
+        std::vector<Entry> entries;
+
+        const Entry *find(const google::protobuf::FieldDescriptor *field) const
+        {
+            for (size_t i = 0; i < entries.size(); i++)
+                if (entries[i].field == field)
+                    return &entries[i];
+            return 0;
+        }
+
+        // Splits the elements of a block sequence, false if the text is not
+        // one.
+        static bool split_sequence(Entry &entry, const char *begin, const char *end)
+        {
+            int indent = -1;
+            for (const char *p = begin; p < end;)
+            {
+                const Line line = line_at(p, end);
+                p = next_line(line, end);
+                if (!line.first)
+                    continue;
+                if (line.first == '\t')
+                    return false;
+                if (indent < 0)
+                    indent = line.indent;
+
+                if (line.indent == indent && is_dash(line))
+                {
+                    if (!entry.elements.empty())
+                        entry.elements.back().end = line.begin;
+                    entry.elements.emplace_back();
+                    entry.elements.back().begin = line.begin;
+                }
+                else if (line.indent <= indent || entry.elements.empty())
+                    return false;
+            }
+            if (entry.elements.empty())
+                return false;
+            entry.elements.back().end = end;
+            for (size_t i = 0; i < entry.elements.size(); i++)
+                entry.elements[i].hash = hash_bytes(entry.elements[i].begin, entry.elements[i].end - entry.elements[i].begin);
+            return true;
+        }
+
+        // Splits a block mapping of `plan` fields by key, false if the text
+        // is not one the split can follow.
+        bool split(const char *begin, const char *end, const Plan *plan)
+        {
+            int indent = -1;
+            // Per entry: its field, and where its value starts if that is on
+            // lines of its own.
+            std::vector<const FieldPlan *> fields;
+            std::vector<const char *> values;
+            for (const char *p = begin; p < end;)
+            {
+                const Line line = line_at(p, end);
+                p = next_line(line, end);
+                if (!line.first)
+                    continue;
+                if (line.first == '\t')
+                    return false;
+                if (indent < 0)
+                    indent = line.indent;
+                // The value of the current key, which may be a block
+                // sequence as indented as the key itself.
+                if (!entries.empty() && (line.indent > indent || (line.indent == indent && is_dash(line))))
+                    continue;
+                if (line.indent != indent)
+                    return false;
+
+                // A plain "name:" key of a regular field.
+                const char *name = line.begin + line.indent;
+                const char *q = name;
+                while (q < line.end && (isalnum((unsigned char)*q) || *q == '_'))
+                    q++;
+                if (q == name || q == line.end || *q != ':')
+                    return false;
+                const char *value = q + 1;
+                if (value < line.end && *value != ' ' && *value != '\r')
+                    return false;
+                const FieldPlan *field = plan->find(std::string(name, q - name));
+                if (!field)
+                    return false;
+
+                // Repeated keys, and keys of the same oneof, depend on each
+                // other.
+                const google::protobuf::OneofDescriptor *oneof = field->field->real_containing_oneof();
+                for (size_t i = 0; i < entries.size(); i++)
+                    if (entries[i].field == field->field || (oneof && entries[i].field->real_containing_oneof() == oneof))
+                        return false;
+
+                if (!entries.empty())
+                    entries.back().end = line.begin;
+                entries.emplace_back();
+                Entry &entry = entries.back();
+                entry.field = field->field;
+                entry.begin = line.begin;
+                entry.sequence = false;
+
+                // Only a value on lines of its own can be split further.
+                while (value < line.end && (*value == ' ' || *value == '\r'))
+                    value++;
+                fields.push_back(field);
+                values.push_back((value < line.end && *value != '#') ? 0 : next_line(line, end));
+            }
+            if (entries.empty())
+                return false;
+            entries.back().end = end;
+
+            for (size_t i = 0; i < entries.size(); i++)
+            {
+                Entry &entry = entries[i];
+                entry.hash = hash_bytes(entry.begin, entry.end - entry.begin);
+                if (!values[i])
+                    continue;
+
+                const FieldPlan *field = fields[i];
+                if (!field->is(FieldPlan::MESSAGE) || field->is(FieldPlan::MAP))
+                    continue;
+                if (field->is(FieldPlan::REPEATED))
+                {
+                    entry.sequence = split_sequence(entry, values[i], entry.end);
+                    if (!entry.sequence)
+                        entry.elements.clear();
+                }
+                else
+                {
+                    entry.child.reset(new Node);
+                    if (!entry.child->split(values[i], entry.end, field->child))
+                        entry.child.reset();
+                }
+            }
+            return true;
+        }
+    };
+
+    IncrementalDecoder::IncrementalDecoder(const DecodeOptions &options)
+        : _options(options), _message(0)
+    {
+    }
+
+    IncrementalDecoder::~IncrementalDecoder()
+    {
+    }
+
+    void IncrementalDecoder::reset()
+    {
+        _root.reset();
+        _message = 0;
+    }
+
+    // Decodes the parts of `fresh` that differ from `old` into scratch
+    // messages, leaving `target`, which holds what `old` was decoded into,
+    // alone. False if any of them fails to decode.
+    bool IncrementalDecoder::prepare(const google::protobuf::Message &target, const Node *old, Node &fresh)
+    {
+        const google::protobuf::Reflection *ref = target.GetReflection();
+        for (size_t i = 0; i < fresh.entries.size(); i++)
+        {
+            Node::Entry &entry = fresh.entries[i];
+            entry.before = (old) ? old->find(entry.field) : 0;
+            const Node::Entry *before = entry.before;
+
+            if (before && before->hash == entry.hash)
+            {
+                entry.action = Node::REUSE;
+                _stats.reused++;
+            }
+            else if (before && before->sequence && entry.sequence && ref->FieldSize(target, entry.field) == int(before->elements.size()))
+            {
+                entry.action = Node::ELEMENTS;
+                std::unordered_multimap<uint64_t, int> available;
+                for (size_t j = 0; j < before->elements.size(); j++)
+                    available.emplace(before->elements[j].hash, int(j));
+
+                const google::protobuf::Message *prototype = ref->GetMessageFactory()->GetPrototype(entry.field->message_type());
+                for (size_t j = 0; j < entry.elements.size(); j++)
+                {
+                    Node::Element &element = entry.elements[j];
+                    std::unordered_multimap<uint64_t, int>::iterator match = available.find(element.hash);
+                    if (match != available.end())
+                    {
+                        element.source = match->second;
+                        available.erase(match);
+                        _stats.reused++;
+                        continue;
+                    }
+
+                    // The element as a mapping of its own: the same text,
+                    // with the dash blanked out.
+                    std::string text(element.begin, element.end);
+                    text[text.find('-')] = ' ';
+                    element.source = -1;
+                    element.scratch.reset(prototype->New(target.GetArena()));
+                    if (!try_yaml2pb(*element.scratch, text.data(), text.size(), _options, 0))
+                        return false;
+                    _stats.decoded++;
+                }
+            }
+            else if (before && before->child && entry.child && ref->HasField(target, entry.field))
+            {
+                entry.action = Node::CHILD;
+                if (!prepare(ref->GetMessage(target, entry.field), before->child.get(), *entry.child))
+                    return false;
+            }
+            else
+            {
+                // The key on its own is a document setting just that field.
+                entry.action = Node::WHOLE;
+                entry.scratch.reset(target.New(target.GetArena()));
+                if (!try_yaml2pb(*entry.scratch, entry.begin, entry.end - entry.begin, _options, 0))
+                    return false;
+                _stats.decoded++;
+            }
+        }
+        return true;
+    }
+
+    // Moves what prepare() decoded into `target`.
+    void IncrementalDecoder::apply(google::protobuf::Message &target, const Node *old, Node &fresh)
+    {
+        const google::protobuf::Reflection *ref = target.GetReflection();
+        for (size_t i = 0; old && i < old->entries.size(); i++)
+            if (!fresh.find(old->entries[i].field))
+                ref->ClearField(&target, old->entries[i].field);
+
+        for (size_t i = 0; i < fresh.entries.size(); i++)
+        {
+            Node::Entry &entry = fresh.entries[i];
+            switch (entry.action)
+            {
+            case Node::REUSE:
+                break;
+
+            case Node::WHOLE:
+                ref->SwapFields(&target, entry.scratch.get(), std::vector<const google::protobuf::FieldDescriptor *>(1, entry.field));
+                entry.scratch.reset();
+                break;
+
+            case Node::CHILD:
+                apply(*ref->MutableMessage(&target, entry.field), entry.before->child.get(), *entry.child);
+                break;
+
+            case Node::ELEMENTS:
+            {
+                // New elements go after the previous ones, then every
+                // element is swapped to its place and the unused ones are
+                // dropped from the end.
+                std::vector<int> source;
+                int count = ref->FieldSize(target, entry.field);
+                for (size_t j = 0; j < entry.elements.size(); j++)
+                {
+                    Node::Element &element = entry.elements[j];
+                    if (element.source >= 0)
+                    {
+                        source.push_back(element.source);
+                        continue;
+                    }
+                    ref->AddAllocatedMessage(&target, entry.field, element.scratch.release());
+                    source.push_back(count++);
+                }
+
+                // at[p] is the element now at position p, pos[e] where
+                // element e is now.
+                std::vector<int> at(count), pos(count);
+                std::iota(at.begin(), at.end(), 0);
+                std::iota(pos.begin(), pos.end(), 0);
+                for (int p = 0; p < int(source.size()); p++)
+                {
+                    const int q = pos[source[p]];
+                    if (q == p)
+                        continue;
+                    ref->SwapElements(&target, entry.field, p, q);
+                    std::swap(at[p], at[q]);
+                    pos[at[p]] = p;
+                    pos[at[q]] = q;
+                }
+                for (int p = int(source.size()); p < count; p++)
+                    ref->RemoveLast(&target, entry.field);
+                break;
+            }
+            }
+        }
+    }
+
+    bool IncrementalDecoder::decode(google::protobuf::Message &message, const char *data, size_t size, Error *error)
+    {
+        Error scratch;
+        Error &e = (error) ? *error : scratch;
+        e = Error();
+        _stats = IncrementalStats();
+
+        std::unique_ptr<Node> fresh;
+        if (_options.element_path.empty() && !_options.mask && message.GetDescriptor() && !has_alias(data, size))
+        {
+            fresh.reset(new Node);
+            if (!fresh->split(data, data + size, Plan::get(message.GetDescriptor())))
+                fresh.reset();
+        }
+
+        if (fresh && _root && _message == &message)
+        {
+            if (prepare(message, _root.get(), *fresh))
+            {
+                apply(message, _root.get(), *fresh);
+                _root = std::move(fresh);
+                return true;
+            }
+            // A changed part that does not decode on its own. The split
+            // itself stays valid for the next version.
+            Node *rebuilt = new Node;
+            rebuilt->split(data, data + size, Plan::get(message.GetDescriptor()));
+            fresh.reset(rebuilt);
+        }
+
+        // In full, into a scratch message so that a failure leaves
+        // `message` alone.
+        _stats = IncrementalStats();
+        _stats.full = true;
+        message_ptr full(message.New(message.GetArena()));
+        if (!try_yaml2pb(*full, data, size, _options, &e))
+            return false;
+        message.GetReflection()->Swap(&message, full.get());
+        _root = std::move(fresh);
+        _message = &message;
+        return true;
+    }
+
+    bool IncrementalDecoder::decode(google::protobuf::Message &message, const std::string &buf, Error *error)
+    {
+        return decode(message, buf.data(), buf.size(), error);
+    }
+} // namespace yaml2pb
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+
+namespace yaml2pb
+{
+    // One line of the input, for splitting block-style YAML along its
+    // indentation without parsing it. Comments count as blank lines.
+    struct Line
+    {
+        const char *begin;
+        // The '\n' ending the line, or the end of the input.
+        const char *end;
+        int indent;
+        // First character after the indentation, '\0' if blank.
+        char first;
+    };
+
+    inline Line line_at(const char *p, const char *end)
+    {
+        Line line;
+        line.begin = p;
+        const char *eol = static_cast<const char *>(memchr(p, '\n', end - p));
+        line.end = (eol) ? eol : end;
+        const char *q = p;
+        while (q < line.end && *q == ' ')
+            q++;
+        line.indent = int(q - p);
+        line.first = (q < line.end && *q != '\r' && *q != '#') ? *q : '\0';
+        return line;
+    }
+
+    inline const char *next_line(const Line &line, const char *end)
+    {
+        return (line.end < end) ? line.end + 1 : end;
+    }
+
+    // "-" starting a block sequence element, but not "---".
+    inline bool is_dash(const Line &line)
+    {
+        const char *p = line.begin + line.indent;
+        return line.first == '-' && (p + 1 == line.end || p[1] == ' ' || p[1] == '\r');
+    }
+
+    // Whether the input may use an alias: a '*' where a YAML token can
+    // start. Aliases can refer to other parts of the document, which then
+    // cannot be decoded on their own.
+    inline bool has_alias(const char *data, size_t size)
+    {
+        for (const char *p = data; (p = static_cast<const char *>(memchr(p, '*', data + size - p))); p++)
+        {
+            if (p > data && !strchr(" \t\n[{,", p[-1]))
+                continue;
+            if (p + 1 < data + size && !strchr(" \t\r\n", p[1]))
+                return true;
+        }
+        return false;
+    }
+} // namespace yaml2pb
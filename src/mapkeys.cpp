@@ -0,0 +1,112 @@
+#include "google/protobuf/reflection.h"
+
+#include "mapkeys.h"
+#include "plan.h"
+
+namespace yaml2pb
+{
+    static const google::protobuf::FieldDescriptor *key_field(const google::protobuf::Message &entry)
+    {
+        return entry.GetDescriptor()->map_key();
+    }
+
+    uint64_t MapKeys::hash(const google::protobuf::Message &entry)
+    {
+        const google::protobuf::Reflection *ref = entry.GetReflection();
+        const google::protobuf::FieldDescriptor *key = key_field(entry);
+
+        uint64_t h;
+        switch (key->cpp_type())
+        {
+        case google::protobuf::FieldDescriptor::CPPTYPE_STRING: {
+            std::string scratch;
+            const std::string &value = ref->GetStringReference(entry, key, &scratch);
+            return Plan::hash(0, value.data(), value.size());
+        }
+        case google::protobuf::FieldDescriptor::CPPTYPE_INT64:
+            h = uint64_t(ref->GetInt64(entry, key));
+            break;
+        case google::protobuf::FieldDescriptor::CPPTYPE_UINT64:
+            h = ref->GetUInt64(entry, key);
+            break;
+        case google::protobuf::FieldDescriptor::CPPTYPE_INT32:
+            h = uint64_t(int64_t(ref->GetInt32(entry, key)));
+            break;
+        case google::protobuf::FieldDescriptor::CPPTYPE_UINT32:
+            h = ref->GetUInt32(entry, key);
+            break;
+        case google::protobuf::FieldDescriptor::CPPTYPE_BOOL:
+            h = ref->GetBool(entry, key);
+            break;
+        default:
+            return 0;
+        }
+        // Spread integer keys over the low bits used as the slot index.
+        h *= 0x9e3779b97f4a7c15ull;
+        return h ^ (h >> 32);
+    }
+
+    bool MapKeys::equal(const google::protobuf::Message &a, const google::protobuf::Message &b)
+    {
+        const google::protobuf::Reflection *ref = a.GetReflection();
+        const google::protobuf::FieldDescriptor *key = key_field(a);
+
+        switch (key->cpp_type())
+        {
+        case google::protobuf::FieldDescriptor::CPPTYPE_STRING: {
+            std::string scratch_a, scratch_b;
+            return ref->GetStringReference(a, key, &scratch_a) == ref->GetStringReference(b, key, &scratch_b);
+        }
+        case google::protobuf::FieldDescriptor::CPPTYPE_INT64:
+            return ref->GetInt64(a, key) == ref->GetInt64(b, key);
+        case google::protobuf::FieldDescriptor::CPPTYPE_UINT64:
+            return ref->GetUInt64(a, key) == ref->GetUInt64(b, key);
+        case google::protobuf::FieldDescriptor::CPPTYPE_INT32:
+            return ref->GetInt32(a, key) == ref->GetInt32(b, key);
+        case google::protobuf::FieldDescriptor::CPPTYPE_UINT32:
+            return ref->GetUInt32(a, key) == ref->GetUInt32(b, key);
+        case google::protobuf::FieldDescriptor::CPPTYPE_BOOL:
+            return ref->GetBool(a, key) == ref->GetBool(b, key);
+        default:
+            return false;
+        }
+    }
+
+    void MapKeys::place(uint64_t h, int index)
+    {
+        const size_t mask = _slots.size() - 1;
+        size_t slot = h & mask;
+        while (_slots[slot] >= 0)
+            slot = (slot + 1) & mask;
+        _slots[slot] = index;
+    }
+
+    bool MapKeys::insert(const google::protobuf::Message &message, const google::protobuf::FieldDescriptor *field, int index)
+    {
+        const google::protobuf::Reflection *ref = message.GetReflection();
+        const google::protobuf::Message &entry = ref->GetRepeatedMessage(message, field, index);
+        const uint64_t h = hash(entry);
+
+        if (!_slots.empty())
+        {
+            const size_t mask = _slots.size() - 1;
+            for (size_t slot = h & mask; _slots[slot] >= 0; slot = (slot + 1) & mask)
+                if (equal(ref->GetRepeatedMessage(message, field, _slots[slot]), entry))
+                    return false;
+        }
+
+        // Keep the table at most half full.
+        if (2 * (_used + 1) > _slots.size())
+        {
+            std::vector<int> old;
+            old.swap(_slots);
+            _slots.assign((old.empty()) ? 16 : 2 * old.size(), -1);
+            for (size_t i = 0; i < old.size(); i++)
+                if (old[i] >= 0)
+                    place(hash(ref->GetRepeatedMessage(message, field, old[i])), old[i]);
+        }
+        place(h, index);
+        _used++;
+        return true;
+    }
+} // namespace yaml2pb
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "google/protobuf/message.h"
+#include "google/protobuf/descriptor.h"
+
+namespace yaml2pb
+{
+    // Spots repeated keys among the entries one YAML mapping appends to a
+    // map field. Keys are compared as typed values read back from the
+    // entries themselves, so the check allocates nothing per entry: the
+    // table only holds entry indices and grows by doubling. This only makes
+    // the check O(1); the entries themselves are still whole messages, which
+    // protobuf copies into map nodes on first map access.
+    class MapKeys
+    {
+        std::vector<int> _slots;
+        size_t _used;
+
+        static uint64_t hash(const google::protobuf::Message &entry);
+        static bool equal(const google::protobuf::Message &a, const google::protobuf::Message &b);
+        void place(uint64_t h, int index);
+
+    public:
+        MapKeys()
+            : _used(0)
+        {
+        }
+
+        // Records the key of entry `index` of map field `field` of `message`.
+        // Returns false if an entry recorded before has the same key.
+        bool insert(const google::protobuf::Message &message, const google::protobuf::FieldDescriptor *field, int index);
+    };
+} // namespace yaml2pb
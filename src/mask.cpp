@@ -0,0 +1,263 @@
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <string>
+#include <utility>
+
+#include "yaml2pb/mask.h"
+#include "error.h"
+#include "exception.h"
+#include "lines.h"
+#include "mask.h"
+
+namespace yaml2pb
+{
+    namespace
+    {
+        // Whether the quoted scalar or flow collection starting at `p` ends
+        // on its line; one that goes on could make the lines after it look
+        // like keys. Any quote is taken to open a quoted scalar, which errs
+        // on the side of going on.
+        bool ends_on_line(const char *p, const char *end)
+        {
+            int depth = 0;
+            char quote = 0;
+            for (; p < end; p++)
+            {
+                if (quote)
+                {
+                    if (*p == '\\' && quote == '"')
+                        p++;
+                    else if (*p == quote)
+                        quote = 0;
+                }
+                else if (*p == '"' || *p == '\'')
+                    quote = *p;
+                else if (*p == '[' || *p == '{')
+                    depth++;
+                else if (*p == ']' || *p == '}')
+                    depth--;
+                else if (*p == '#')
+                    return false;
+                if (!quote && depth <= 0)
+                    return true;
+            }
+            return false;
+        }
+
+        // The order ListFields() gives.
+        bool by_number(const google::protobuf::FieldDescriptor *a, const google::protobuf::FieldDescriptor *b)
+        {
+            return a->number() < b->number();
+        }
+    } // namespace
+
+    CompiledMask::CompiledMask()
+        : _descriptor(0)
+    {
+    }
+
+    CompiledMask::~CompiledMask()
+    {
+    }
+
+    CompiledMask::Node *CompiledMask::add(const google::protobuf::Descriptor *descriptor)
+    {
+        _nodes.emplace_back(new Node);
+        _nodes.back()->fields.resize(descriptor->field_count());
+        return _nodes.back().get();
+    }
+
+    bool CompiledMask::compile(const google::protobuf::Descriptor *descriptor, const google::protobuf::FieldMask &mask, Error *error)
+    {
+        Error scratch;
+        Error &e = (error) ? *error : scratch;
+        e = Error();
+        _descriptor = 0;
+        _nodes.clear();
+        if (!descriptor)
+        {
+            set_error(e, ERROR_DESCRIPTOR, YAML::Mark::null_mark(), "No descriptor or reflection");
+            return false;
+        }
+
+        add(descriptor);
+        for (int i = 0; i < mask.paths_size(); i++)
+        {
+            const std::string &path = mask.paths(i);
+            Node *node = _nodes[0].get();
+            const google::protobuf::Descriptor *type = descriptor;
+            for (size_t begin = 0;;)
+            {
+                const size_t end = path.find('.', begin);
+                const google::protobuf::FieldDescriptor *field = type->FindFieldByName(path.substr(begin, end - begin));
+                const bool last = end == std::string::npos;
+                if (!field || (!last && (field->cpp_type() != google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE || field->is_map())))
+                {
+                    set_error(e, ERROR_UNKNOWN_FIELD, YAML::Mark::null_mark(), "invalid field mask path '" + path + "'");
+                    e.path = path;
+                    _nodes.clear();
+                    return false;
+                }
+
+                Node *&selected = node->fields[field->index()];
+                if (!selected)
+                    node->selected.push_back(field);
+                if (last)
+                {
+                    selected = Node::all();
+                    break;
+                }
+                // Already selected whole by a shorter path.
+                if (selected == Node::all())
+                    break;
+                if (!selected)
+                    selected = add(field->message_type());
+                node = selected;
+                type = field->message_type();
+                begin = end + 1;
+            }
+        }
+        for (size_t i = 0; i < _nodes.size(); i++)
+        {
+            std::vector<const google::protobuf::FieldDescriptor *> &selected = _nodes[i]->selected;
+            std::sort(selected.begin(), selected.end(), by_number);
+        }
+        _descriptor = descriptor;
+        return true;
+    }
+
+    bool prune(const MaskNode *mask, const Plan *plan, const char *data, size_t size, std::vector<Range> &ranges)
+    {
+        const char *end = data + size;
+        if (!mask || has_alias(data, size))
+            return false;
+
+        // Where each top-level key starts, and whether it is kept.
+        std::vector<std::pair<const char *, bool>> keys;
+        int indent = -1;
+        bool cut = false;
+        bool kept_any = false;
+        for (const char *p = data; p < end;)
+        {
+            const Line line = line_at(p, end);
+            p = next_line(line, end);
+            if (!line.first)
+                continue;
+            if (line.first == '\t')
+                return false;
+            if (indent < 0)
+                indent = line.indent;
+            if (!keys.empty() && (line.indent > indent || (line.indent == indent && is_dash(line))))
+                continue;
+            if (line.indent != indent)
+                return false;
+
+            const char *name = line.begin + line.indent;
+            const char *q = name;
+            while (q < line.end && (isalnum((unsigned char)*q) || *q == '_'))
+                q++;
+            if (q == name || q == line.end || *q != ':')
+                return false;
+            const char *value = q + 1;
+            if (value < line.end && *value != ' ' && *value != '\r')
+                return false;
+            // Past anchors and tags to the value itself.
+            while (value < line.end && *value == ' ')
+                value++;
+            while (value < line.end && (*value == '&' || *value == '!'))
+            {
+                while (value < line.end && *value != ' ')
+                    value++;
+                while (value < line.end && *value == ' ')
+                    value++;
+            }
+            if (value < line.end && strchr("\"'[{", *value) && !ends_on_line(value, line.end))
+                return false;
+
+            // Unknown keys are kept for the decoder to report.
+            const FieldPlan *field = plan->find(std::string(name, q - name));
+            const MaskNode *within;
+            const bool keep = !field || MaskNode::select(mask, field->field, within);
+            keys.push_back(std::make_pair(line.begin, keep));
+            cut = cut || !keep;
+            kept_any = kept_any || keep;
+        }
+        // With every key cut there would be no document left at all.
+        if (!cut || !kept_any)
+            return false;
+
+        static const std::string newlines(4096, '\n');
+        ranges.clear();
+        // Start of the kept text not in `ranges` yet.
+        const char *kept = data;
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            if (keys[i].second)
+                continue;
+            const char *begin = keys[i].first;
+            const char *next = (i + 1 < keys.size()) ? keys[i + 1].first : end;
+            if (begin > kept)
+                ranges.push_back(Range(kept, begin - kept));
+            for (size_t lines = std::count(begin, next, '\n'); lines;)
+            {
+                const size_t n = std::min(lines, newlines.size());
+                ranges.push_back(Range(newlines.data(), n));
+                lines -= n;
+            }
+            kept = next;
+        }
+        if (kept < end)
+            ranges.push_back(Range(kept, end - kept));
+        return true;
+    }
+
+    bool try_yaml2pb(google::protobuf::Message &message, const std::string &buf, const google::protobuf::FieldMask &mask, Error *error)
+    {
+        return try_yaml2pb(message, buf, mask, DecodeOptions(), error);
+    }
+
+    bool try_yaml2pb(google::protobuf::Message &message, const std::string &buf, const google::protobuf::FieldMask &mask, const DecodeOptions &options, Error *error)
+    {
+        CompiledMask compiled;
+        if (!compiled.compile(message.GetDescriptor(), mask, error))
+            return false;
+        DecodeOptions masked = options;
+        masked.mask = &compiled;
+        return try_yaml2pb(message, buf, masked, error);
+    }
+
+    void yaml2pb(google::protobuf::Message &message, const std::string &buf, const google::protobuf::FieldMask &mask)
+    {
+        yaml2pb(message, buf, mask, DecodeOptions());
+    }
+
+    void yaml2pb(google::protobuf::Message &message, const std::string &buf, const google::protobuf::FieldMask &mask, const DecodeOptions &options)
+    {
+        Error error;
+        if (!try_yaml2pb(message, buf, mask, options, &error))
+            throw exception(error);
+    }
+
+    std::string pb2yaml(const google::protobuf::Message &message, const google::protobuf::FieldMask &mask)
+    {
+        CompiledMask compiled;
+        Error error;
+        if (!compiled.compile(message.GetDescriptor(), mask, &error))
+            throw exception(error);
+        EncodeOptions options;
+        options.mask = &compiled;
+        return pb2yaml(message, options);
+    }
+
+    void pb2yaml(const google::protobuf::Message &message, const google::protobuf::FieldMask &mask, Sink &sink)
+    {
+        CompiledMask compiled;
+        Error error;
+        if (!compiled.compile(message.GetDescriptor(), mask, &error))
+            throw exception(error);
+        EncodeOptions options;
+        options.mask = &compiled;
+        pb2yaml(message, sink, options);
+    }
+} // namespace yaml2pb
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "google/protobuf/descriptor.h"
+
+#include "yaml2pb/mask.h"
+#include "membuf.h"
+#include "plan.h"
+
+namespace yaml2pb
+{
+    struct CompiledMask::Node
+    {
+        // Per field index: 0 if the field is left out, all() if it is
+        // selected whole, otherwise what is selected within its message type.
+        std::vector<Node *> fields;
+        // The fields not left out, by number, so that encoding never lists
+        // the fields a message has set.
+        std::vector<const google::protobuf::FieldDescriptor *> selected;
+
+        // Marks fields selected whole; never looked into.
+        static Node *all()
+        {
+            static Node node;
+            return &node;
+        }
+
+        // Whether `field` of a message whose selection is `node` is
+        // selected, with `within` set to the selection inside it. Null
+        // stands for everything on both sides, so decoding without a mask
+        // never looks further than the first test.
+        static bool select(const Node *node, const google::protobuf::FieldDescriptor *field, const Node *&within)
+        {
+            within = 0;
+            if (!node)
+                return true;
+            if (field->is_extension())
+                return false;
+            const Node *selected = node->fields[field->index()];
+            if (!selected)
+                return false;
+            if (selected != all())
+                within = selected;
+            return true;
+        }
+    };
+
+    typedef CompiledMask::Node MaskNode;
+
+    // Cuts the values of top-level keys that `mask` leaves out of a
+    // document of `plan` type before it reaches the parser, which otherwise
+    // scans all of it however little is selected. Splits the text along
+    // its lines like IncrementalDecoder; the kept text goes to `ranges`, and
+    // each cut is replaced by as many newlines, so that positions in errors
+    // stay those of the input. False if there is nothing to cut, nothing
+    // to keep, or the text is not plain enough to split safely.
+    bool prune(const MaskNode *mask, const Plan *plan, const char *data, size_t size, std::vector<Range> &ranges);
+} // namespace yaml2pb
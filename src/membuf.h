@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <streambuf>
+#include <utility>
+#include <vector>
+
+namespace yaml2pb
+{
+    // Read-only streambuf over a caller-owned buffer, so that handing the
+    // input to YAML::Parser does not copy it.
+    class membuf : public std::streambuf
+    {
+    public:
+        membuf(const char *data, size_t size)
+        {
+            char *p = const_cast<char *>(data);
+            setg(p, p, p + size);
+        }
+    };
+
+    typedef std::pair<const char *, size_t> Range;
+
+    // Same, over caller-owned ranges read one after the other as if they
+    // were one buffer.
+    class rangebuf : public std::streambuf
+    {
+        const std::vector<Range> &_ranges;
+        size_t _next;
+
+    public:
+        explicit rangebuf(const std::vector<Range> &ranges)
+            : _ranges(ranges), _next(0)
+        {
+        }
+
+    protected:
+        virtual int_type underflow()
+        {
+            while (gptr() == egptr())
+            {
+                if (_next == _ranges.size())
+                    return traits_type::eof();
+                char *p = const_cast<char *>(_ranges[_next].first);
+                setg(p, p, p + _ranges[_next].second);
+                _next++;
+            }
+            return traits_type::to_int_type(*gptr());
+        }
+
+        // Steps back into the previous range, which yaml-cpp does while
+        // sniffing the encoding. Ranges are never empty.
+        virtual int_type pbackfail(int_type c)
+        {
+            if (_next < 2)
+                return traits_type::eof();
+            _next--;
+            const Range &range = _ranges[_next - 1];
+            char *p = const_cast<char *>(range.first);
+            setg(p, p + range.second - 1, p + range.second);
+            if (!traits_type::eq_int_type(c, traits_type::eof()) && !traits_type::eq_int_type(c, traits_type::to_int_type(*gptr())))
+                return traits_type::eof();
+            return traits_type::to_int_type(*gptr());
+        }
+    };
+} // namespace yaml2pb
@@ -0,0 +1,272 @@
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "plan.h"
+#include "exception.h"
+
+namespace yaml2pb
+{
+    namespace
+    {
+        // Plans and enum tables of the types of one DescriptorPool, so that
+        // release_pool() can drop them together.
+        struct PoolPlans
+        {
+            std::unordered_map<const google::protobuf::Descriptor *, std::unique_ptr<Plan>> plans;
+            std::unordered_map<const google::protobuf::EnumDescriptor *, std::unique_ptr<EnumTable>> enum_tables;
+        };
+
+        std::recursive_mutex plans_lock;
+        std::unordered_map<const google::protobuf::DescriptorPool *, PoolPlans> &pools()
+        {
+            static std::unordered_map<const google::protobuf::DescriptorPool *, PoolPlans> instance;
+            return instance;
+        }
+
+        std::unordered_map<const google::protobuf::Descriptor *, Codec> &codecs()
+        {
+            static std::unordered_map<const google::protobuf::Descriptor *, Codec> instance;
+            return instance;
+        }
+
+        // Bumped by every release_pool().
+        std::atomic<uint64_t> generation(0);
+
+        // Plans are immutable once published, so each thread keeps its own
+        // lookaside copy of the pointers and only takes the lock on a miss.
+        thread_local std::unordered_map<const google::protobuf::Descriptor *, const Plan *> local_plans;
+        thread_local std::unordered_map<const google::protobuf::EnumDescriptor *, const EnumTable *> local_enum_tables;
+        thread_local uint64_t local_generation = 0;
+
+        // Forgets the lookaside copies once release_pool() has freed some of
+        // what they point to.
+        void refresh_local()
+        {
+            const uint64_t current = generation.load(std::memory_order_acquire);
+            if (local_generation == current)
+                return;
+            local_plans.clear();
+            local_enum_tables.clear();
+            local_generation = current;
+        }
+    } // namespace
+
+    FieldPlan FieldPlan::compile(const google::protobuf::FieldDescriptor *field)
+    {
+        FieldPlan plan;
+        plan.field = field;
+        plan.flags = 0;
+        plan.set = resolve_setter(field);
+        plan.child = 0;
+
+        if (field->is_repeated())
+            plan.flags |= REPEATED;
+        if (field->is_map())
+            plan.flags |= MAP;
+        if (field->type() == google::protobuf::FieldDescriptor::TYPE_BYTES)
+            plan.flags |= BYTES;
+        if (field->cpp_type() == google::protobuf::FieldDescriptor::CPPTYPE_ENUM)
+            plan.flags |= ENUM;
+        if (field->cpp_type() == google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE)
+        {
+            plan.flags |= MESSAGE;
+            plan.child = Plan::get(field->message_type());
+        }
+        return plan;
+    }
+
+    Plan::Plan(const google::protobuf::Descriptor *descriptor)
+        : _descriptor(descriptor), _codec(0), _seed(0), _mask(0)
+    {
+    }
+
+    uint32_t Plan::hash(uint32_t seed, const char *name, size_t size)
+    {
+        uint32_t h = 2166136261u ^ seed;
+        for (size_t i = 0; i < size; i++)
+        {
+            h ^= (unsigned char)name[i];
+            h *= 16777619u;
+        }
+        return h;
+    }
+
+    bool Plan::place(uint32_t seed, uint32_t size)
+    {
+        _slots.assign(size, -1);
+        for (int i = 0; i < _descriptor->field_count(); i++)
+        {
+            const std::string &name = _descriptor->field(i)->name();
+            int &slot = _slots[hash(seed, name.data(), name.size()) & (size - 1)];
+            if (slot >= 0)
+                return false;
+            slot = i;
+        }
+        _seed = seed;
+        _mask = size - 1;
+        return true;
+    }
+
+    void Plan::compile()
+    {
+        const int count = _descriptor->field_count();
+
+        // Search seeds, then table sizes, until every name lands in its own
+        // slot; a lookup is then one hash and one string compare.
+        uint32_t size = 1;
+        while (size < 2u * count)
+            size <<= 1;
+        for (bool placed = false; !placed; size <<= 1)
+            for (uint32_t seed = 0; seed < 64 && !placed; seed++)
+                placed = place(seed, size);
+
+        std::unordered_map<const google::protobuf::Descriptor *, Codec>::const_iterator codec = codecs().find(_descriptor);
+        if (codec != codecs().end())
+            _codec = &codec->second;
+
+        // Plans of child messages may refer back to this one, which is
+        // already registered, so recursive types terminate.
+        _fields.reserve(count);
+        for (int i = 0; i < count; i++)
+            _fields.push_back(FieldPlan::compile(_descriptor->field(i)));
+    }
+
+    void register_codec(const google::protobuf::Descriptor *descriptor, const Codec &codec)
+    {
+        // Plans pick up codecs when compiled, which is why registration is
+        // expected to happen during static initialization.
+        std::lock_guard<std::recursive_mutex> guard(plans_lock);
+        codecs()[descriptor] = codec;
+    }
+
+    const Plan *Plan::get(const google::protobuf::Descriptor *descriptor)
+    {
+        refresh_local();
+        std::unordered_map<const google::protobuf::Descriptor *, const Plan *>::const_iterator local = local_plans.find(descriptor);
+        if (local != local_plans.end())
+            return local->second;
+
+        // compile() comes back here for child messages, hence the recursive
+        // lock. Other threads only ever see fully compiled plans.
+        std::lock_guard<std::recursive_mutex> guard(plans_lock);
+        std::unique_ptr<Plan> &slot = pools()[descriptor->file()->pool()].plans[descriptor];
+        if (!slot)
+        {
+            slot.reset(new Plan(descriptor));
+            slot->compile();
+        }
+        local_plans[descriptor] = slot.get();
+        return slot.get();
+    }
+
+    EnumTable::EnumTable(const google::protobuf::EnumDescriptor *descriptor)
+        : _descriptor(descriptor), _min(0), _seed(0), _mask(0)
+    {
+    }
+
+    bool EnumTable::place(uint32_t seed, uint32_t size)
+    {
+        _names.assign(size, 0);
+        for (int i = 0; i < _descriptor->value_count(); i++)
+        {
+            const google::protobuf::EnumValueDescriptor *value = _descriptor->value(i);
+            const google::protobuf::EnumValueDescriptor *&slot = _names[Plan::hash(seed, value->name().data(), value->name().size()) & (size - 1)];
+            if (slot)
+                return false;
+            slot = value;
+        }
+        _seed = seed;
+        _mask = size - 1;
+        return true;
+    }
+
+    void EnumTable::compile()
+    {
+        const int count = _descriptor->value_count();
+
+        uint32_t size = 1;
+        while (size < 2u * count)
+            size <<= 1;
+        for (bool placed = false; !placed; size <<= 1)
+            for (uint32_t seed = 0; seed < 64 && !placed; seed++)
+                placed = place(seed, size);
+
+        int64_t min = _descriptor->value(0)->number(), max = min;
+        for (int i = 1; i < count; i++)
+        {
+            min = std::min<int64_t>(min, _descriptor->value(i)->number());
+            max = std::max<int64_t>(max, _descriptor->value(i)->number());
+        }
+
+        // Sparse enums keep using FindValueByNumber.
+        if (max - min >= 2 * count + 16)
+            return;
+        _min = int(min);
+        _numbers.assign(size_t(max - min + 1), 0);
+        for (int i = 0; i < count; i++)
+        {
+            // With allow_alias the first value declared for a number wins,
+            // as with FindValueByNumber.
+            const google::protobuf::EnumValueDescriptor *&slot = _numbers[_descriptor->value(i)->number() - _min];
+            if (!slot)
+                slot = _descriptor->value(i);
+        }
+    }
+
+    const google::protobuf::EnumValueDescriptor *EnumTable::find(const std::string &value) const
+    {
+        if (value.empty())
+            return 0;
+
+        // Names are identifiers, and the spellings scalar_as() takes for an
+        // int all start with a digit or a sign.
+        const char c = value[0];
+        if ((c >= '0' && c <= '9') || c == '-' || c == '+')
+        {
+            int number;
+            if (!scalar_as(value, number))
+                return 0;
+            if (_numbers.empty())
+                return _descriptor->FindValueByNumber(number);
+
+            int64_t offset = int64_t(number) - _min;
+            return (offset >= 0 && offset < int64_t(_numbers.size())) ? _numbers[size_t(offset)] : 0;
+        }
+
+        const google::protobuf::EnumValueDescriptor *ev = _names[Plan::hash(_seed, value.data(), value.size()) & _mask];
+        return (ev && ev->name() == value) ? ev : 0;
+    }
+
+    const EnumTable *EnumTable::get(const google::protobuf::EnumDescriptor *descriptor)
+    {
+        refresh_local();
+        std::unordered_map<const google::protobuf::EnumDescriptor *, const EnumTable *>::const_iterator local = local_enum_tables.find(descriptor);
+        if (local != local_enum_tables.end())
+            return local->second;
+
+        std::lock_guard<std::recursive_mutex> guard(plans_lock);
+        std::unique_ptr<EnumTable> &slot = pools()[descriptor->file()->pool()].enum_tables[descriptor];
+        if (!slot)
+        {
+            slot.reset(new EnumTable(descriptor));
+            slot->compile();
+        }
+        local_enum_tables[descriptor] = slot.get();
+        return slot.get();
+    }
+
+    uint64_t plan_generation()
+    {
+        return generation.load(std::memory_order_acquire);
+    }
+
+    void release_pool(const google::protobuf::DescriptorPool *pool)
+    {
+        std::lock_guard<std::recursive_mutex> guard(plans_lock);
+        pools().erase(pool);
+        generation.fetch_add(1, std::memory_order_release);
+    }
+} // namespace yaml2pb
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/descriptor.h"
+
+#include "yaml2pb/generated.h"
+#include "convert.h"
+
+namespace yaml2pb
+{
+    class Plan;
+
+    // Everything the decoders need to know about one field, resolved once.
+    struct FieldPlan
+    {
+        enum Flags
+        {
+            REPEATED = 1 << 0,
+            MAP = 1 << 1,
+            MESSAGE = 1 << 2,
+            BYTES = 1 << 3,
+            ENUM = 1 << 4,
+        };
+
+        const google::protobuf::FieldDescriptor *field;
+        unsigned flags;
+        // Scalar conversion, 0 for message-typed fields.
+        scalar_setter set;
+        // Plan of the message type, or of the entry type for map fields.
+        const Plan *child;
+
+        bool is(Flags flag) const { return (flags & flag) != 0; }
+
+        // Fills in a plan for `field`, which may be an extension.
+        static FieldPlan compile(const google::protobuf::FieldDescriptor *field);
+    };
+
+    // A Descriptor compiled into a flat table: fields in declaration order
+    // plus a collision-free hash of their names. Plans are built once per
+    // Descriptor, shared between threads and freed only by release_pool().
+    class Plan
+    {
+        const google::protobuf::Descriptor *_descriptor;
+        const Codec *_codec;
+        std::vector<FieldPlan> _fields;
+        std::vector<int> _slots;
+        uint32_t _seed;
+        uint32_t _mask;
+
+        explicit Plan(const google::protobuf::Descriptor *descriptor);
+        bool place(uint32_t seed, uint32_t size);
+        void compile();
+
+    public:
+        // FNV-1a, perturbed by `seed`; shared with EnumTable.
+        static uint32_t hash(uint32_t seed, const char *name, size_t size);
+
+        const google::protobuf::Descriptor *descriptor() const { return _descriptor; }
+        const FieldPlan &field(int index) const { return _fields[index]; }
+        // Codec generated by protoc-gen-yaml2pb for this type, if registered.
+        const Codec *codec() const { return _codec; }
+
+        // Looks up a regular field by name, 0 if there is none.
+        const FieldPlan *find(const std::string &name) const
+        {
+            int index = _slots[hash(_seed, name.data(), name.size()) & _mask];
+            if (index < 0 || _fields[index].field->name() != name)
+                return 0;
+            return &_fields[index];
+        }
+
+        // Returns the plan for `descriptor`, compiling it on first use.
+        static const Plan *get(const google::protobuf::Descriptor *descriptor);
+    };
+
+    // Resolves enum scalars without going through FindValueByName or parsing
+    // every name as a number first: a dense array indexed by number (unless
+    // the numbers are too sparse) and a collision-free hash of the names.
+    // Built once per EnumDescriptor and shared like Plans.
+    class EnumTable
+    {
+        const google::protobuf::EnumDescriptor *_descriptor;
+        int _min;
+        std::vector<const google::protobuf::EnumValueDescriptor *> _numbers;
+        std::vector<const google::protobuf::EnumValueDescriptor *> _names;
+        uint32_t _seed;
+        uint32_t _mask;
+
+        explicit EnumTable(const google::protobuf::EnumDescriptor *descriptor);
+        bool place(uint32_t seed, uint32_t size);
+        void compile();
+
+    public:
+        // Looks up the text of a YAML scalar as a number when it starts like
+        // one, and as a value name otherwise; 0 if there is no such value.
+        const google::protobuf::EnumValueDescriptor *find(const std::string &value) const;
+
+        static const EnumTable *get(const google::protobuf::EnumDescriptor *descriptor);
+    };
+
+    // Changes whenever release_pool() frees plans; anything else kept per
+    // descriptor is stale once it does.
+    uint64_t plan_generation();
+} // namespace yaml2pb
@@ -0,0 +1,67 @@
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+#include <unistd.h>
+
+#include "yaml2pb/sink.h"
+#include "exception.h"
+
+namespace yaml2pb
+{
+    void OstreamSink::write(const char *data, size_t size)
+    {
+        _out.write(data, size);
+    }
+
+    void OstreamSink::flush()
+    {
+        _out.flush();
+    }
+
+    static void write_all(int fd, const char *data, size_t size)
+    {
+        while (size)
+        {
+            ssize_t n = ::write(fd, data, size);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0)
+                throw exception(std::string("write failed: ") + strerror(errno));
+            data += n;
+            size -= n;
+        }
+    }
+
+    FdSink::~FdSink()
+    {
+        try
+        {
+            flush();
+        }
+        catch (...)
+        {
+        }
+    }
+
+    void FdSink::write(const char *data, size_t size)
+    {
+        if (_used + size > sizeof(_buffer))
+            flush();
+        if (size >= sizeof(_buffer))
+        {
+            // Large chunks bypass the buffer.
+            write_all(_fd, data, size);
+            return;
+        }
+        memcpy(_buffer + _used, data, size);
+        _used += size;
+    }
+
+    void FdSink::flush()
+    {
+        size_t used = _used;
+        _used = 0;
+        write_all(_fd, _buffer, used);
+    }
+} // namespace yaml2pb
@@ -0,0 +1,123 @@
+#include <istream>
+#include <memory>
+#include <string>
+
+#include "google/protobuf/dynamic_message.h"
+#include "google/protobuf/message.h"
+#include "google/protobuf/descriptor.h"
+
+#include "yaml2pb/yaml2pb.h"
+
+namespace yaml2pb
+{
+    namespace
+    {
+        // Splits a YAML stream into its documents without parsing it. A line
+        // starting with `---` or `...` is a document marker wherever it
+        // appears, since YAML does not allow one inside content; a single
+        // yaml-cpp parser over the whole stream would instead keep state for
+        // every document it has seen.
+        class DocumentReader
+        {
+            std::istream &_in;
+            std::string _line;
+            // `_line` is a `---` line read ahead, opening the next document.
+            bool _held;
+            int _lines;
+
+            static bool marker(const std::string &line, const char *text)
+            {
+                return line.compare(0, 3, text) == 0 && (line.size() == 3 || line[3] == ' ' || line[3] == '\t' || line[3] == '\r');
+            }
+
+            // Nothing but blanks, a comment, a directive or a bare marker.
+            static bool blank(const std::string &line)
+            {
+                size_t begin = 0;
+                if (marker(line, "---") || marker(line, "..."))
+                    begin = 3;
+                else if (line.compare(0, 1, "%") == 0)
+                    return true;
+                size_t i = line.find_first_not_of(" \t\r", begin);
+                return i == std::string::npos || line[i] == '#';
+            }
+
+        public:
+            explicit DocumentReader(std::istream &in)
+                : _in(in), _held(false), _lines(0)
+            {
+            }
+
+            // Replaces `document` with the text of the next document and sets
+            // `first_line` to the number of lines before it, and `content` to
+            // whether it holds more than markers, comments and directives.
+            // Returns false at the end of the stream.
+            bool next(std::string &document, int &first_line, bool &content)
+            {
+                document.clear();
+                content = false;
+                bool opened = false;
+                first_line = _lines;
+                if (_held)
+                {
+                    first_line--;
+                    document.append(_line).push_back('\n');
+                    opened = true;
+                    content = !blank(_line);
+                    _held = false;
+                }
+
+                while (std::getline(_in, _line))
+                {
+                    _lines++;
+                    const bool start = marker(_line, "---");
+                    if (start && (opened || content))
+                    {
+                        _held = true;
+                        return true;
+                    }
+                    document.append(_line).push_back('\n');
+                    content = content || !blank(_line);
+                    if (start)
+                        opened = true;
+                    else if (marker(_line, "..."))
+                        return true;
+                }
+                return !document.empty();
+            }
+        };
+    } // namespace
+
+    size_t decode_stream(std::istream &in, const google::protobuf::Descriptor *descriptor, const DocumentCallback &callback)
+    {
+        return decode_stream(in, descriptor, callback, DecodeOptions());
+    }
+
+    size_t decode_stream(std::istream &in, const google::protobuf::Descriptor *descriptor, const DocumentCallback &callback, const DecodeOptions &options)
+    {
+        google::protobuf::DynamicMessageFactory factory(descriptor->file()->pool());
+        factory.SetDelegateToGeneratedFactory(true);
+        std::unique_ptr<google::protobuf::Message> message(factory.GetPrototype(descriptor)->New());
+
+        DocumentReader reader(in);
+        std::string document;
+        int first_line;
+        bool content;
+        size_t documents = 0;
+        while (reader.next(document, first_line, content))
+        {
+            if (!content)
+                continue;
+
+            Error error;
+            message->Clear();
+            if (!try_yaml2pb(*message, document, options, &error) && error.line)
+                error.line += first_line;
+
+            documents++;
+            if (!callback(*message, error))
+                break;
+        }
+        return documents;
+    }
+} // namespace yaml2pb
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <string>
+
+#include "google/protobuf/message.h"
+#include "yaml-cpp/yaml.h"
+
+namespace yaml2pb
+{
+    // The reflection walk over YAML::Node trees behind ENGINE_TREE, also used
+    // by generated codecs for whatever they do not cover themselves.
+    void decode_tree(google::protobuf::Message &message, const YAML::Node &node);
+    void decode_tree_field(google::protobuf::Message &message, const std::string &name, const YAML::Mark &mark, const YAML::Node &value);
+    void encode_tree(YAML::Node &node, const google::protobuf::Message &message);
+    void encode_tree_field(YAML::Node &node, const google::protobuf::Message &message, const google::protobuf::FieldDescriptor *field);
+} // namespace yaml2pb
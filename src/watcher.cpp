@@ -0,0 +1,213 @@
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <string>
+#include <utility>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include "yaml2pb/watcher.h"
+#include "error.h"
+#include "exception.h"
+#include "file.h"
+
+namespace yaml2pb
+{
+    struct SnapshotCell::Holder
+    {
+        std::shared_ptr<const void> value;
+    };
+
+    SnapshotCell::SnapshotCell()
+        : _current(new Holder), _epoch(0)
+    {
+        _readers[0].count = 0;
+        _readers[1].count = 0;
+    }
+
+    SnapshotCell::~SnapshotCell()
+    {
+        delete _current.load();
+    }
+
+    std::shared_ptr<const void> SnapshotCell::load() const
+    {
+        for (;;)
+        {
+            const uint64_t epoch = _epoch.load();
+            std::atomic<size_t> &readers = _readers[epoch & 1].count;
+            readers++;
+            // A store() that moved on before we were counted does not wait
+            // for us, so the holder we would read may be gone: try again in
+            // the new epoch. This only spins while a store is under way.
+            if (_epoch.load() == epoch)
+            {
+                std::shared_ptr<const void> value = _current.load()->value;
+                readers--;
+                return value;
+            }
+            readers--;
+        }
+    }
+
+    void SnapshotCell::store(std::shared_ptr<const void> value)
+    {
+        Holder *holder = new Holder;
+        holder->value = std::move(value);
+
+        std::lock_guard<std::mutex> guard(_store);
+        Holder *old = _current.exchange(holder);
+        // Readers counted in the old epoch may still be copying out of
+        // `old`; those counted from here on only see `holder`.
+        const uint64_t epoch = _epoch++;
+        while (_readers[epoch & 1].count.load())
+            std::this_thread::yield();
+        delete old;
+    }
+
+    WatcherBase::WatcherBase(const std::string &path, const DecodeOptions &options)
+        : _path(path), _options(options), _inotify(-1)
+    {
+        _wake[0] = _wake[1] = -1;
+        const size_t slash = path.rfind('/');
+        _name = (slash == std::string::npos) ? path : path.substr(slash + 1);
+    }
+
+    WatcherBase::~WatcherBase()
+    {
+        stop();
+    }
+
+    void WatcherBase::stop()
+    {
+        if (_thread.joinable())
+        {
+            const char byte = 0;
+            while (write(_wake[1], &byte, 1) < 0 && errno == EINTR)
+                ;
+            _thread.join();
+        }
+        const int fds[] = {_inotify, _wake[0], _wake[1]};
+        for (int fd : fds)
+            if (fd >= 0)
+                close(fd);
+        _inotify = _wake[0] = _wake[1] = -1;
+    }
+
+    bool WatcherBase::start(Error *error)
+    {
+        Error scratch;
+        Error &e = (error) ? *error : scratch;
+        e = Error();
+
+        // The directory is watched rather than the file, so that a file
+        // replaced by a rename is still followed.
+        const size_t slash = _path.rfind('/');
+        const std::string dir = (slash == std::string::npos) ? "." : (slash == 0) ? "/" : _path.substr(0, slash);
+        _inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (_inotify < 0 || inotify_add_watch(_inotify, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0 || pipe2(_wake, O_CLOEXEC) < 0)
+        {
+            set_error(e, ERROR_IO, YAML::Mark::null_mark(), _path + ": cannot watch: " + strerror(errno));
+            stop();
+            return false;
+        }
+
+        // Loaded once the watch is in place, so that no change in between
+        // is missed.
+        if (!reload(&e))
+        {
+            stop();
+            return false;
+        }
+        _thread = std::thread(&WatcherBase::watch, this);
+        return true;
+    }
+
+    void WatcherBase::start()
+    {
+        Error error;
+        if (!start(&error))
+            throw exception(error);
+    }
+
+    bool WatcherBase::reload(Error *error)
+    {
+        Error scratch;
+        Error &e = (error) ? *error : scratch;
+        e = Error();
+
+        std::lock_guard<std::mutex> guard(_reload);
+        const std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+
+        // Read rather than mapped: a config rewritten in place while it is
+        // decoded must not fault the process.
+        FileInput input;
+        std::shared_ptr<const void> value;
+        if (int err = input.open(_path.c_str(), false))
+            set_error(e, ERROR_IO, YAML::Mark::null_mark(), _path + ": " + strerror(err));
+        else
+            value = decode(input.data(), input.size(), _options, e);
+
+        const bool ok = bool(value);
+        if (ok)
+            _snapshot.store(std::move(value));
+        const std::chrono::nanoseconds latency = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin);
+
+        std::lock_guard<std::mutex> stats(_lock);
+        if (ok)
+            _stats.reloads++;
+        else
+        {
+            _stats.failures++;
+            _stats.last_error = e;
+        }
+        _stats.last_latency = latency;
+        _stats.max_latency = std::max(_stats.max_latency, latency);
+        _stats.total_latency += latency;
+        return ok;
+    }
+
+    ReloadStats WatcherBase::stats() const
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        return _stats;
+    }
+
+    void WatcherBase::watch()
+    {
+        // Room for several events with names of any length.
+        alignas(struct inotify_event) char buffer[16 * (sizeof(struct inotify_event) + NAME_MAX + 1)];
+        struct pollfd fds[2] = {{_inotify, POLLIN, 0}, {_wake[0], POLLIN, 0}};
+        for (;;)
+        {
+            if (poll(fds, 2, -1) < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return;
+            }
+            if (fds[1].revents)
+                return;
+
+            // One reload for however many events have piled up.
+            bool changed = false;
+            ssize_t n;
+            while ((n = read(_inotify, buffer, sizeof(buffer))) > 0)
+            {
+                for (const char *p = buffer; p < buffer + n;)
+                {
+                    const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>(p);
+                    if ((event->mask & IN_Q_OVERFLOW) || (event->len && _name == event->name))
+                        changed = true;
+                    p += sizeof(struct inotify_event) + event->len;
+                }
+            }
+            if (changed)
+                reload(0);
+        }
+    }
+} // namespace yaml2pb
@@ -1,4 +1,5 @@
-#include <exception>
+#include <atomic>
+#include <istream>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -8,176 +9,443 @@
 #include "google/protobuf/descriptor.h"
 #include "yaml-cpp/yaml.h"
 
+#include "yaml2pb/executor.h"
 #include "yaml2pb/yaml2pb.h"
 #include "base64.h"
+#include "decoder.h"
+#include "error.h"
+#include "exception.h"
+#include "format.h"
+#include "mapkeys.h"
+#include "mask.h"
+#include "membuf.h"
+#include "plan.h"
+#include "tree.h"
 
 namespace yaml2pb
 {
-    class exception : public std::exception
+    static bool yaml2pb(google::protobuf::Message &message, const Plan *plan, const MaskNode *mask, const YAML::Node &node, bool underscores, Error &error);
+    static void pb2yaml(YAML::Node &node, const google::protobuf::Message &message, const MaskNode *mask);
+
+    // Text of a scalar node the way node.as<std::string>() reads it, 0 for
+    // collections.
+    static const std::string *scalar_text(const YAML::Node &node)
     {
-        std::string _error;
+        static const std::string null_value("null");
+        if (node.IsNull())
+            return &null_value;
+        return (node.IsScalar()) ? &node.Scalar() : 0;
+    }
 
-    public:
-        exception(const std::string &e)
-            : _error(e)
+    // `mask` is what is selected within message values.
+    static bool yaml2field(google::protobuf::Message &msg, const FieldPlan &field, const MaskNode *mask, const YAML::Node &node, bool underscores, Error &error)
+    {
+        if (field.is(FieldPlan::MESSAGE))
         {
+            const google::protobuf::Reflection *ref = msg.GetReflection();
+            google::protobuf::Message *mf = (field.is(FieldPlan::REPEATED)) ? ref->AddMessage(&msg, field.field) : ref->MutableMessage(&msg, field.field);
+            return yaml2pb(*mf, field.child, mask, node, underscores, error);
         }
-        exception(const google::protobuf::FieldDescriptor *field, const std::string &e)
-            : _error(field->name() + ": " + e)
+
+        const std::string *value = scalar_text(node);
+        if (!value)
         {
+            set_error(error, ERROR_TYPE, node.Mark(), "invalid value");
+            return false;
         }
-        virtual ~exception() throw(){};
-
-        virtual const char *what() const throw() { return _error.c_str(); };
-    };
+        if (field.set(msg, field.field, *value, underscores))
+            return true;
+        set_error(error, ERROR_VALUE, node.Mark(), invalid_value(field.field, *value));
+        return false;
+    }
 
-    static void yaml2pb(google::protobuf::Message &message, const YAML::Node &node);
-    static void pb2yaml(YAML::Node &node, const google::protobuf::Message &message);
+// MutableRepeatedField() and MutableRepeatedPtrField() are deprecated in
+// favour of MutableRepeatedFieldRef, which cannot reserve.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
 
-    static void yaml2field(google::protobuf::Message &msg, const google::protobuf::FieldDescriptor *field, const YAML::Node &node)
+    // Makes room for `count` more elements in the repeated or map `field`,
+    // so that a collection of known size is appended without regrowing.
+    static void reserve(google::protobuf::Message &message, const google::protobuf::FieldDescriptor *field, int count)
     {
-        const google::protobuf::Reflection *ref = msg.GetReflection();
-        const bool repeated = field->is_repeated();
+        // Extensions are created on first access; leave that to AddXxx.
+        if (field->is_extension())
+            return;
 
+        const google::protobuf::Reflection *ref = message.GetReflection();
+        const int size = ref->FieldSize(message, field) + count;
         switch (field->cpp_type())
         {
-#define _SET_OR_ADD(setfunc, addfunc, __value)  \
-    do                                          \
-    {                                           \
-        if (repeated)                           \
-            ref->addfunc(&msg, field, __value); \
-        else                                    \
-            ref->setfunc(&msg, field, __value); \
-    } while (0)
-
-#define _CONVERT(pbtype, ctype, setfunc, addfunc)          \
-    case google::protobuf::FieldDescriptor::pbtype:        \
-        _SET_OR_ADD(setfunc, addfunc, node.as<ctype>());   \
+#define _CONVERT(type, ctype)                                               \
+    case google::protobuf::FieldDescriptor::type:                           \
+        ref->MutableRepeatedField<ctype>(&message, field)->Reserve(size); \
         break;
 
-            _CONVERT(CPPTYPE_DOUBLE, double, SetDouble, AddDouble);
-            _CONVERT(CPPTYPE_FLOAT, float, SetFloat, AddFloat);
-            _CONVERT(CPPTYPE_INT64, int64_t, SetInt64, AddInt64);
-            _CONVERT(CPPTYPE_UINT64, uint64_t, SetUInt64, AddUInt64);
-            _CONVERT(CPPTYPE_INT32, int32_t, SetInt32, AddInt32);
-            _CONVERT(CPPTYPE_UINT32, uint32_t, SetUInt32, AddUInt32);
-            _CONVERT(CPPTYPE_BOOL, bool, SetBool, AddBool);
-
+            _CONVERT(CPPTYPE_DOUBLE, double);
+            _CONVERT(CPPTYPE_FLOAT, float);
+            _CONVERT(CPPTYPE_INT64, int64_t);
+            _CONVERT(CPPTYPE_UINT64, uint64_t);
+            _CONVERT(CPPTYPE_INT32, int32_t);
+            _CONVERT(CPPTYPE_UINT32, uint32_t);
+            _CONVERT(CPPTYPE_BOOL, bool);
+            _CONVERT(CPPTYPE_ENUM, int32_t);
 #undef _CONVERT
 
-        case google::protobuf::FieldDescriptor::CPPTYPE_STRING: {
-            std::string value = node.as<std::string>();
-            if (field->type() == google::protobuf::FieldDescriptor::TYPE_BYTES)
-            {
-                std::vector<BYTE> data = base64_decode(value);
-                std::string str(data.begin(), data.end());
-                _SET_OR_ADD(SetString, AddString, str);
-            }
-            else
-            {
-                _SET_OR_ADD(SetString, AddString, value);
-            }
+        case google::protobuf::FieldDescriptor::CPPTYPE_STRING:
+            ref->MutableRepeatedPtrField<std::string>(&message, field)->Reserve(size);
             break;
-        }
-        case google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE: {
-            google::protobuf::Message *mf = (repeated) ? ref->AddMessage(&msg, field) : ref->MutableMessage(&msg, field);
-            yaml2pb(*mf, node);
+
+        case google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE:
+            ref->MutableRepeatedPtrField<google::protobuf::Message>(&message, field)->Reserve(size);
             break;
         }
-        case google::protobuf::FieldDescriptor::CPPTYPE_ENUM: {
-            const google::protobuf::EnumDescriptor *ed = field->enum_type();
-            const google::protobuf::EnumValueDescriptor *ev = 0;
+    }
 
-            try
+#pragma GCC diagnostic pop
+
+    static bool yaml2value(google::protobuf::Message &message, const FieldPlan *field, const MaskNode *mask, const YAML::Node &value, bool underscores, Error &error)
+    {
+        const google::protobuf::Reflection *ref = message.GetReflection();
+
+        if (field->is(FieldPlan::MAP))
+        {
+            if (!value.IsMap())
             {
-                ev = ed->FindValueByNumber(node.as<int>());
+                set_error(error, ERROR_TYPE, value.Mark(), "invalid map");
+                return false;
             }
-            catch (...)
+
+            const Plan *entry_plan = field->child;
+            const FieldPlan &key_field = entry_plan->field(entry_plan->descriptor()->map_key()->index());
+            const FieldPlan &value_field = entry_plan->field(entry_plan->descriptor()->map_value()->index());
+            // Entries are appended in place, see the event decoder.
+            reserve(message, field->field, int(value.size()));
+            MapKeys keys;
+            for (YAML::const_iterator it_pair = value.begin(); it_pair != value.end(); it_pair++)
             {
-                try
+                google::protobuf::Message *entry = ref->AddMessage(&message, field->field);
+                bool ok = yaml2field(*entry, key_field, 0, it_pair->first, underscores, error);
+                if (ok && !keys.insert(message, field->field, ref->FieldSize(message, field->field) - 1))
                 {
-                    ev = ed->FindValueByName(node.as<std::string>());
+                    set_error(error, ERROR_DUPLICATE_KEY, it_pair->first.Mark(), "duplicate key '" + *scalar_text(it_pair->first) + "'");
+                    ok = false;
                 }
-                catch (...)
+                if (!ok || !yaml2field(*entry, value_field, 0, it_pair->second, underscores, error))
                 {
-                    throw exception("invalid enum type");
+                    const std::string *key = scalar_text(it_pair->first);
+                    if (key)
+                        prepend_key(error, *key);
+                    return false;
                 }
             }
-            if (!ev)
-                throw exception(field, "Enum value not found:" + node.as<std::string>());
-            _SET_OR_ADD(SetEnum, AddEnum, ev);
-            break;
         }
-        default:
-            break;
+        else if (field->is(FieldPlan::REPEATED))
+        {
+            if (!value.IsSequence())
+            {
+                set_error(error, ERROR_TYPE, value.Mark(), "invalid array");
+                return false;
+            }
+
+            reserve(message, field->field, int(value.size()));
+            size_t index = 0;
+            for (YAML::const_iterator it2 = value.begin(); it2 != value.end(); it2++, index++)
+            {
+                if (!yaml2field(message, *field, mask, *it2, underscores, error))
+                {
+                    prepend_index(error, index);
+                    return false;
+                }
+            }
         }
+        else
+        {
+            return yaml2field(message, *field, mask, value, underscores, error);
+        }
+        return true;
     }
 
-    static void yaml2pb(google::protobuf::Message &message, const YAML::Node &node)
+    // Decodes the value of the field or extension called `name`, whose key
+    // is at `mark`, unless `mask` leaves it out.
+    static bool yaml2value(google::protobuf::Message &message, const Plan *plan, const MaskNode *mask, const std::string &name, const YAML::Mark &mark, const YAML::Node &value, bool underscores, Error &error)
     {
-        const google::protobuf::Descriptor *d = message.GetDescriptor();
-        const google::protobuf::Reflection *ref = message.GetReflection();
-        if (!d || !ref)
-            throw exception("No descriptor or reflection");
+        const FieldPlan *field = plan->find(name);
+        const google::protobuf::FieldDescriptor *extension = (field) ? 0 : message.GetReflection()->FindKnownExtensionByName(name);
+        if (!field && !extension)
+        {
+            set_error(error, ERROR_UNKNOWN_FIELD, mark, "unknown field '" + name + "'");
+            prepend_field(error, name);
+            return false;
+        }
 
-        for (YAML::const_iterator it = node.begin(); it != node.end(); it++)
+        FieldPlan extension_plan;
+        if (extension)
         {
-            std::string name = it->first.as<std::string>();
-            const YAML::Node &value = it->second;
+            extension_plan = FieldPlan::compile(extension);
+            field = &extension_plan;
+        }
+        const MaskNode *within;
+        if (!MaskNode::select(mask, field->field, within))
+            return true;
+        if (yaml2value(message, field, within, value, underscores, error))
+            return true;
+        prepend_field(error, name);
+        return false;
+    }
 
-            const google::protobuf::FieldDescriptor *field = d->FindFieldByName(name);
-            if (!field)
-                field = ref->FindKnownExtensionByName(name);
-            if (!field)
-                throw exception("unknown field '" + name + "'");
+    static bool yaml2pb(google::protobuf::Message &message, const Plan *plan, const MaskNode *mask, const YAML::Node &node, bool underscores, Error &error)
+    {
+        // Like the event decoder, a scalar or null leaves the message empty.
+        if (node.IsSequence())
+        {
+            set_error(error, ERROR_TYPE, node.Mark(), "invalid value");
+            return false;
+        }
 
-            if (field->is_map())
+        for (YAML::const_iterator it = node.begin(); it != node.end(); it++)
+        {
+            const std::string *name = scalar_text(it->first);
+            if (!name)
             {
-                if (!value.IsMap())
-                    throw exception(field, "invalid map");
+                set_error(error, ERROR_TYPE, it->first.Mark(), "invalid key");
+                return false;
+            }
+            if (!yaml2value(message, plan, mask, *name, it->first.Mark(), it->second, underscores, error))
+                return false;
+        }
+        return true;
+    }
 
-                auto mf = ref->GetMutableRepeatedFieldRef<google::protobuf::Message>(&message, field);
-                for (YAML::const_iterator it_pair = value.begin(); it_pair != value.end(); it_pair++)
-                {
-                    std::unique_ptr<google::protobuf::Message> entry(google::protobuf::MessageFactory::generated_factory()->GetPrototype(field->message_type())->New(message.GetArena()));
-                    yaml2field(*entry, field->message_type()->field(0), it_pair->first);
-                    yaml2field(*entry, field->message_type()->field(1), it_pair->second);
-                    mf.Add(*entry);
-                }
+    void decode_tree(google::protobuf::Message &message, const YAML::Node &node)
+    {
+        if (!message.GetDescriptor() || !message.GetReflection())
+            throw exception("No descriptor or reflection");
+
+        Error error;
+        if (!yaml2pb(message, Plan::get(message.GetDescriptor()), 0, node, false, error))
+            throw decode_error(error);
+    }
+
+    void decode_tree_field(google::protobuf::Message &message, const std::string &name, const YAML::Mark &mark, const YAML::Node &value)
+    {
+        Error error;
+        if (!yaml2value(message, Plan::get(message.GetDescriptor()), 0, name, mark, value, false, error))
+            throw decode_error(error);
+    }
+
+    bool try_yaml2pb(google::protobuf::Message &message, const std::string &buf, Error *error)
+    {
+        return try_yaml2pb(message, buf, DecodeOptions(), error);
+    }
+
+    bool try_yaml2pb(google::protobuf::Message &message, const std::string &buf, const DecodeOptions &options, Error *error)
+    {
+        return try_yaml2pb(message, buf.data(), buf.size(), options, error);
+    }
+
+    bool try_yaml2pb(google::protobuf::Message &message, const char *data, size_t size, Error *error)
+    {
+        return try_yaml2pb(message, data, size, DecodeOptions(), error);
+    }
+
+    bool try_yaml2pb(google::protobuf::Message &message, const char *data, size_t size, const DecodeOptions &options, Error *error)
+    {
+        Error scratch;
+        Error &e = (error) ? *error : scratch;
+        e = Error();
+        return decode_buffer(message, data, size, options, e);
+    }
+
+    // The message holding the streamed field, or null if the path to it is
+    // not set.
+    static google::protobuf::Message *element_parent(google::protobuf::Message &message, const ElementStream &stream)
+    {
+        google::protobuf::Message *parent = &message;
+        for (size_t i = 0; i + 1 < stream.path.size(); i++)
+        {
+            const google::protobuf::Reflection *ref = parent->GetReflection();
+            if (!ref->HasField(*parent, stream.path[i]))
+                return 0;
+            parent = ref->MutableMessage(parent, stream.path[i]);
+        }
+        return parent;
+    }
+
+    // Passes the elements the tree engines appended to the streamed field to
+    // the callback and removes them again, skipping those the event engine
+    // delivered before falling back.
+    static void drain_elements(google::protobuf::Message &message, ElementStream &stream)
+    {
+        google::protobuf::Message *parent = element_parent(message, stream);
+        if (!parent)
+            return;
+        const google::protobuf::Reflection *ref = parent->GetReflection();
+        const google::protobuf::FieldDescriptor *field = stream.path.back();
+        const int size = ref->FieldSize(*parent, field);
+        for (int i = stream.existing + int(stream.delivered); i < size; i++)
+        {
+            if (*stream.callback)
+                (*stream.callback)(*ref->MutableRepeatedMessage(parent, field, i), stream.delivered);
+            stream.delivered++;
+        }
+        if (!stream.existing)
+            ref->ClearField(parent, field);
+        else
+            for (int i = stream.existing; i < size; i++)
+                ref->RemoveLast(parent, field);
+    }
+
+    static bool decode_tree(google::protobuf::Message &message, const char *data, size_t size, const DecodeOptions &options, Error &e)
+    {
+        if (!message.GetDescriptor() || !message.GetReflection())
+        {
+            set_error(e, ERROR_DESCRIPTOR, YAML::Mark::null_mark(), "No descriptor or reflection");
+            return false;
+        }
+
+        YAML::Node node;
+        try
+        {
+            // Parse in place rather than through YAML::Load(std::string),
+            // which copies the input into a stringstream first.
+            membuf sb(data, size);
+            std::istream in(&sb);
+            node = YAML::Load(in);
+        }
+        catch (const YAML::ParserException &ex)
+        {
+            set_error(e, ERROR_SYNTAX, ex.mark, ex.msg);
+            return false;
+        }
+        if (!node.IsMap())
+        {
+            set_error(e, ERROR_TYPE, node.Mark(), "invalid node");
+            return false;
+        }
+
+        const Plan *plan = Plan::get(message.GetDescriptor());
+        if (options.engine == ENGINE_GENERATED && plan->codec() && !options.underscores && !options.mask)
+        {
+            // Generated codecs report errors by throwing, with the path
+            // complete once out of the outermost one.
+            try
+            {
+                if (plan->codec()->from_yaml(message, node))
+                    return true;
             }
-            else if (field->is_repeated())
+            catch (const decode_error &ex)
             {
-                if (!value.IsSequence())
-                    throw exception(field, "invalid array");
-
-                for (YAML::const_iterator it2 = value.begin(); it2 != value.end(); it2++)
-                    yaml2field(message, field, *it2);
+                e = ex.error;
+                return false;
             }
-            else
+            catch (const YAML::Exception &ex)
             {
-                yaml2field(message, field, value);
+                set_error(e, ERROR_TYPE, ex.mark, ex.msg);
+                return false;
+            }
+            catch (const std::exception &ex)
+            {
+                set_error(e, ERROR_VALUE, YAML::Mark::null_mark(), ex.what());
+                return false;
             }
         }
+        return yaml2pb(message, plan, (options.mask) ? options.mask->root() : 0, node, options.underscores, e);
+    }
+
+    bool decode_buffer(google::protobuf::Message &message, const char *data, size_t size, const DecodeOptions &options, Error &e)
+    {
+        if (options.mask && options.mask->descriptor() != message.GetDescriptor())
+        {
+            set_error(e, ERROR_DESCRIPTOR, YAML::Mark::null_mark(), "field mask is not for this message type");
+            return false;
+        }
+
+        ElementStream stream;
+        if (!options.element_path.empty())
+        {
+            if (!message.GetDescriptor() || !stream.resolve(message, options))
+            {
+                set_error(e, ERROR_UNKNOWN_FIELD, YAML::Mark::null_mark(), "invalid element path '" + options.element_path + "'");
+                e.path = options.element_path;
+                return false;
+            }
+        }
+
+        if (options.engine == ENGINE_EVENT)
+        {
+            membuf sb(data, size);
+            std::vector<Range> ranges;
+            rangebuf pruned(ranges);
+            const bool cut = options.mask && message.GetDescriptor() && prune(options.mask->root(), Plan::get(message.GetDescriptor()), data, size, ranges);
+            std::istream in((cut) ? static_cast<std::streambuf *>(&pruned) : &sb);
+            EventStatus status = decode_events(message, in, options, (stream.path.empty()) ? 0 : &stream, e);
+            if (status != EVENTS_ALIASED)
+                return status == EVENTS_DECODED;
+        }
+
+        if (stream.path.empty())
+            return decode_tree(message, data, size, options, e);
+
+        const google::protobuf::Message *parent = element_parent(message, stream);
+        stream.existing = (parent) ? parent->GetReflection()->FieldSize(*parent, stream.path.back()) : 0;
+        if (!decode_tree(message, data, size, options, e))
+            return false;
+        drain_elements(message, stream);
+        return true;
+    }
+
+    size_t decode_batch(const std::string *documents, google::protobuf::Message *const *messages, size_t count, Executor &executor, const DecodeOptions &options, Error *errors)
+    {
+        std::atomic<size_t> failed(0);
+        executor.parallel_for(count, [&](size_t i) {
+            if (!try_yaml2pb(*messages[i], documents[i], options, (errors) ? &errors[i] : 0))
+                failed++;
+        });
+        return failed;
+    }
+
+    size_t decode_batch(const std::vector<std::string> &documents, const std::vector<google::protobuf::Message *> &messages, Executor &executor, std::vector<Error> *errors)
+    {
+        if (documents.size() != messages.size())
+            throw exception("decode_batch: documents and messages differ in size");
+        if (errors)
+            errors->assign(documents.size(), Error());
+        return decode_batch(documents.data(), messages.data(), documents.size(), executor, DecodeOptions(), (errors) ? errors->data() : 0);
     }
 
     void yaml2pb(google::protobuf::Message &message, const std::string &buf)
     {
-        YAML::Node node = YAML::Load(buf);
-        if (!node.IsMap())
-            throw exception("invalid node");
-        yaml2pb(message, node);
+        yaml2pb(message, buf, DecodeOptions());
+    }
+
+    void yaml2pb(google::protobuf::Message &message, const std::string &buf, const DecodeOptions &options)
+    {
+        yaml2pb(message, buf.data(), buf.size(), options);
+    }
+
+    void yaml2pb(google::protobuf::Message &message, const char *data, size_t size)
+    {
+        yaml2pb(message, data, size, DecodeOptions());
+    }
+
+    void yaml2pb(google::protobuf::Message &message, const char *data, size_t size, const DecodeOptions &options)
+    {
+        Error error;
+        if (!try_yaml2pb(message, data, size, options, &error))
+            throw exception(error);
     }
 
-    static void field2yaml(YAML::Node &node, const google::protobuf::Message &message, const google::protobuf::FieldDescriptor *field, int index)
+    // `mask` is what is selected within message values.
+    static void field2yaml(YAML::Node &node, const google::protobuf::Message &message, const google::protobuf::FieldDescriptor *field, int index, const MaskNode *mask)
     {
         const google::protobuf::Reflection *ref = message.GetReflection();
         const bool repeated = field->is_repeated();
 
         switch (field->cpp_type())
         {
-#define _CONVERT(type, ctype, setfunc, addfunc)                                         \
-    case google::protobuf::FieldDescriptor::type:                                       \
-        node = (repeated) ? ref->addfunc(message, field, index) : ref->setfunc(message, field); \
+#define _CONVERT(type, ctype, setfunc, addfunc)                                                      \
+    case google::protobuf::FieldDescriptor::type:                                                    \
+        node = number_text((repeated) ? ref->addfunc(message, field, index) : ref->setfunc(message, field)); \
         break;
 
             _CONVERT(CPPTYPE_DOUBLE, double, GetDouble, GetRepeatedDouble);
@@ -186,14 +454,17 @@ namespace yaml2pb
             _CONVERT(CPPTYPE_UINT64, uint64_t, GetUInt64, GetRepeatedUInt64);
             _CONVERT(CPPTYPE_INT32, int32_t, GetInt32, GetRepeatedInt32);
             _CONVERT(CPPTYPE_UINT32, uint32_t, GetUInt32, GetRepeatedUInt32);
-            _CONVERT(CPPTYPE_BOOL, bool, GetBool, GetRepeatedBool);
 #undef _CONVERT
 
+        case google::protobuf::FieldDescriptor::CPPTYPE_BOOL:
+            node = (repeated) ? ref->GetRepeatedBool(message, field, index) : ref->GetBool(message, field);
+            break;
+
         case google::protobuf::FieldDescriptor::CPPTYPE_STRING: {
             std::string scratch;
             const std::string &value = (repeated) ? ref->GetRepeatedStringReference(message, field, index, &scratch) : ref->GetStringReference(message, field, &scratch);
             if (field->type() == google::protobuf::FieldDescriptor::TYPE_BYTES)
-                node = base64_encode((const BYTE *)value.c_str(), value.size());
+                node = base64_encode(value);
             else
                 node = value;
             break;
@@ -201,13 +472,16 @@ namespace yaml2pb
 
         case google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE: {
             const google::protobuf::Message &mf = (repeated) ? ref->GetRepeatedMessage(message, field, index) : ref->GetMessage(message, field);
-            pb2yaml(node, mf);
+            pb2yaml(node, mf, mask);
+            // Like the streaming encoder, write an empty message as {}.
+            if (node.IsNull())
+                node = YAML::Node(YAML::NodeType::Map);
             break;
         }
 
         case google::protobuf::FieldDescriptor::CPPTYPE_ENUM: {
             const google::protobuf::EnumValueDescriptor *ef = (repeated) ? ref->GetRepeatedEnum(message, field, index) : ref->GetEnum(message, field);
-            node = ef->name();
+            node = enum_text(ef);
             break;
         }
 
@@ -219,69 +493,107 @@ namespace yaml2pb
             throw exception(field, "Fail to convert to yaml");
     }
 
-    static void pb2yaml(YAML::Node &node, const google::protobuf::Message &message)
+    static void value2yaml(YAML::Node &node, const google::protobuf::Message &message, const google::protobuf::FieldDescriptor *field, const MaskNode *mask)
     {
-        const google::protobuf::Descriptor *d = message.GetDescriptor();
         const google::protobuf::Reflection *ref = message.GetReflection();
-        if (!d || !ref)
-            throw exception("No descriptor or reflection");
-
-        std::vector<const google::protobuf::FieldDescriptor *> fields;
-        ref->ListFields(message, &fields);
 
-        for (std::vector<const google::protobuf::FieldDescriptor *>::iterator it = fields.begin(); it != fields.end(); it++)
+        const std::string &name = (field->is_extension()) ? field->full_name() : field->name();
+        if (field->is_map())
         {
-            const google::protobuf::FieldDescriptor *field = *it;
-
-            const std::string &name = (field->is_extension()) ? field->full_name() : field->name();
-            if (field->is_map())
+            size_t count = ref->FieldSize(message, field);
+            if (!count)
+                return;
+
+            // force_insert() does not mark the node defined, so give it its
+            // type up front.
+            YAML::Node map_value = node[name];
+            map_value = YAML::Node(YAML::NodeType::Map);
+            for (size_t j = 0; j < count; j++)
             {
-                size_t count = ref->FieldSize(message, field);
-                if (!count)
-                    continue;
-
-                YAML::Node map_value;
-                for (size_t j = 0; j < count; j++)
-                {
-                    YAML::Node item;
-                    const google::protobuf::Message &mf = ref->GetRepeatedMessage(message, field, j);
-                    const google::protobuf::Descriptor *df = mf.GetDescriptor();
-                    const google::protobuf::FieldDescriptor *map_key_field = df->map_key();
-                    if (map_key_field->type() != google::protobuf::FieldDescriptor::TYPE_STRING)
-                        throw exception(field, "Invalid key type");
-                    field2yaml(item, mf, df->map_value(), 0);
-                    std::string scratch;
-                    const std::string &map_name = mf.GetReflection()->GetStringReference(mf, map_key_field, &scratch);
-                    map_value[map_name] = item;
-                }
-                node[name] = map_value;
+                // Keys of any type are written as scalars, like values.
+                YAML::Node key, item;
+                const google::protobuf::Message &mf = ref->GetRepeatedMessage(message, field, j);
+                const google::protobuf::Descriptor *df = mf.GetDescriptor();
+                field2yaml(key, mf, df->map_key(), 0, 0);
+                field2yaml(item, mf, df->map_value(), 0, 0);
+                // Keys of a protobuf map are unique already; map_value[key]
+                // would scan every entry inserted so far.
+                map_value.force_insert(key, item);
             }
-            else if (field->is_repeated())
-            {
-                size_t count = ref->FieldSize(message, field);
-                if (!count)
-                    continue;
-
-                for (size_t j = 0; j < count; j++)
-                {
-                    YAML::Node item;
-                    field2yaml(item, message, field, j);
-                    node[name].push_back(item);
-                }
-            }
-            else if (ref->HasField(message, field))
+        }
+        else if (field->is_repeated())
+        {
+            size_t count = ref->FieldSize(message, field);
+            if (!count)
+                return;
+
+            // Look the key up once and append through the handle; node[name]
+            // per element repeats the map lookup. The handle already shares
+            // node's memory, so each item is merged in once rather than the
+            // whole sequence being merged again on assignment.
+            YAML::Node sequence = node[name];
+            for (size_t j = 0; j < count; j++)
             {
                 YAML::Node item;
-                field2yaml(item, message, field, 0);
-                node[name] = item;
+                field2yaml(item, message, field, j, mask);
+                sequence.push_back(item);
             }
         }
+        else if (ref->HasField(message, field))
+        {
+            YAML::Node item;
+            field2yaml(item, message, field, 0, mask);
+            node[name] = item;
+        }
+    }
+
+    static void pb2yaml(YAML::Node &node, const google::protobuf::Message &message, const MaskNode *mask)
+    {
+        const google::protobuf::Descriptor *d = message.GetDescriptor();
+        const google::protobuf::Reflection *ref = message.GetReflection();
+        if (!d || !ref)
+            throw exception("No descriptor or reflection");
+
+        // With a mask, only the selected fields are looked at.
+        std::vector<const google::protobuf::FieldDescriptor *> listed;
+        const std::vector<const google::protobuf::FieldDescriptor *> *fields = &listed;
+        if (mask)
+            fields = &mask->selected;
+        else
+            ref->ListFields(message, &listed);
+
+        for (std::vector<const google::protobuf::FieldDescriptor *>::const_iterator it = fields->begin(); it != fields->end(); it++)
+        {
+            const MaskNode *within;
+            MaskNode::select(mask, *it, within);
+            value2yaml(node, message, *it, within);
+        }
+    }
+
+    void encode_tree(YAML::Node &node, const google::protobuf::Message &message)
+    {
+        pb2yaml(node, message, 0);
+    }
+
+    void encode_tree_field(YAML::Node &node, const google::protobuf::Message &message, const google::protobuf::FieldDescriptor *field)
+    {
+        value2yaml(node, message, field, 0);
     }
 
     std::string pb2yaml(const google::protobuf::Message &message)
     {
+        return pb2yaml(message, EncodeOptions());
+    }
+
+    std::string pb2yaml(const google::protobuf::Message &message, const EncodeOptions &options)
+    {
+        if (options.mask && options.mask->descriptor() != message.GetDescriptor())
+            throw exception("field mask is not for this message type");
+
         YAML::Node root;
-        pb2yaml(root, message);
+        const Codec *codec = (options.generated && !options.mask && message.GetDescriptor()) ? Plan::get(message.GetDescriptor())->codec() : 0;
+        if (!codec || !codec->to_yaml(root, message))
+            pb2yaml(root, message, (options.mask) ? options.mask->root() : 0);
         std::ostringstream oss;
         oss << root << std::endl;
         return oss.str();
@@ -0,0 +1,88 @@
+#include "gtest/gtest.h"
+#include <cctype>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include "base64.h"
+
+static std::vector<yaml2pb::Base64Kernel> kernels()
+{
+    std::vector<yaml2pb::Base64Kernel> supported;
+    for (int kernel = yaml2pb::BASE64_SCALAR; kernel <= yaml2pb::base64_kernel(); kernel++)
+        supported.push_back(yaml2pb::Base64Kernel(kernel));
+    return supported;
+}
+
+TEST(base64, known)
+{
+    const char *cases[][2] = {
+        {"", ""},
+        {"f", "Zg=="},
+        {"fo", "Zm8="},
+        {"foo", "Zm9v"},
+        {"foob", "Zm9vYg=="},
+        {"fooba", "Zm9vYmE="},
+        {"foobar", "Zm9vYmFy"},
+    };
+
+    for (yaml2pb::Base64Kernel kernel : kernels())
+    {
+        for (const auto &c : cases)
+        {
+            std::string out;
+            yaml2pb::base64_encode(c[0], strlen(c[0]), out, kernel);
+            EXPECT_EQ(out, c[1]);
+            yaml2pb::base64_decode(c[1], strlen(c[1]), out, kernel);
+            EXPECT_EQ(out, c[0]);
+        }
+    }
+}
+
+TEST(base64, kernels)
+{
+    std::mt19937 random(42);
+    for (size_t size = 0; size < 300; size++)
+    {
+        std::string data(size, '\0');
+        for (char &c : data)
+            c = char(random());
+
+        std::string expected;
+        yaml2pb::base64_encode(data.data(), data.size(), expected, yaml2pb::BASE64_SCALAR);
+        for (yaml2pb::Base64Kernel kernel : kernels())
+        {
+            std::string encoded, decoded;
+            yaml2pb::base64_encode(data.data(), data.size(), encoded, kernel);
+            EXPECT_EQ(encoded, expected) << "kernel " << kernel << ", size " << size;
+            yaml2pb::base64_decode(encoded.data(), encoded.size(), decoded, kernel);
+            EXPECT_EQ(decoded, data) << "kernel " << kernel << ", size " << size;
+        }
+    }
+}
+
+TEST(base64, stops_at_invalid)
+{
+    // Every byte value at every position of a block long enough for the
+    // vector kernels has to decode the same as with the scalar one.
+    const std::string valid = yaml2pb::base64_encode(std::string(96, 'x'));
+    for (size_t pos = 0; pos < valid.size(); pos++)
+    {
+        for (int c = 0; c < 256; c++)
+        {
+            std::string input = valid;
+            input[pos] = char(c);
+
+            std::string expected;
+            yaml2pb::base64_decode(input.data(), input.size(), expected, yaml2pb::BASE64_SCALAR);
+            size_t partial = pos % 4;
+            EXPECT_EQ(expected.size(), (isalnum(c) || c == '+' || c == '/') ? 96 : pos / 4 * 3 + (partial ? partial - 1 : 0));
+            for (yaml2pb::Base64Kernel kernel : kernels())
+            {
+                std::string decoded;
+                yaml2pb::base64_decode(input.data(), input.size(), decoded, kernel);
+                ASSERT_EQ(decoded, expected) << "kernel " << kernel << ", byte " << c << " at " << pos;
+            }
+        }
+    }
+}
@@ -0,0 +1,188 @@
+#include "gtest/gtest.h"
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <unistd.h>
+#include "sample.pb.h"
+#include "yaml2pb/cache.h"
+#include "yaml2pb/yaml2pb.h"
+
+static const char *cache_yaml = "\
+name: cached\n\
+processors:\n\
+  - name: mixer\n\
+    type: video\n\
+    modules:\n\
+      - type: h264\n\
+        bitrate: 1_000\n";
+
+// Paths of the entries in `dir`.
+static std::vector<std::string> entries(const std::string &dir)
+{
+    std::vector<std::string> paths;
+    if (DIR *d = opendir(dir.c_str()))
+    {
+        while (struct dirent *entry = readdir(d))
+            if (entry->d_name[0] != '.')
+                paths.push_back(dir + "/" + entry->d_name);
+        closedir(d);
+    }
+    return paths;
+}
+
+static void remove_all(const std::string &dir)
+{
+    std::vector<std::string> paths = entries(dir);
+    for (size_t i = 0; i < paths.size(); i++)
+        unlink(paths[i].c_str());
+    rmdir(dir.c_str());
+}
+
+TEST(cache, hits)
+{
+    char root[] = "/tmp/yaml2pb_cache_XXXXXX";
+    ASSERT_TRUE(mkdtemp(root));
+    // Created on the first store.
+    const std::string dir = std::string(root) + "/cache";
+
+    yaml2pb::DecodeOptions options;
+    options.underscores = true;
+    Sample expected;
+    yaml2pb::yaml2pb(expected, cache_yaml, options);
+
+    yaml2pb::DecodeCache cache(dir, options);
+    for (int i = 0; i < 3; i++)
+    {
+        Sample sample;
+        yaml2pb::Error error;
+        ASSERT_TRUE(cache.decode(sample, cache_yaml, &error)) << error.to_string();
+        EXPECT_EQ(sample.SerializeAsString(), expected.SerializeAsString());
+    }
+    yaml2pb::CacheStats stats = cache.stats();
+    EXPECT_EQ(stats.misses, 1u);
+    EXPECT_EQ(stats.hits, 2u);
+    EXPECT_EQ(stats.stores, 1u);
+    EXPECT_EQ(stats.errors, 0u);
+    ASSERT_EQ(entries(dir).size(), 1u);
+
+    // Another process, or another cache on the same directory.
+    yaml2pb::DecodeCache other(dir, options);
+    Sample sample;
+    EXPECT_TRUE(other.decode(sample, cache_yaml, 0));
+    EXPECT_EQ(other.stats().hits, 1u);
+
+    // Decoding on top of a non-empty message goes around the cache, so the
+    // zero values the document sets replace the message's own.
+    Sample merged;
+    merged.set_name("before");
+    merged.add_drains()->set_name("kept");
+    Sample direct = merged;
+    yaml2pb::yaml2pb(direct, cache_yaml, options);
+    EXPECT_TRUE(cache.decode(merged, cache_yaml, 0));
+    EXPECT_EQ(merged.SerializeAsString(), direct.SerializeAsString());
+    Module zero;
+    EXPECT_TRUE(cache.decode(zero, std::string("type: unknown\nwidth: 0\n"), 0));
+    zero.set_type(Module::scaler);
+    zero.set_width(640);
+    EXPECT_TRUE(cache.decode(zero, std::string("type: unknown\nwidth: 0\n"), 0));
+    EXPECT_EQ(zero.type(), Module::unknown);
+    EXPECT_EQ(zero.width(), 0);
+    EXPECT_EQ(cache.stats().hits, 2u);
+
+    // The same bytes for another type, or with other options, are other
+    // entries.
+    Processor processor;
+    EXPECT_TRUE(cache.decode(processor, std::string("name: cached\n"), 0));
+    yaml2pb::DecodeCache strict(dir);
+    Sample rejected;
+    EXPECT_FALSE(strict.decode(rejected, cache_yaml, 0));
+    EXPECT_EQ(strict.stats().misses, 1u);
+    // Failures are not stored.
+    EXPECT_EQ(entries(dir).size(), 3u);
+
+    remove_all(dir);
+    rmdir(root);
+}
+
+TEST(cache, damaged)
+{
+    char dir[] = "/tmp/yaml2pb_cache_XXXXXX";
+    ASSERT_TRUE(mkdtemp(dir));
+    yaml2pb::DecodeCache cache(dir);
+    Sample expected;
+    yaml2pb::yaml2pb(expected, "name: damaged\n");
+
+    Sample sample;
+    ASSERT_TRUE(cache.decode(sample, std::string("name: damaged\n"), 0));
+    ASSERT_EQ(entries(dir).size(), 1u);
+    const std::string path = entries(dir)[0];
+
+    // Truncated, garbled and emptied entries are decoded again and
+    // replaced.
+    const int sizes[] = {60, 20, 0};
+    for (int size : sizes)
+    {
+        ASSERT_EQ(truncate(path.c_str(), size), 0);
+        if (size == 60)
+            std::ofstream(path, std::ios::in | std::ios::out) << "garbage";
+        sample.Clear();
+        ASSERT_TRUE(cache.decode(sample, std::string("name: damaged\n"), 0));
+        EXPECT_EQ(sample.SerializeAsString(), expected.SerializeAsString());
+        sample.Clear();
+        ASSERT_TRUE(cache.decode(sample, std::string("name: damaged\n"), 0));
+        EXPECT_EQ(sample.SerializeAsString(), expected.SerializeAsString());
+    }
+    yaml2pb::CacheStats stats = cache.stats();
+    EXPECT_EQ(stats.errors, 3u);
+    EXPECT_EQ(stats.misses, 4u);
+    EXPECT_EQ(stats.hits, 3u);
+    EXPECT_EQ(stats.stores, 4u);
+
+    // Files go through the cache as well.
+    sample.Clear();
+    const std::string file = std::string(dir) + "/config.yaml";
+    std::ofstream(file) << "name: damaged\n";
+    EXPECT_TRUE(cache.load_file(sample, file.c_str(), 0));
+    EXPECT_EQ(sample.SerializeAsString(), expected.SerializeAsString());
+    EXPECT_EQ(cache.stats().hits, 4u);
+    yaml2pb::Error error;
+    EXPECT_FALSE(cache.load_file(sample, (file + ".missing").c_str(), &error));
+    EXPECT_EQ(error.kind, yaml2pb::ERROR_IO);
+
+    remove_all(dir);
+}
+
+TEST(cache, concurrent)
+{
+    char dir[] = "/tmp/yaml2pb_cache_XXXXXX";
+    ASSERT_TRUE(mkdtemp(dir));
+    yaml2pb::DecodeOptions options;
+    options.underscores = true;
+    Sample expected;
+    yaml2pb::yaml2pb(expected, cache_yaml, options);
+
+    // Writers racing on the same entries never leave a partial one.
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++)
+    {
+        threads.emplace_back([&dir, &options, &expected]() {
+            yaml2pb::DecodeCache cache(dir, options);
+            for (int i = 0; i < 50; i++)
+            {
+                Sample sample;
+                std::string yaml = std::string(cache_yaml) + "drains: [{name: d" + std::to_string(i % 5) + "}]\n";
+                ASSERT_TRUE(cache.decode(sample, yaml, 0));
+                EXPECT_EQ(sample.processors(0).SerializeAsString(), expected.processors(0).SerializeAsString());
+                EXPECT_EQ(sample.drains(0).name(), "d" + std::to_string(i % 5));
+            }
+            EXPECT_EQ(cache.stats().errors, 0u);
+        });
+    }
+    for (size_t t = 0; t < threads.size(); t++)
+        threads[t].join();
+    EXPECT_EQ(entries(dir).size(), 5u);
+    remove_all(dir);
+}
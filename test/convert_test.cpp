@@ -0,0 +1,287 @@
+#include "gtest/gtest.h"
+#include <clocale>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <random>
+#include <string>
+#include "convert.h"
+#include "format.h"
+#include "google/protobuf/descriptor.pb.h"
+#include "google/protobuf/dynamic_message.h"
+#include "google/protobuf/text_format.h"
+#include "sample.pb.h"
+#include "yaml2pb/sink.h"
+#include "yaml2pb/yaml2pb.h"
+
+template <typename T>
+static bool parses(const std::string &input, T expected, bool underscores = false)
+{
+    T value;
+    return yaml2pb::scalar_as(input, value, underscores) && value == expected;
+}
+
+template <typename T>
+static bool rejects(const std::string &input, bool underscores = false)
+{
+    T value;
+    return !yaml2pb::scalar_as(input, value, underscores);
+}
+
+TEST(convert, integers)
+{
+    EXPECT_TRUE(parses<int32_t>("0", 0));
+    EXPECT_TRUE(parses<int32_t>("-0", 0));
+    EXPECT_TRUE(parses<int32_t>("+42", 42));
+    EXPECT_TRUE(parses<int32_t>("0x1F", 31));
+    EXPECT_TRUE(parses<int32_t>("-0x10", -16));
+    EXPECT_TRUE(parses<int32_t>("017", 15));
+    EXPECT_TRUE(parses<int32_t>("0o17", 15));
+    EXPECT_TRUE(parses<int32_t>("12 \n", 12));
+    EXPECT_TRUE(rejects<int32_t>(""));
+    EXPECT_TRUE(rejects<int32_t>("-"));
+    EXPECT_TRUE(rejects<int32_t>("0x"));
+    EXPECT_TRUE(rejects<int32_t>("08"));
+    EXPECT_TRUE(rejects<int32_t>(" 1"));
+    EXPECT_TRUE(rejects<int32_t>("1.0"));
+    EXPECT_TRUE(rejects<int32_t>("1e3"));
+    EXPECT_TRUE(rejects<int32_t>("12abc"));
+
+    // Exact limits of every protobuf integer type.
+    EXPECT_TRUE(parses<int32_t>("2147483647", INT32_MAX));
+    EXPECT_TRUE(parses<int32_t>("-2147483648", INT32_MIN));
+    EXPECT_TRUE(rejects<int32_t>("2147483648"));
+    EXPECT_TRUE(rejects<int32_t>("-2147483649"));
+    EXPECT_TRUE(parses<uint32_t>("4294967295", UINT32_MAX));
+    EXPECT_TRUE(parses<uint32_t>("0xffffffff", UINT32_MAX));
+    EXPECT_TRUE(rejects<uint32_t>("4294967296"));
+    EXPECT_TRUE(rejects<uint32_t>("-1"));
+    EXPECT_TRUE(rejects<uint32_t>("-0"));
+    EXPECT_TRUE(parses<int64_t>("9223372036854775807", INT64_MAX));
+    EXPECT_TRUE(parses<int64_t>("-9223372036854775808", INT64_MIN));
+    EXPECT_TRUE(rejects<int64_t>("9223372036854775808"));
+    EXPECT_TRUE(rejects<int64_t>("-9223372036854775809"));
+    EXPECT_TRUE(parses<uint64_t>("18446744073709551615", UINT64_MAX));
+    EXPECT_TRUE(rejects<uint64_t>("18446744073709551616"));
+    EXPECT_TRUE(rejects<uint64_t>("0x10000000000000000"));
+}
+
+TEST(convert, reals)
+{
+    EXPECT_TRUE(parses<double>("0", 0.0));
+    EXPECT_TRUE(parses<double>("1.5", 1.5));
+    EXPECT_TRUE(parses<double>("-.5", -0.5));
+    EXPECT_TRUE(parses<double>("2.", 2.0));
+    EXPECT_TRUE(parses<double>("+1e3", 1000.0));
+    EXPECT_TRUE(parses<double>("1.25E-2", 0.0125));
+    EXPECT_TRUE(parses<double>("0.1", 0.1));
+    EXPECT_TRUE(parses<double>("3.14 ", 3.14));
+    EXPECT_TRUE(parses<float>("0.1", 0.1f));
+    EXPECT_TRUE(parses<double>(".inf", std::numeric_limits<double>::infinity()));
+    EXPECT_TRUE(parses<double>("-.Inf", -std::numeric_limits<double>::infinity()));
+    EXPECT_TRUE(parses<float>("+.INF", std::numeric_limits<float>::infinity()));
+    double nan;
+    EXPECT_TRUE(yaml2pb::scalar_as(".NaN", nan) && std::isnan(nan));
+    double zero;
+    EXPECT_TRUE(yaml2pb::scalar_as("-0.0", zero) && zero == 0 && std::signbit(zero));
+
+    EXPECT_TRUE(rejects<double>(""));
+    EXPECT_TRUE(rejects<double>("."));
+    EXPECT_TRUE(rejects<double>("1e"));
+    EXPECT_TRUE(rejects<double>("1.2.3"));
+    EXPECT_TRUE(rejects<double>("0x10"));
+    EXPECT_TRUE(rejects<double>("inf"));
+    EXPECT_TRUE(rejects<double>("+.nan"));
+    EXPECT_TRUE(rejects<double>("1,5"));
+    EXPECT_TRUE(rejects<double>("1e400"));
+    EXPECT_TRUE(rejects<float>("1e39"));
+    EXPECT_TRUE(parses<double>("1e-400", 0.0));
+    EXPECT_TRUE(parses<double>("4.9406564584124654e-324", std::numeric_limits<double>::denorm_min()));
+    EXPECT_TRUE(parses<double>("1.7976931348623157e308", std::numeric_limits<double>::max()));
+    EXPECT_TRUE(parses<float>("3.40282347e38", std::numeric_limits<float>::max()));
+    EXPECT_TRUE(parses<double>("0.30000000000000000000000001", 0.3));
+    EXPECT_TRUE(parses<double>("12345678901234567890123", 12345678901234567890123.0));
+}
+
+// Both the fast path and the fallback agree with strtod.
+TEST(convert, round_trip)
+{
+    std::mt19937_64 random(1);
+    for (int i = 0; i < 100000; i++)
+    {
+        uint64_t bits = random();
+        double expected;
+        memcpy(&expected, &bits, sizeof(expected));
+        if (!std::isfinite(expected))
+            continue;
+        char text[32];
+        snprintf(text, sizeof(text), (i % 2) ? "%.17g" : "%.6g", expected);
+        double value;
+        ASSERT_TRUE(yaml2pb::scalar_as(text, value)) << text;
+        EXPECT_EQ(value, strtod(text, 0)) << text;
+
+        float single;
+        uint32_t half = uint32_t(bits);
+        memcpy(&single, &half, sizeof(single));
+        if (!std::isfinite(single))
+            continue;
+        snprintf(text, sizeof(text), (i % 2) ? "%.9g" : "%.4g", double(single));
+        ASSERT_TRUE(yaml2pb::scalar_as(text, single)) << text;
+        EXPECT_EQ(single, strtof(text, 0)) << text;
+    }
+}
+
+TEST(convert, locale)
+{
+    const char *previous = setlocale(LC_NUMERIC, 0);
+    const std::string saved = (previous) ? previous : "C";
+    if (!setlocale(LC_NUMERIC, "de_DE.UTF-8") && !setlocale(LC_NUMERIC, "fr_FR.UTF-8"))
+        GTEST_SKIP() << "no locale with a decimal comma";
+    EXPECT_TRUE(parses<double>("0.30000000000000004", 0.30000000000000004));
+    EXPECT_TRUE(rejects<double>("0,5"));
+    setlocale(LC_NUMERIC, saved.c_str());
+}
+
+TEST(convert, underscores)
+{
+    EXPECT_TRUE(rejects<int32_t>("1_000"));
+    EXPECT_TRUE(parses<int32_t>("1_000", 1000, true));
+    EXPECT_TRUE(parses<uint32_t>("0xff_ff", 0xffff, true));
+    EXPECT_TRUE(parses<double>("1_000.000_5e1_0", 1000.0005e10, true));
+    EXPECT_TRUE(parses<double>("3.141_592_653_589_793_238_462", 3.141592653589793238462, true));
+    EXPECT_TRUE(rejects<int32_t>("_1", true));
+    EXPECT_TRUE(rejects<int32_t>("1_", true));
+    EXPECT_TRUE(rejects<int32_t>("1__0", true));
+    EXPECT_TRUE(rejects<int32_t>("0x_1", true));
+    EXPECT_TRUE(rejects<double>("1_.5", true));
+
+    const char *engines[] = {"event", "tree", "generated"};
+    for (int engine = yaml2pb::ENGINE_EVENT; engine <= yaml2pb::ENGINE_GENERATED; engine++)
+    {
+        SCOPED_TRACE(engines[engine]);
+        yaml2pb::DecodeOptions options;
+        options.engine = yaml2pb::Engine(engine);
+        Module module;
+        EXPECT_FALSE(yaml2pb::try_yaml2pb(module, "bitrate: 1_000_000\n", options, 0));
+        options.underscores = true;
+        EXPECT_TRUE(yaml2pb::try_yaml2pb(module, "bitrate: 1_000_000\n", options, 0));
+        EXPECT_EQ(module.bitrate(), 1000000);
+    }
+}
+
+TEST(convert, format)
+{
+    EXPECT_EQ(yaml2pb::number_text(0.0), "0");
+    EXPECT_EQ(yaml2pb::number_text(-0.0), "-0");
+    EXPECT_EQ(yaml2pb::number_text(0.1), "0.1");
+    EXPECT_EQ(yaml2pb::number_text(0.1 + 0.2), "0.30000000000000004");
+    EXPECT_EQ(yaml2pb::number_text(1.5), "1.5");
+    EXPECT_EQ(yaml2pb::number_text(-250.0), "-250");
+    EXPECT_EQ(yaml2pb::number_text(0.0001), "0.0001");
+    EXPECT_EQ(yaml2pb::number_text(0.00001), "1e-05");
+    EXPECT_EQ(yaml2pb::number_text(1e16), "10000000000000000");
+    EXPECT_EQ(yaml2pb::number_text(1e17), "1e+17");
+    EXPECT_EQ(yaml2pb::number_text(123456789012345680000.0), "1.2345678901234568e+20");
+    EXPECT_EQ(yaml2pb::number_text(5e-324), "5e-324");
+    EXPECT_EQ(yaml2pb::number_text(std::numeric_limits<double>::max()), "1.7976931348623157e+308");
+    EXPECT_EQ(yaml2pb::number_text(0.1f), "0.1");
+    EXPECT_EQ(yaml2pb::number_text(16777216.0f), "16777216");
+    EXPECT_EQ(yaml2pb::number_text(1e9f), "1e+09");
+    EXPECT_EQ(yaml2pb::number_text(std::numeric_limits<float>::max()), "3.4028235e+38");
+    EXPECT_EQ(yaml2pb::number_text(std::numeric_limits<double>::infinity()), ".inf");
+    EXPECT_EQ(yaml2pb::number_text(-std::numeric_limits<float>::infinity()), "-.inf");
+    EXPECT_EQ(yaml2pb::number_text(std::numeric_limits<double>::quiet_NaN()), ".nan");
+
+    EXPECT_EQ(yaml2pb::number_text(int32_t(0)), "0");
+    EXPECT_EQ(yaml2pb::number_text(INT32_MIN), "-2147483648");
+    EXPECT_EQ(yaml2pb::number_text(UINT32_MAX), "4294967295");
+    EXPECT_EQ(yaml2pb::number_text(INT64_MIN), "-9223372036854775808");
+    EXPECT_EQ(yaml2pb::number_text(UINT64_MAX), "18446744073709551615");
+}
+
+// Every finite value reads back bit for bit, in no more digits than %.17g
+// (%.9g for floats) needs.
+TEST(convert, format_round_trip)
+{
+    std::mt19937_64 random(2);
+    for (int i = 0; i < 200000; i++)
+    {
+        const uint64_t bits = random();
+        double value;
+        memcpy(&value, &bits, sizeof(value));
+        if (!std::isfinite(value))
+            continue;
+        const std::string text = yaml2pb::number_text(value);
+        double parsed;
+        ASSERT_TRUE(yaml2pb::scalar_as(text, parsed)) << text;
+        ASSERT_EQ(memcmp(&parsed, &value, sizeof(value)), 0) << text;
+        char reference[32];
+        EXPECT_LE(text.size(), size_t(snprintf(reference, sizeof(reference), "%.17g", value))) << text;
+
+        float single;
+        const uint32_t half = uint32_t(bits >> 17);
+        memcpy(&single, &half, sizeof(single));
+        if (!std::isfinite(single))
+            continue;
+        const std::string short_text = yaml2pb::number_text(single);
+        float parsed_single;
+        ASSERT_TRUE(yaml2pb::scalar_as(short_text, parsed_single)) << short_text;
+        ASSERT_EQ(memcmp(&parsed_single, &single, sizeof(single)), 0) << short_text;
+        EXPECT_LE(short_text.size(), size_t(snprintf(reference, sizeof(reference), "%.9g", double(single)))) << short_text;
+    }
+}
+
+// pb2yaml() and yaml2pb() restore every number, through either encoder.
+TEST(convert, message_round_trip)
+{
+    google::protobuf::FileDescriptorProto file;
+    ASSERT_TRUE(google::protobuf::TextFormat::ParseFromString("name: 'numbers.proto' syntax: 'proto3' "
+                                                              "message_type { name: 'Numbers' "
+                                                              "field { name: 'reals' number: 1 label: LABEL_REPEATED type: TYPE_DOUBLE } "
+                                                              "field { name: 'singles' number: 2 label: LABEL_REPEATED type: TYPE_FLOAT } "
+                                                              "field { name: 'signed' number: 3 label: LABEL_REPEATED type: TYPE_SINT64 } "
+                                                              "field { name: 'unsigned' number: 4 label: LABEL_REPEATED type: TYPE_FIXED64 } }",
+                                                              &file));
+    google::protobuf::DescriptorPool pool;
+    const google::protobuf::FileDescriptor *numbers = pool.BuildFile(file);
+    ASSERT_TRUE(numbers);
+    google::protobuf::DynamicMessageFactory factory(&pool);
+    const google::protobuf::Message *prototype = factory.GetPrototype(numbers->message_type(0));
+    std::unique_ptr<google::protobuf::Message> message(prototype->New());
+
+    const google::protobuf::Descriptor *d = message->GetDescriptor();
+    const google::protobuf::Reflection *ref = message->GetReflection();
+    std::mt19937_64 random(3);
+    for (int i = 0; i < 1000; i++)
+    {
+        uint64_t bits = random();
+        double real;
+        float single;
+        memcpy(&real, &bits, sizeof(real));
+        memcpy(&single, &bits, sizeof(single));
+        ref->AddDouble(message.get(), d->field(0), (std::isnan(real)) ? 0.5 : real);
+        ref->AddFloat(message.get(), d->field(1), (std::isnan(single)) ? 0.5f : single);
+        ref->AddInt64(message.get(), d->field(2), int64_t(bits));
+        ref->AddUInt64(message.get(), d->field(3), bits);
+    }
+
+    for (int sink = 0; sink < 2; sink++)
+    {
+        std::string yaml;
+        if (sink)
+        {
+            yaml2pb::BufferSink out(yaml);
+            yaml2pb::pb2yaml(*message, out);
+        }
+        else
+            yaml = yaml2pb::pb2yaml(*message);
+        std::unique_ptr<google::protobuf::Message> decoded(prototype->New());
+        yaml2pb::yaml2pb(*decoded, yaml);
+        EXPECT_EQ(decoded->SerializeAsString(), message->SerializeAsString());
+    }
+    yaml2pb::release_pool(&pool);
+}
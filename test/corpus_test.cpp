@@ -0,0 +1,120 @@
+#include "gtest/gtest.h"
+#include <memory>
+#include <sstream>
+#include <string>
+#include "google/protobuf/descriptor.pb.h"
+#include "google/protobuf/dynamic_message.h"
+#include "google/protobuf/text_format.h"
+#include "google/protobuf/util/message_differencer.h"
+#include "corpus.h"
+#include "sample.pb.h"
+#include "yaml2pb/yaml2pb.h"
+
+static std::string generate(const yaml2pb::corpus::Options &options, std::string *binary)
+{
+    std::ostringstream yaml, pb;
+    size_t size = yaml2pb::corpus::generate(Sample::descriptor(), options, yaml, pb);
+    EXPECT_EQ(size, yaml.str().size());
+    if (binary)
+        *binary = pb.str();
+    return yaml.str();
+}
+
+TEST(corpus, seeded)
+{
+    yaml2pb::corpus::Options options;
+    options.size = 16 << 10;
+    const std::string first = generate(options, NULL);
+    EXPECT_EQ(first, generate(options, NULL));
+
+    options.seed = 2;
+    EXPECT_NE(first, generate(options, NULL));
+}
+
+TEST(corpus, size)
+{
+    yaml2pb::corpus::Options options;
+    // Several batches of the root collections.
+    options.size = 4 << 20;
+    const std::string yaml = generate(options, NULL);
+    EXPECT_GE(yaml.size(), options.size);
+    EXPECT_LT(yaml.size(), options.size + (options.size >> 4));
+}
+
+TEST(corpus, round_trip)
+{
+    const yaml2pb::Engine engines[] = {yaml2pb::ENGINE_EVENT, yaml2pb::ENGINE_TREE, yaml2pb::ENGINE_GENERATED};
+    for (uint64_t seed = 1; seed <= 8; seed++)
+    {
+        yaml2pb::corpus::Options options;
+        options.seed = seed;
+        options.size = 32 << 10;
+        options.repeat = int(seed);
+        options.fill = int(seed * 12);
+
+        std::string binary;
+        const std::string yaml = generate(options, &binary);
+        Sample expected;
+        ASSERT_TRUE(expected.ParseFromString(binary));
+
+        for (yaml2pb::Engine engine : engines)
+        {
+            yaml2pb::DecodeOptions decode;
+            decode.engine = engine;
+            Sample sample;
+            yaml2pb::Error error;
+            ASSERT_TRUE(yaml2pb::try_yaml2pb(sample, yaml, decode, &error)) << "seed " << seed << ": " << error.to_string();
+            EXPECT_TRUE(google::protobuf::util::MessageDifferencer::Equals(sample, expected)) << "seed " << seed << ", engine " << engine;
+        }
+    }
+}
+
+TEST(corpus, map_keys)
+{
+    google::protobuf::FileDescriptorProto file;
+    ASSERT_TRUE(google::protobuf::TextFormat::ParseFromString("name: 'keys.proto' syntax: 'proto3' "
+                                                              "message_type { name: 'Keys' "
+                                                              "field { name: 'ints' number: 1 label: LABEL_REPEATED type: TYPE_MESSAGE type_name: '.Keys.IntsEntry' } "
+                                                              "field { name: 'flags' number: 2 label: LABEL_REPEATED type: TYPE_MESSAGE type_name: '.Keys.FlagsEntry' } "
+                                                              "field { name: 'counts' number: 3 label: LABEL_REPEATED type: TYPE_MESSAGE type_name: '.Keys.CountsEntry' } "
+                                                              "nested_type { name: 'IntsEntry' options { map_entry: true } "
+                                                              "field { name: 'key' number: 1 label: LABEL_OPTIONAL type: TYPE_INT64 } "
+                                                              "field { name: 'value' number: 2 label: LABEL_OPTIONAL type: TYPE_INT64 } } "
+                                                              "nested_type { name: 'FlagsEntry' options { map_entry: true } "
+                                                              "field { name: 'key' number: 1 label: LABEL_OPTIONAL type: TYPE_BOOL } "
+                                                              "field { name: 'value' number: 2 label: LABEL_OPTIONAL type: TYPE_STRING } } "
+                                                              "nested_type { name: 'CountsEntry' options { map_entry: true } "
+                                                              "field { name: 'key' number: 1 label: LABEL_OPTIONAL type: TYPE_UINT32 } "
+                                                              "field { name: 'value' number: 2 label: LABEL_OPTIONAL type: TYPE_DOUBLE } } }",
+                                                              &file));
+    google::protobuf::DescriptorPool pool;
+    const google::protobuf::FileDescriptor *keys = pool.BuildFile(file);
+    ASSERT_TRUE(keys);
+    const google::protobuf::Descriptor *descriptor = keys->message_type(0);
+    {
+        google::protobuf::DynamicMessageFactory factory(&pool);
+        const google::protobuf::Message *prototype = factory.GetPrototype(descriptor);
+
+        yaml2pb::corpus::Options options;
+        options.size = 64 << 10;
+        std::ostringstream yaml, pb;
+        yaml2pb::corpus::generate(descriptor, options, yaml, pb);
+        std::unique_ptr<google::protobuf::Message> expected(prototype->New());
+        ASSERT_TRUE(expected->ParseFromString(pb.str()));
+        const google::protobuf::Reflection *ref = expected->GetReflection();
+        EXPECT_GT(ref->FieldSize(*expected, descriptor->field(0)), 100);
+        EXPECT_EQ(ref->FieldSize(*expected, descriptor->field(1)), 2);
+
+        const yaml2pb::Engine engines[] = {yaml2pb::ENGINE_EVENT, yaml2pb::ENGINE_TREE};
+        for (yaml2pb::Engine engine : engines)
+        {
+            yaml2pb::DecodeOptions decode;
+            decode.engine = engine;
+            std::unique_ptr<google::protobuf::Message> message(prototype->New());
+            yaml2pb::Error error;
+            ASSERT_TRUE(yaml2pb::try_yaml2pb(*message, yaml.str(), decode, &error)) << error.to_string();
+            EXPECT_TRUE(google::protobuf::util::MessageDifferencer::Equals(*message, *expected)) << "engine " << engine;
+        }
+    }
+    yaml2pb::release_pool(&pool);
+}
@@ -0,0 +1,66 @@
+#include "gtest/gtest.h"
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "yaml2pb/executor.h"
+
+TEST(executor, every_index_once)
+{
+    yaml2pb::Executor executor(4);
+    EXPECT_EQ(executor.size(), 4u);
+
+    for (size_t count : {0, 1, 3, 100, 10000})
+    {
+        std::vector<std::atomic<int>> calls(count);
+        for (size_t i = 0; i < count; i++)
+            calls[i] = 0;
+        executor.parallel_for(count, [&calls](size_t i) { calls[i]++; });
+        for (size_t i = 0; i < count; i++)
+            EXPECT_EQ(calls[i].load(), 1) << "index " << i << " of " << count;
+    }
+}
+
+TEST(executor, uneven)
+{
+    // One slow index per worker queue; the others have to steal the rest.
+    yaml2pb::Executor executor(4);
+    std::atomic<size_t> total(0);
+    executor.parallel_for(64, [&total](size_t i) {
+        if (i % 16 == 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        total += i;
+    });
+    EXPECT_EQ(total.load(), 64u * 63 / 2);
+}
+
+TEST(executor, exception)
+{
+    yaml2pb::Executor executor(2);
+    std::atomic<int> calls(0);
+    EXPECT_THROW(executor.parallel_for(100, [&calls](size_t i) {
+        calls++;
+        if (i == 42)
+            throw std::runtime_error("42");
+    }),
+                 std::runtime_error);
+    // The other calls still run.
+    EXPECT_EQ(calls.load(), 100);
+}
+
+TEST(executor, nested_and_concurrent)
+{
+    yaml2pb::Executor executor(3);
+    std::atomic<int> calls(0);
+    std::vector<std::thread> callers;
+    for (int t = 0; t < 4; t++)
+        callers.push_back(std::thread([&executor, &calls]() {
+            executor.parallel_for(8, [&executor, &calls](size_t) {
+                executor.parallel_for(8, [&calls](size_t) { calls++; });
+            });
+        }));
+    for (size_t t = 0; t < callers.size(); t++)
+        callers[t].join();
+    EXPECT_EQ(calls.load(), 4 * 8 * 8);
+}
@@ -0,0 +1,210 @@
+#include "gtest/gtest.h"
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+#include "sample.pb.h"
+#include "yaml2pb/incremental.h"
+#include "yaml2pb/yaml2pb.h"
+
+static const char *base_yaml = "\
+name: recorder\n\
+metadata:\n\
+  info:\n\
+    owner: media\n\
+sources:\n\
+  - name: camera\n\
+    processors: [mixer]\n\
+processors:\n\
+  - name: first\n\
+    type: video\n\
+    modules:\n\
+      - type: scaler\n\
+        width: 640\n\
+  - name: second\n\
+    type: audio\n\
+  # between elements\n\
+  - name: third\n\
+    modules:\n\
+      - type: aac\n\
+drains:\n\
+- name: out\n\
+  type: mp4\n";
+
+// Decodes `yaml` incrementally on top of whatever `sample` holds, and checks
+// the result against a full decode.
+static void expect_same(yaml2pb::IncrementalDecoder &decoder, Sample &sample, const std::string &yaml)
+{
+    Sample expected;
+    yaml2pb::Error expected_error;
+    const bool ok = yaml2pb::try_yaml2pb(expected, yaml, &expected_error);
+
+    const std::string before = sample.SerializeAsString();
+    yaml2pb::Error error;
+    EXPECT_EQ(decoder.decode(sample, yaml, &error), ok) << yaml;
+    if (ok)
+        EXPECT_EQ(sample.DebugString(), expected.DebugString()) << yaml;
+    else
+    {
+        EXPECT_EQ(error.to_string(), expected_error.to_string());
+        EXPECT_EQ(sample.SerializeAsString(), before);
+    }
+}
+
+static std::string replace(std::string text, const std::string &from, const std::string &to)
+{
+    const size_t at = text.find(from);
+    EXPECT_NE(at, std::string::npos) << from;
+    return text.replace(at, from.size(), to);
+}
+
+TEST(incremental, changes)
+{
+    yaml2pb::IncrementalDecoder decoder;
+    Sample sample;
+    expect_same(decoder, sample, base_yaml);
+    EXPECT_TRUE(decoder.stats().full);
+
+    // Nothing changed: every key is kept.
+    expect_same(decoder, sample, base_yaml);
+    EXPECT_FALSE(decoder.stats().full);
+    EXPECT_EQ(decoder.stats().decoded, 0u);
+    EXPECT_EQ(decoder.stats().reused, 5u);
+
+    // One element of processors: the other two and the other keys stay.
+    std::string yaml = replace(base_yaml, "width: 640", "width: 1280");
+    expect_same(decoder, sample, yaml);
+    EXPECT_FALSE(decoder.stats().full);
+    EXPECT_EQ(decoder.stats().decoded, 1u);
+    EXPECT_EQ(decoder.stats().reused, 6u);
+
+    // Elements reordered, removed and added.
+    yaml = replace(yaml, "  - name: second\n    type: audio\n", "");
+    yaml = replace(yaml, "  - name: third\n", "  - name: fourth\n  - name: third\n");
+    expect_same(decoder, sample, yaml);
+    // fourth, and first, which now ends in the comment that followed second.
+    EXPECT_EQ(decoder.stats().decoded, 2u);
+    yaml = replace(yaml, "  - name: fourth\n", "");
+    yaml = replace(yaml, "processors:\n", "processors:\n  - name: fourth\n");
+    expect_same(decoder, sample, yaml);
+    EXPECT_FALSE(decoder.stats().full);
+    EXPECT_EQ(decoder.stats().decoded, 0u);
+
+    // A nested mapping, keys removed and added.
+    yaml = replace(yaml, "owner: media", "owner: video");
+    expect_same(decoder, sample, yaml);
+    EXPECT_EQ(decoder.stats().decoded, 1u);
+    yaml = replace(yaml, "name: recorder\n", "");
+    expect_same(decoder, sample, yaml);
+    yaml = "name: player\n" + yaml;
+    expect_same(decoder, sample, yaml);
+    EXPECT_FALSE(decoder.stats().full);
+
+    // A compact sequence as indented as its key.
+    yaml = replace(yaml, "- name: out\n", "- name: in\n");
+    expect_same(decoder, sample, yaml);
+    EXPECT_FALSE(decoder.stats().full);
+
+    // Inline values and flow style are kept whole.
+    yaml = replace(yaml, "processors: [mixer]", "processors: [mixer, muxer]");
+    expect_same(decoder, sample, yaml);
+    EXPECT_FALSE(decoder.stats().full);
+}
+
+TEST(incremental, errors)
+{
+    yaml2pb::IncrementalDecoder decoder;
+    Sample sample;
+    expect_same(decoder, sample, base_yaml);
+
+    // A failed version leaves the message and the decoder as they were.
+    expect_same(decoder, sample, replace(base_yaml, "width: 640", "width: wide"));
+    EXPECT_TRUE(decoder.stats().full);
+    expect_same(decoder, sample, replace(base_yaml, "type: audio", "typ: audio"));
+    expect_same(decoder, sample, replace(base_yaml, "name: recorder", "name: [recorder"));
+    expect_same(decoder, sample, base_yaml);
+    EXPECT_FALSE(decoder.stats().full);
+    EXPECT_EQ(decoder.stats().decoded, 0u);
+
+    // Text the split cannot follow is decoded in full.
+    const char *unsplit[] = {
+        "{name: flow}\n",
+        "'name': quoted\n",
+        "name: &a x\nsources:\n  - name: *a\n",
+        "%YAML 1.2\n---\nname: directive\n",
+        "name: twice\nname: again\n",
+    };
+    for (const char *yaml : unsplit)
+    {
+        expect_same(decoder, sample, yaml);
+        expect_same(decoder, sample, yaml);
+        EXPECT_TRUE(decoder.stats().full) << yaml;
+    }
+
+    // As is a different message.
+    expect_same(decoder, sample, base_yaml);
+    Sample other;
+    expect_same(decoder, other, base_yaml);
+    EXPECT_TRUE(decoder.stats().full);
+    decoder.reset();
+    expect_same(decoder, other, base_yaml);
+    EXPECT_TRUE(decoder.stats().full);
+}
+
+TEST(incremental, arena)
+{
+    google::protobuf::Arena arena;
+    Sample *sample = google::protobuf::Arena::CreateMessage<Sample>(&arena);
+    yaml2pb::IncrementalDecoder decoder;
+    expect_same(decoder, *sample, base_yaml);
+    expect_same(decoder, *sample, replace(base_yaml, "name: second", "name: 2nd"));
+    EXPECT_FALSE(decoder.stats().full);
+    EXPECT_EQ(decoder.stats().decoded, 1u);
+}
+
+TEST(incremental, random_edits)
+{
+    // A line of the document deleted, repeated, moved or overwritten at
+    // random, valid or not, must always decode as it would in full.
+    std::vector<std::string> base;
+    for (const char *p = base_yaml; *p;)
+    {
+        const char *eol = strchr(p, '\n');
+        base.push_back(std::string(p, eol + 1));
+        p = eol + 1;
+    }
+
+    yaml2pb::IncrementalDecoder decoder;
+    Sample sample;
+    uint64_t state = 1;
+    size_t incremental = 0;
+    for (int i = 0; i < 500; i++)
+    {
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        std::vector<std::string> lines = base;
+        const size_t at = (state >> 33) % lines.size();
+        switch ((state >> 20) % 4)
+        {
+        case 0:
+            lines.erase(lines.begin() + at);
+            break;
+        case 1:
+            lines.insert(lines.begin() + at, lines[at]);
+            break;
+        case 2:
+            std::swap(lines[at], lines[(at + 1) % lines.size()]);
+            break;
+        default:
+            lines[at] = lines[(state >> 40) % lines.size()];
+            break;
+        }
+
+        std::string yaml;
+        for (size_t j = 0; j < lines.size(); j++)
+            yaml += lines[j];
+        expect_same(decoder, sample, yaml);
+        if (!decoder.stats().full)
+            incremental++;
+    }
+    EXPECT_GT(incremental, 100u);
+}
@@ -0,0 +1,325 @@
+#include "gtest/gtest.h"
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+#include "sample.pb.h"
+#include "yaml2pb/mask.h"
+#include "yaml2pb/yaml2pb.h"
+
+static const char *mask_yaml = "\
+name: recorder\n\
+metadata:\n\
+  info:\n\
+    owner: media\n\
+sources:\n\
+  - name: camera\n\
+    processors: [mixer]\n\
+processors:\n\
+  - name: mixer\n\
+    type: video\n\
+    modules:\n\
+      - {type: scaler, width: 640}\n\
+      - type: h264\n\
+drains:\n\
+  - name: out\n\
+    type: mp4\n\
+    processors: [mixer, muxer]\n\
+  - name: log\n\
+    processors: []\n";
+
+static google::protobuf::FieldMask field_mask(const std::vector<std::string> &paths)
+{
+    google::protobuf::FieldMask mask;
+    for (size_t i = 0; i < paths.size(); i++)
+        mask.add_paths(paths[i]);
+    return mask;
+}
+
+static const yaml2pb::Engine engines[] = {yaml2pb::ENGINE_EVENT, yaml2pb::ENGINE_TREE, yaml2pb::ENGINE_GENERATED};
+
+TEST(mask, decode)
+{
+    Sample expected;
+    expected.set_name("recorder");
+    expected.add_drains()->add_processors("mixer");
+    expected.mutable_drains(0)->add_processors("muxer");
+    expected.add_drains();
+
+    yaml2pb::CompiledMask mask;
+    ASSERT_TRUE(mask.compile(Sample::descriptor(), field_mask({"name", "drains.processors"}), 0));
+    for (yaml2pb::Engine engine : engines)
+    {
+        yaml2pb::DecodeOptions options;
+        options.engine = engine;
+        options.mask = &mask;
+        Sample sample;
+        yaml2pb::Error error;
+        ASSERT_TRUE(yaml2pb::try_yaml2pb(sample, mask_yaml, options, &error)) << error.to_string();
+        EXPECT_EQ(sample.DebugString(), expected.DebugString()) << engine;
+        // Unselected messages are not even created.
+        EXPECT_FALSE(sample.has_metadata());
+
+        // Fields outside the mask are left as they were.
+        Sample merged;
+        merged.set_name("before");
+        merged.add_sources()->set_name("kept");
+        ASSERT_TRUE(yaml2pb::try_yaml2pb(merged, mask_yaml, options, 0));
+        EXPECT_EQ(merged.name(), "recorder");
+        ASSERT_EQ(merged.sources_size(), 1);
+        EXPECT_EQ(merged.sources(0).name(), "kept");
+        EXPECT_EQ(merged.drains_size(), 2);
+    }
+
+    // Whole fields, maps and nested messages.
+    Sample full;
+    yaml2pb::yaml2pb(full, mask_yaml);
+    Sample sample;
+    yaml2pb::yaml2pb(sample, mask_yaml, field_mask({"metadata", "processors.modules.width", "processors.modules", "sources"}));
+    Sample partial = full;
+    partial.clear_name();
+    partial.clear_drains();
+    for (int i = 0; i < partial.processors_size(); i++)
+    {
+        partial.mutable_processors(i)->clear_name();
+        partial.mutable_processors(i)->clear_type();
+    }
+    EXPECT_EQ(sample.DebugString(), partial.DebugString());
+
+    // Aliases fall back to the tree engine, which applies the mask too.
+    sample.Clear();
+    yaml2pb::yaml2pb(sample, "name: &n aliased\ndrains: [{name: *n, type: wav}]\n", field_mask({"drains.name"}));
+    EXPECT_EQ(sample.ShortDebugString(), "drains { name: \"aliased\" }");
+
+    // A mask without paths selects nothing, and decoding still succeeds.
+    sample.Clear();
+    yaml2pb::yaml2pb(sample, mask_yaml, field_mask({}));
+    EXPECT_EQ(sample.ByteSizeLong(), 0u);
+}
+
+TEST(mask, skipped)
+{
+    // Skipped values are not converted, so nothing in them can fail but
+    // their syntax.
+    const std::string yaml = "name: x\nprocessors:\n  - modules: [{width: wide}]\n    nope: 1\nmetadata: [1, {2: 3}]\n";
+    for (yaml2pb::Engine engine : engines)
+    {
+        yaml2pb::CompiledMask mask;
+        ASSERT_TRUE(mask.compile(Sample::descriptor(), field_mask({"name"}), 0));
+        yaml2pb::DecodeOptions options;
+        options.engine = engine;
+        options.mask = &mask;
+        Sample sample;
+        yaml2pb::Error error;
+        ASSERT_TRUE(yaml2pb::try_yaml2pb(sample, yaml, options, &error)) << error.to_string();
+        EXPECT_EQ(sample.ShortDebugString(), "name: \"x\"");
+
+        // Selected values are checked as usual, and so are keys.
+        ASSERT_TRUE(mask.compile(Sample::descriptor(), field_mask({"processors.modules"}), 0));
+        EXPECT_FALSE(yaml2pb::try_yaml2pb(sample, yaml, options, &error));
+        EXPECT_EQ(error.kind, yaml2pb::ERROR_VALUE);
+        EXPECT_EQ(error.path, "processors[0].modules[0].width");
+        EXPECT_FALSE(yaml2pb::try_yaml2pb(sample, "nope: 1\n", options, &error));
+        EXPECT_EQ(error.kind, yaml2pb::ERROR_UNKNOWN_FIELD);
+        EXPECT_FALSE(yaml2pb::try_yaml2pb(sample, "name: [x\n", options, &error));
+        EXPECT_EQ(error.kind, yaml2pb::ERROR_SYNTAX);
+    }
+
+    // Streaming a field within the mask.
+    yaml2pb::CompiledMask mask;
+    ASSERT_TRUE(mask.compile(Sample::descriptor(), field_mask({"processors.name"}), 0));
+    yaml2pb::DecodeOptions options;
+    options.mask = &mask;
+    options.element_path = "processors";
+    std::vector<std::string> streamed;
+    options.on_element = [&streamed](google::protobuf::Message &element, size_t) {
+        streamed.push_back(element.ShortDebugString());
+    };
+    Sample sample;
+    yaml2pb::yaml2pb(sample, mask_yaml, options);
+    ASSERT_EQ(streamed.size(), 1u);
+    EXPECT_EQ(streamed[0], "name: \"mixer\"");
+}
+
+TEST(mask, compile)
+{
+    yaml2pb::CompiledMask mask;
+    EXPECT_TRUE(mask.descriptor() == 0);
+
+    const char *invalid[] = {"nope", "", "name.size", "drains..name", "metadata.info.owner", "processors.modules.type.x"};
+    for (const char *path : invalid)
+    {
+        yaml2pb::Error error;
+        EXPECT_FALSE(mask.compile(Sample::descriptor(), field_mask({"name", path}), &error)) << path;
+        EXPECT_EQ(error.kind, yaml2pb::ERROR_UNKNOWN_FIELD);
+        EXPECT_EQ(error.path, path);
+        EXPECT_TRUE(mask.descriptor() == 0);
+
+        Sample sample;
+        EXPECT_FALSE(yaml2pb::try_yaml2pb(sample, mask_yaml, field_mask({path}), &error));
+        EXPECT_EQ(error.kind, yaml2pb::ERROR_UNKNOWN_FIELD);
+        EXPECT_EQ(sample.ByteSizeLong(), 0u);
+    }
+
+    // A mask only applies to the type it was compiled for.
+    ASSERT_TRUE(mask.compile(Sample::descriptor(), field_mask({"name"}), 0));
+    EXPECT_EQ(mask.descriptor(), Sample::descriptor());
+    yaml2pb::DecodeOptions options;
+    options.mask = &mask;
+    Processor processor;
+    yaml2pb::Error error;
+    EXPECT_FALSE(yaml2pb::try_yaml2pb(processor, "name: x\n", options, &error));
+    EXPECT_EQ(error.kind, yaml2pb::ERROR_DESCRIPTOR);
+    EXPECT_THROW(yaml2pb::yaml2pb(processor, "name: x\n", options), std::exception);
+
+    // A shorter path selects the whole field, whichever comes first.
+    ASSERT_TRUE(mask.compile(Sample::descriptor(), field_mask({"drains.name", "drains", "processors", "processors.type"}), 0));
+    Sample sample;
+    yaml2pb::yaml2pb(sample, mask_yaml, options);
+    Sample expected;
+    yaml2pb::yaml2pb(expected, mask_yaml);
+    expected.clear_name();
+    expected.clear_metadata();
+    expected.clear_sources();
+    EXPECT_EQ(sample.DebugString(), expected.DebugString());
+}
+
+// Decodes `yaml` with the event engine, which cuts unselected top-level
+// keys out before parsing, and checks it against the tree engine, which
+// does not. Errors in what is cut go unnoticed, and the engines may report
+// different errors first, so only what decodes is compared.
+static void expect_pruned(const yaml2pb::CompiledMask &mask, const std::string &yaml)
+{
+    yaml2pb::DecodeOptions options;
+    options.mask = &mask;
+    options.engine = yaml2pb::ENGINE_TREE;
+    Sample expected;
+    const bool ok = yaml2pb::try_yaml2pb(expected, yaml, options, 0);
+
+    options.engine = yaml2pb::ENGINE_EVENT;
+    Sample sample;
+    yaml2pb::Error error;
+    const bool pruned = yaml2pb::try_yaml2pb(sample, yaml, options, &error);
+    if (ok)
+    {
+        EXPECT_TRUE(pruned) << yaml << error.to_string();
+        EXPECT_EQ(sample.DebugString(), expected.DebugString()) << yaml;
+    }
+}
+
+TEST(mask, pruned)
+{
+    yaml2pb::CompiledMask mask;
+    ASSERT_TRUE(mask.compile(Sample::descriptor(), field_mask({"name", "drains.processors"}), 0));
+
+    // Positions in errors are those of the input.
+    std::string yaml = std::string(mask_yaml) + "name: [x\n";
+    Sample sample;
+    yaml2pb::Error expected;
+    EXPECT_FALSE(yaml2pb::try_yaml2pb(sample, yaml, &expected));
+    yaml2pb::DecodeOptions options;
+    options.mask = &mask;
+    yaml2pb::Error error;
+    EXPECT_FALSE(yaml2pb::try_yaml2pb(sample, yaml, options, &error));
+    EXPECT_EQ(error.to_string(), expected.to_string());
+    EXPECT_EQ(error.line, 20);
+    EXPECT_FALSE(yaml2pb::try_yaml2pb(sample, std::string(mask_yaml) + "drains: [{processors: {}}]\n", options, &error));
+    EXPECT_EQ(error.line, 20);
+    EXPECT_EQ(error.path, "drains[0].processors");
+
+    // Values that go on past their line, whose next lines only look like
+    // keys, are not cut.
+    const char *unsplit[] = {
+        "sources: \"a\nname: b\"\nname: c\n",
+        "sources: [{name: a,\nname: b}]\nname: c\n",
+        "sources: &s 'a\nname: b'\nname: c\n",
+        "sources: !!seq [\nname]\nname: c\n",
+        "%YAML 1.2\n---\nsources: []\nname: c\n",
+        "name: &n c\nsources: [{name: *n}]\n",
+    };
+    for (const char *text : unsplit)
+        expect_pruned(mask, text);
+
+    // Any line deleted, repeated, moved or overwritten.
+    std::vector<std::string> base;
+    for (const char *p = mask_yaml; *p;)
+    {
+        const char *eol = strchr(p, '\n');
+        base.push_back(std::string(p, eol + 1));
+        p = eol + 1;
+    }
+    uint64_t state = 1;
+    for (int i = 0; i < 300; i++)
+    {
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        std::vector<std::string> lines = base;
+        const size_t at = (state >> 33) % lines.size();
+        switch ((state >> 20) % 4)
+        {
+        case 0:
+            lines.erase(lines.begin() + at);
+            break;
+        case 1:
+            lines.insert(lines.begin() + at, lines[at]);
+            break;
+        case 2:
+            std::swap(lines[at], lines[(at + 1) % lines.size()]);
+            break;
+        default:
+            lines[at] = lines[(state >> 40) % lines.size()];
+            break;
+        }
+        std::string text;
+        for (size_t j = 0; j < lines.size(); j++)
+            text += lines[j];
+        expect_pruned(mask, text);
+    }
+}
+
+// What pb2yaml(message, sink) writes.
+static std::string streamed(const google::protobuf::Message &message, const yaml2pb::EncodeOptions &options)
+{
+    std::string yaml;
+    yaml2pb::BufferSink sink(yaml);
+    yaml2pb::pb2yaml(message, sink, options);
+    return yaml;
+}
+
+TEST(mask, encode)
+{
+    Sample full;
+    yaml2pb::yaml2pb(full, mask_yaml);
+
+    // Paths in any order come out in field order, like the whole message.
+    const google::protobuf::FieldMask paths = field_mask({"processors.modules.width", "name", "drains.processors", "metadata"});
+    Sample partial;
+    yaml2pb::yaml2pb(partial, mask_yaml, paths);
+    EXPECT_EQ(yaml2pb::pb2yaml(full, paths), yaml2pb::pb2yaml(partial));
+
+    yaml2pb::CompiledMask mask;
+    ASSERT_TRUE(mask.compile(Sample::descriptor(), paths, 0));
+    yaml2pb::EncodeOptions options;
+    options.mask = &mask;
+    EXPECT_EQ(yaml2pb::pb2yaml(full, options), yaml2pb::pb2yaml(partial));
+    EXPECT_EQ(streamed(full, options), streamed(partial, yaml2pb::EncodeOptions()));
+    std::string yaml;
+    yaml2pb::BufferSink sink(yaml);
+    yaml2pb::pb2yaml(full, paths, sink);
+    EXPECT_EQ(yaml, streamed(partial, yaml2pb::EncodeOptions()));
+
+    // Generated codecs write every field, so a mask bypasses them.
+    options.generated = true;
+    EXPECT_EQ(yaml2pb::pb2yaml(full, options), yaml2pb::pb2yaml(partial));
+
+    // Selected but unset fields are left out.
+    Sample sparse;
+    sparse.add_drains()->set_name("only");
+    EXPECT_EQ(yaml2pb::pb2yaml(sparse, options), "drains:\n  - {}\n");
+    EXPECT_EQ(streamed(sparse, options), "drains:\n  - {}\n");
+
+    // Masks for another type, and invalid ones, throw.
+    Processor processor;
+    EXPECT_THROW(yaml2pb::pb2yaml(processor, options), std::exception);
+    EXPECT_THROW(streamed(processor, options), std::exception);
+    EXPECT_THROW(yaml2pb::pb2yaml(full, field_mask({"nope"})), std::exception);
+}
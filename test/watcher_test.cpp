@@ -0,0 +1,142 @@
+#include "gtest/gtest.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "sample.pb.h"
+#include "yaml2pb/watcher.h"
+
+// Writes `text` next to `path` and renames it into place, as deployment
+// tools do.
+static void replace(const std::string &path, const std::string &text)
+{
+    const std::string temporary = path + ".tmp";
+    std::ofstream(temporary) << text;
+    ASSERT_EQ(rename(temporary.c_str(), path.c_str()), 0);
+}
+
+// Waits for the watcher to get through `count` reloads and failures.
+static bool settle(const yaml2pb::WatcherBase &watcher, uint64_t count)
+{
+    for (int i = 0; i < 500; i++)
+    {
+        const yaml2pb::ReloadStats stats = watcher.stats();
+        if (stats.reloads + stats.failures >= count)
+            return true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return false;
+}
+
+TEST(watcher, snapshot_cell)
+{
+    yaml2pb::SnapshotCell cell;
+    EXPECT_FALSE(cell.load());
+    cell.store(std::make_shared<const int>(0));
+
+    // Readers must only ever see whole values, in the order stored.
+    std::atomic<bool> done(false);
+    std::atomic<size_t> errors(0);
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 4; i++)
+    {
+        readers.emplace_back([&cell, &done, &errors]() {
+            int last = 0;
+            while (!done)
+            {
+                std::shared_ptr<const int> value = std::static_pointer_cast<const int>(cell.load());
+                if (!value || *value < last)
+                    errors++;
+                else
+                    last = *value;
+            }
+        });
+    }
+    for (int i = 1; i <= 10000; i++)
+        cell.store(std::make_shared<const int>(i));
+    done = true;
+    for (size_t i = 0; i < readers.size(); i++)
+        readers[i].join();
+
+    EXPECT_EQ(errors.load(), 0u);
+    EXPECT_EQ(*std::static_pointer_cast<const int>(cell.load()), 10000);
+}
+
+TEST(watcher, reload)
+{
+    char dir[] = "/tmp/yaml2pb_watcher_XXXXXX";
+    ASSERT_TRUE(mkdtemp(dir));
+    const std::string path = std::string(dir) + "/config.yaml";
+
+    // Nothing to load yet.
+    yaml2pb::Error error;
+    {
+        yaml2pb::ConfigWatcher<Sample> missing(path);
+        EXPECT_FALSE(missing.start(&error));
+        EXPECT_EQ(error.kind, yaml2pb::ERROR_IO);
+        EXPECT_FALSE(missing.snapshot());
+    }
+
+    replace(path, "name: first\n");
+    yaml2pb::ConfigWatcher<Sample> watcher(path, yaml2pb::DecodeOptions(), [](const Sample &sample, std::string &reason) {
+        if (sample.name().empty())
+        {
+            reason = "name is required";
+            return false;
+        }
+        return true;
+    });
+    ASSERT_TRUE(watcher.start(&error)) << error.to_string();
+    std::shared_ptr<const Sample> first = watcher.snapshot();
+    ASSERT_TRUE(first);
+    EXPECT_EQ(first->name(), "first");
+
+    replace(path, "name: second\n");
+    ASSERT_TRUE(settle(watcher, 2));
+    EXPECT_EQ(watcher.snapshot()->name(), "second");
+    // An old snapshot outlives the reload.
+    EXPECT_EQ(first->name(), "first");
+
+    // Written in place rather than renamed.
+    std::ofstream(path) << "name: third\n";
+    ASSERT_TRUE(settle(watcher, 3));
+    EXPECT_EQ(watcher.snapshot()->name(), "third");
+
+    // Invalid files keep the previous snapshot.
+    replace(path, "nam: fourth\n");
+    ASSERT_TRUE(settle(watcher, 4));
+    replace(path, "processors: []\n");
+    ASSERT_TRUE(settle(watcher, 5));
+    EXPECT_EQ(watcher.snapshot()->name(), "third");
+
+    yaml2pb::ReloadStats stats = watcher.stats();
+    EXPECT_EQ(stats.reloads, 3u);
+    EXPECT_EQ(stats.failures, 2u);
+    EXPECT_EQ(stats.last_error.kind, yaml2pb::ERROR_INVALID);
+    EXPECT_EQ(stats.last_error.message, "name is required");
+    EXPECT_GT(stats.last_latency.count(), 0);
+    EXPECT_GE(stats.max_latency, stats.last_latency);
+    EXPECT_GE(stats.total_latency, stats.max_latency);
+
+    // Other files in the directory do not trigger reloads.
+    std::ofstream(std::string(dir) + "/other.yaml") << "name: other\n";
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    EXPECT_EQ(watcher.stats().reloads + watcher.stats().failures, 5u);
+
+    // Reloading by hand reports the error.
+    EXPECT_FALSE(watcher.reload(&error));
+    EXPECT_EQ(error.kind, yaml2pb::ERROR_INVALID);
+
+    unlink((std::string(dir) + "/other.yaml").c_str());
+    unlink(path.c_str());
+    EXPECT_FALSE(watcher.reload(&error));
+    EXPECT_EQ(error.kind, yaml2pb::ERROR_IO);
+    EXPECT_EQ(watcher.snapshot()->name(), "third");
+    rmdir(dir);
+}
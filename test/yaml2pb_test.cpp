@@ -1,7 +1,18 @@
 #include "gtest/gtest.h"
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include <sstream>
+#include <thread>
 #include <utility>
+#include <vector>
+#include "google/protobuf/descriptor.pb.h"
+#include "google/protobuf/dynamic_message.h"
 #include "google/protobuf/map.h"
+#include "google/protobuf/text_format.h"
 #include "sample.pb.h"
+#include "sample.yaml2pb.h"
+#include "yaml2pb/executor.h"
 #include "yaml2pb/yaml2pb.h"
 
 const char *test_yaml = "\
@@ -70,6 +81,614 @@ TEST(yaml2pb, sample)
     EXPECT_EQ(sample.drains_size(), 3);
 }
 
+TEST(yaml2pb, engines)
+{
+    yaml2pb::DecodeOptions tree;
+    tree.engine = yaml2pb::ENGINE_TREE;
+
+    Sample by_event, by_tree;
+    yaml2pb::yaml2pb(by_event, test_yaml);
+    yaml2pb::yaml2pb(by_tree, test_yaml, tree);
+    EXPECT_EQ(by_event.SerializeAsString(), by_tree.SerializeAsString());
+    EXPECT_EQ(by_event.processors(0).modules(1).type(), Module_ModuleType_h264);
+    EXPECT_EQ(by_event.processors(0).modules(1).bitrate(), 1000000);
+    EXPECT_THROW(yaml2pb::yaml2pb(by_event, "- name: x\n"), std::exception);
+    EXPECT_THROW(yaml2pb::yaml2pb(by_event, "nam: x\n"), std::exception);
+}
+
+TEST(yaml2pb, enums)
+{
+    const char *engines[] = {"event", "tree", "generated"};
+    for (int engine = yaml2pb::ENGINE_EVENT; engine <= yaml2pb::ENGINE_GENERATED; engine++)
+    {
+        SCOPED_TRACE(engines[engine]);
+        yaml2pb::DecodeOptions options;
+        options.engine = yaml2pb::Engine(engine);
+
+        Module module;
+        yaml2pb::yaml2pb(module, "type: h264_svc\n", options);
+        EXPECT_EQ(module.type(), Module_ModuleType_h264_svc);
+        yaml2pb::yaml2pb(module, "type: 24\n", options);
+        EXPECT_EQ(module.type(), Module_ModuleType_mp3);
+        yaml2pb::yaml2pb(module, "type: 0x14\n", options);
+        EXPECT_EQ(module.type(), Module_ModuleType_pcma);
+        yaml2pb::yaml2pb(module, "type: +2\n", options);
+        EXPECT_EQ(module.type(), Module_ModuleType_resampler);
+
+        EXPECT_THROW(yaml2pb::yaml2pb(module, "type: h266\n", options), std::exception);
+        EXPECT_THROW(yaml2pb::yaml2pb(module, "type: 14\n", options), std::exception);
+        EXPECT_THROW(yaml2pb::yaml2pb(module, "type: -1\n", options), std::exception);
+        EXPECT_THROW(yaml2pb::yaml2pb(module, "type: ''\n", options), std::exception);
+    }
+}
+
+TEST(yaml2pb, errors)
+{
+    const char *bad_enum = "\
+processors:\n\
+  - name: video\n\
+    modules:\n\
+      - type: scaler\n\
+      - type: h266\n\
+";
+    const char *engines[] = {"event", "tree", "generated"};
+    for (int engine = yaml2pb::ENGINE_EVENT; engine <= yaml2pb::ENGINE_GENERATED; engine++)
+    {
+        SCOPED_TRACE(engines[engine]);
+        yaml2pb::DecodeOptions options;
+        options.engine = yaml2pb::Engine(engine);
+
+        Sample sample;
+        yaml2pb::Error error;
+        EXPECT_FALSE(yaml2pb::try_yaml2pb(sample, bad_enum, options, &error));
+        EXPECT_EQ(error.kind, yaml2pb::ERROR_VALUE);
+        EXPECT_EQ(error.path, "processors[0].modules[1].type");
+        EXPECT_EQ(error.line, 5);
+        EXPECT_EQ(error.column, 15);
+
+        EXPECT_FALSE(yaml2pb::try_yaml2pb(sample, "metadata:\n  info:\n    k: v\n  bogus: 1\n", options, &error));
+        EXPECT_EQ(error.kind, yaml2pb::ERROR_UNKNOWN_FIELD);
+        EXPECT_EQ(error.path, "metadata.bogus");
+        EXPECT_EQ(error.line, 4);
+        EXPECT_EQ(error.column, 3);
+
+        EXPECT_FALSE(yaml2pb::try_yaml2pb(sample, "sources: default\n", options, &error));
+        EXPECT_EQ(error.kind, yaml2pb::ERROR_TYPE);
+        EXPECT_EQ(error.path, "sources");
+
+        EXPECT_FALSE(yaml2pb::try_yaml2pb(sample, "metadata:\n  info: {a: [1]}\n", options, &error));
+        EXPECT_EQ(error.kind, yaml2pb::ERROR_TYPE);
+        EXPECT_EQ(error.path, "metadata.info[a]");
+        EXPECT_EQ(error.line, 2);
+        EXPECT_EQ(error.column, 13);
+
+        EXPECT_FALSE(yaml2pb::try_yaml2pb(sample, "sources:\n  - processors: [a, b, {c: d}]\n", options, &error));
+        EXPECT_EQ(error.kind, yaml2pb::ERROR_TYPE);
+        EXPECT_EQ(error.path, "sources[0].processors[2]");
+        EXPECT_EQ(error.line, 2);
+
+        EXPECT_FALSE(yaml2pb::try_yaml2pb(sample, "name: b: c\n", options, &error));
+        EXPECT_EQ(error.kind, yaml2pb::ERROR_SYNTAX);
+        EXPECT_EQ(error.line, 1);
+
+        EXPECT_FALSE(yaml2pb::try_yaml2pb(sample, "- name: x\n", options, &error));
+        EXPECT_EQ(error.kind, yaml2pb::ERROR_TYPE);
+
+        EXPECT_FALSE(yaml2pb::try_yaml2pb(sample, bad_enum, options, 0));
+        EXPECT_TRUE(yaml2pb::try_yaml2pb(sample, test_yaml, options, &error));
+        EXPECT_EQ(error.kind, yaml2pb::ERROR_NONE);
+    }
+
+    Sample sample;
+    try
+    {
+        yaml2pb::yaml2pb(sample, bad_enum);
+        ADD_FAILURE();
+    }
+    catch (const std::exception &e)
+    {
+        EXPECT_STREQ(e.what(), "processors[0].modules[1].type: Enum value not found:h266 (line 5, column 15)");
+    }
+}
+
+TEST(yaml2pb, arena)
+{
+    Sample expected;
+    yaml2pb::yaml2pb(expected, test_yaml);
+
+    for (int engine = yaml2pb::ENGINE_EVENT; engine <= yaml2pb::ENGINE_TREE; engine++)
+    {
+        google::protobuf::Arena arena, scratch;
+        yaml2pb::DecodeOptions options;
+        options.engine = yaml2pb::Engine(engine);
+        options.arena = &scratch;
+
+        Sample *sample = google::protobuf::Arena::CreateMessage<Sample>(&arena);
+        yaml2pb::yaml2pb(*sample, test_yaml, options);
+        EXPECT_EQ(sample->SerializeAsString(), expected.SerializeAsString());
+        EXPECT_EQ(sample->processors(0).modules(0).GetArena(), &arena);
+        EXPECT_EQ(sample->metadata().GetArena(), &arena);
+        EXPECT_EQ(scratch.SpaceUsed(), 0u);
+
+        // Decoding on top of a non-empty message keeps a copy of it for the
+        // alias fallback, which the event engine makes on the scratch arena.
+        yaml2pb::yaml2pb(*sample, "name: reloaded\n", options);
+        EXPECT_TRUE(sample->name() == "reloaded");
+        EXPECT_EQ(sample->processors_size(), expected.processors_size());
+        if (engine == yaml2pb::ENGINE_EVENT)
+        {
+            EXPECT_GT(scratch.SpaceUsed(), 0u);
+        }
+    }
+}
+
+TEST(yaml2pb, maps)
+{
+    std::string large = "metadata:\n  info:\n";
+    for (int i = 0; i < 10000; i++)
+        large += "    key_" + std::to_string(i) + ": value_" + std::to_string(i) + "\n";
+
+    const char *engines[] = {"event", "tree", "generated"};
+    for (int engine = yaml2pb::ENGINE_EVENT; engine <= yaml2pb::ENGINE_GENERATED; engine++)
+    {
+        SCOPED_TRACE(engines[engine]);
+        yaml2pb::DecodeOptions options;
+        options.engine = yaml2pb::Engine(engine);
+
+        Sample sample;
+        (*sample.mutable_metadata()->mutable_info())["kept"] = "old";
+        (*sample.mutable_metadata()->mutable_info())["replaced"] = "old";
+        yaml2pb::yaml2pb(sample, "metadata:\n  info:\n    replaced: new\n    added: new\n", options);
+        const google::protobuf::Map<std::string, std::string> &info = sample.metadata().info();
+        EXPECT_EQ(info.size(), 3u);
+        EXPECT_TRUE(info.at("kept") == "old");
+        EXPECT_TRUE(info.at("replaced") == "new");
+        EXPECT_TRUE(info.at("added") == "new");
+
+        Sample duplicated;
+        yaml2pb::Error error;
+        EXPECT_FALSE(yaml2pb::try_yaml2pb(duplicated, "metadata:\n  info:\n    a: 1\n    b: 2\n    a: 3\n", options, &error));
+        EXPECT_EQ(error.kind, yaml2pb::ERROR_DUPLICATE_KEY);
+        EXPECT_EQ(error.path, "metadata.info[a]");
+        EXPECT_EQ(error.line, 5);
+
+        Sample labels;
+        yaml2pb::yaml2pb(labels, large, options);
+        EXPECT_EQ(labels.metadata().info().size(), 10000u);
+        EXPECT_TRUE(labels.metadata().info().at("key_9999") == "value_9999");
+    }
+}
+
+TEST(yaml2pb, reserve)
+{
+    std::string yaml = "sources:\n  - processors:\n";
+    for (int i = 0; i < 100; i++)
+        yaml += "      - p" + std::to_string(i) + "\n";
+
+    // The tree engines know sequence lengths up front and size the field once.
+    const char *engines[] = {"event", "tree", "generated"};
+    for (int engine = yaml2pb::ENGINE_TREE; engine <= yaml2pb::ENGINE_GENERATED; engine++)
+    {
+        SCOPED_TRACE(engines[engine]);
+        yaml2pb::DecodeOptions options;
+        options.engine = yaml2pb::Engine(engine);
+        Sample sample;
+        yaml2pb::yaml2pb(sample, yaml, options);
+        ASSERT_EQ(sample.sources(0).processors_size(), 100);
+        EXPECT_EQ(sample.sources(0).processors().Capacity(), 100);
+        EXPECT_EQ(sample.sources(0).processors(99), "p99");
+    }
+}
+
+TEST(yaml2pb, alias_fallback)
+{
+    const char *yaml = "\
+name: merged\n\
+sources:\n\
+  - &src\n\
+    name: default_source\n\
+  - *src\n\
+";
+    Sample sample;
+    sample.set_name("previous");
+    sample.add_drains()->set_name("kept");
+    yaml2pb::yaml2pb(sample, yaml);
+    EXPECT_TRUE(sample.name() == "merged");
+    EXPECT_EQ(sample.drains_size(), 1);
+    EXPECT_EQ(sample.sources_size(), 2);
+    EXPECT_TRUE(sample.sources(1).name() == "default_source");
+}
+
+TEST(yaml2pb, decode_on_top)
+{
+    // Zero and empty values overwrite what the message held, as they would
+    // assigned one by one, with or without the alias fallback.
+    const char *engines[] = {"event", "tree", "generated"};
+    for (int engine = yaml2pb::ENGINE_EVENT; engine <= yaml2pb::ENGINE_GENERATED; engine++)
+    {
+        SCOPED_TRACE(engines[engine]);
+        yaml2pb::DecodeOptions options;
+        options.engine = yaml2pb::Engine(engine);
+
+        Module module;
+        module.set_type(Module_ModuleType_h264);
+        module.set_width(640);
+        module.set_height(480);
+        yaml2pb::yaml2pb(module, "type: unknown\nwidth: 0\n", options);
+        EXPECT_EQ(module.ShortDebugString(), "height: 480");
+        yaml2pb::yaml2pb(module, "width: &zero 0\nheight: *zero\nbitrate: 100\n", options);
+        EXPECT_EQ(module.ShortDebugString(), "bitrate: 100");
+
+        Sample sample;
+        sample.set_name("before");
+        sample.add_drains()->set_name("kept");
+        yaml2pb::yaml2pb(sample, "name: ''\n", options);
+        EXPECT_TRUE(sample.name().empty());
+        EXPECT_EQ(sample.drains_size(), 1);
+    }
+}
+
+TEST(yaml2pb, pools)
+{
+    // Successive pools with different types of the same name, as when a
+    // schema is reloaded; the second may well reuse the first's addresses.
+    const char *fields[] = {"name", "title"};
+    for (int i = 0; i < 2; i++)
+    {
+        google::protobuf::FileDescriptorProto file;
+        file.set_name("pools.proto");
+        file.set_syntax("proto3");
+        google::protobuf::DescriptorProto *type = file.add_message_type();
+        type->set_name("Config");
+        google::protobuf::FieldDescriptorProto *field = type->add_field();
+        field->set_name(fields[i]);
+        field->set_number(1);
+        field->set_label(google::protobuf::FieldDescriptorProto::LABEL_OPTIONAL);
+        field->set_type(google::protobuf::FieldDescriptorProto::TYPE_STRING);
+
+        google::protobuf::DescriptorPool pool;
+        ASSERT_TRUE(pool.BuildFile(file));
+        {
+            google::protobuf::DynamicMessageFactory factory(&pool);
+            std::unique_ptr<google::protobuf::Message> message(factory.GetPrototype(pool.FindMessageTypeByName("Config"))->New());
+            const std::string yaml = std::string(fields[i]) + ": x\n";
+            for (int engine = yaml2pb::ENGINE_EVENT; engine <= yaml2pb::ENGINE_TREE; engine++)
+            {
+                yaml2pb::DecodeOptions options;
+                options.engine = yaml2pb::Engine(engine);
+                message->Clear();
+                yaml2pb::Error error;
+                EXPECT_TRUE(yaml2pb::try_yaml2pb(*message, yaml, options, &error)) << error.to_string();
+                EXPECT_EQ(yaml2pb::pb2yaml(*message), yaml);
+            }
+        }
+        yaml2pb::release_pool(&pool);
+    }
+}
+
+TEST(yaml2pb, threads)
+{
+    Sample expected;
+    yaml2pb::yaml2pb(expected, test_yaml);
+
+    // Every thread compiles or picks up the shared decode plans concurrently.
+    std::vector<std::string> results(8);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < results.size(); i++)
+        threads.push_back(std::thread([&results, i]() {
+            for (int n = 0; n < 50; n++)
+            {
+                Sample sample;
+                yaml2pb::yaml2pb(sample, test_yaml);
+                results[i] = sample.SerializeAsString();
+            }
+        }));
+    for (size_t i = 0; i < threads.size(); i++)
+        threads[i].join();
+    for (size_t i = 0; i < results.size(); i++)
+        EXPECT_EQ(results[i], expected.SerializeAsString());
+}
+
+TEST(yaml2pb, batch)
+{
+    Sample expected;
+    yaml2pb::yaml2pb(expected, test_yaml);
+
+    std::vector<std::string> documents;
+    std::vector<Sample> samples(200);
+    std::vector<google::protobuf::Message *> messages;
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        // Every tenth document has an unknown enum value.
+        documents.push_back((i % 10 == 3) ? "name: x\nprocessors:\n  - type: hologram\n" : test_yaml);
+        messages.push_back(&samples[i]);
+    }
+
+    yaml2pb::Executor executor(4);
+    std::vector<yaml2pb::Error> errors;
+    EXPECT_EQ(yaml2pb::decode_batch(documents, messages, executor, &errors), 20u);
+    ASSERT_EQ(errors.size(), samples.size());
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        if (i % 10 == 3)
+        {
+            EXPECT_EQ(errors[i].kind, yaml2pb::ERROR_VALUE);
+            EXPECT_EQ(errors[i].path, "processors[0].type");
+            EXPECT_EQ(errors[i].line, 3);
+        }
+        else
+        {
+            EXPECT_EQ(errors[i].kind, yaml2pb::ERROR_NONE);
+            EXPECT_EQ(samples[i].SerializeAsString(), expected.SerializeAsString());
+        }
+    }
+
+    messages.pop_back();
+    EXPECT_THROW(yaml2pb::decode_batch(documents, messages, executor, NULL), std::exception);
+}
+
+TEST(yaml2pb, load_file)
+{
+    Sample expected;
+    yaml2pb::yaml2pb(expected, test_yaml);
+
+    const std::string yaml = test_yaml;
+    char path[] = "/tmp/yaml2pb_test_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(write(fd, yaml.data(), yaml.size()), ssize_t(yaml.size()));
+    close(fd);
+
+    const yaml2pb::Engine engines[] = {yaml2pb::ENGINE_EVENT, yaml2pb::ENGINE_TREE, yaml2pb::ENGINE_GENERATED};
+    for (yaml2pb::Engine engine : engines)
+    {
+        yaml2pb::DecodeOptions options;
+        options.engine = engine;
+        Sample sample;
+        yaml2pb::load_file(sample, path, options);
+        EXPECT_EQ(sample.SerializeAsString(), expected.SerializeAsString());
+    }
+
+    // An empty file reads like an empty document.
+    truncate(path, 0);
+    Sample sample;
+    yaml2pb::Error error;
+    EXPECT_FALSE(yaml2pb::try_load_file(sample, path, &error));
+    EXPECT_EQ(error.kind, yaml2pb::ERROR_TYPE);
+    unlink(path);
+
+    EXPECT_FALSE(yaml2pb::try_load_file(sample, path, &error));
+    EXPECT_EQ(error.kind, yaml2pb::ERROR_IO);
+    EXPECT_NE(error.message.find(path), std::string::npos);
+    EXPECT_THROW(yaml2pb::load_file(sample, path), std::exception);
+
+    // Pipes cannot be mapped and are read instead.
+    int fds[2];
+    ASSERT_EQ(pipe(fds), 0);
+    std::thread writer([&fds, &yaml]() {
+        EXPECT_EQ(write(fds[1], yaml.data(), yaml.size()), ssize_t(yaml.size()));
+        close(fds[1]);
+    });
+    sample.Clear();
+    yaml2pb::load_file(sample, ("/dev/fd/" + std::to_string(fds[0])).c_str());
+    writer.join();
+    close(fds[0]);
+    EXPECT_EQ(sample.SerializeAsString(), expected.SerializeAsString());
+}
+
+TEST(yaml2pb, buffer)
+{
+    Sample expected;
+    yaml2pb::yaml2pb(expected, test_yaml);
+
+    // The document in the middle of a larger buffer, with no NUL after it.
+    const std::string yaml = test_yaml;
+    const std::string buffer = "name: before\n" + yaml + "name: after\n";
+    const char *data = buffer.data() + strlen("name: before\n");
+
+    const yaml2pb::Engine engines[] = {yaml2pb::ENGINE_EVENT, yaml2pb::ENGINE_TREE, yaml2pb::ENGINE_GENERATED};
+    for (yaml2pb::Engine engine : engines)
+    {
+        yaml2pb::DecodeOptions options;
+        options.engine = engine;
+        Sample sample;
+        yaml2pb::yaml2pb(sample, data, yaml.size(), options);
+        EXPECT_EQ(sample.SerializeAsString(), expected.SerializeAsString());
+    }
+
+    Sample sample;
+    yaml2pb::Error error;
+    EXPECT_FALSE(yaml2pb::try_yaml2pb(sample, "name: x\nnam: y\n", 15, &error));
+    EXPECT_EQ(error.kind, yaml2pb::ERROR_UNKNOWN_FIELD);
+    EXPECT_EQ(error.line, 2);
+    EXPECT_THROW(yaml2pb::yaml2pb(sample, "name: x\nnam: y\n", 15), std::exception);
+    // Cut short, the same bytes are a valid document.
+    EXPECT_TRUE(yaml2pb::try_yaml2pb(sample, "name: x\nnam: y\n", 8, &error));
+    EXPECT_EQ(sample.name(), "x");
+
+#if __cplusplus >= 201703L
+    sample.Clear();
+    yaml2pb::yaml2pb(sample, std::string_view(data, yaml.size()));
+    EXPECT_EQ(sample.SerializeAsString(), expected.SerializeAsString());
+    EXPECT_FALSE(yaml2pb::try_yaml2pb(sample, std::string_view("nam: y\n"), &error));
+#endif
+}
+
+TEST(yaml2pb, stream)
+{
+    std::istringstream in("name: first\n"
+                          "---\n"
+                          "name: second\n"
+                          "processors:\n"
+                          "  - type: hologram\n"
+                          "---\n"
+                          "---\n"
+                          "name: third\n"
+                          "metadata:\n"
+                          "  info:\n"
+                          "    a: &x 1\n"
+                          "    b: *x\n"
+                          "---\n"
+                          "name: fourth\n"
+                          "---\n");
+
+    std::vector<std::pair<std::string, yaml2pb::Error>> documents;
+    yaml2pb::DocumentCallback collect = [&documents](google::protobuf::Message &message, const yaml2pb::Error &error) {
+        documents.push_back(std::make_pair(static_cast<Sample &>(message).name(), error));
+        return true;
+    };
+    EXPECT_EQ(yaml2pb::decode_stream(in, Sample::descriptor(), collect), 4u);
+    ASSERT_EQ(documents.size(), 4u);
+    EXPECT_EQ(documents[0].first, "first");
+    EXPECT_EQ(documents[0].second.kind, yaml2pb::ERROR_NONE);
+    // Lines count from the start of the stream.
+    EXPECT_EQ(documents[1].second.kind, yaml2pb::ERROR_VALUE);
+    EXPECT_EQ(documents[1].second.path, "processors[0].type");
+    EXPECT_EQ(documents[1].second.line, 5);
+    // Aliases fall back to the tree engine as usual.
+    EXPECT_EQ(documents[2].first, "third");
+    EXPECT_EQ(documents[2].second.kind, yaml2pb::ERROR_NONE);
+    EXPECT_EQ(documents[3].first, "fourth");
+    EXPECT_EQ(documents[3].second.kind, yaml2pb::ERROR_NONE);
+
+    // Stopping early.
+    in.clear();
+    in.seekg(0);
+    EXPECT_EQ(yaml2pb::decode_stream(in, Sample::descriptor(), [](google::protobuf::Message &, const yaml2pb::Error &) { return false; }), 1u);
+
+    // Markers with comments, directives and an explicit end; a syntax error
+    // only spoils its own document.
+    documents.clear();
+    std::istringstream markers("# log\n"
+                               "--- # one\n"
+                               "name: a\n"
+                               "...\n"
+                               "%YAML 1.2\n"
+                               "---\n"
+                               "name: b: c\n"
+                               "--- {name: d}\n"
+                               "...\n");
+    EXPECT_EQ(yaml2pb::decode_stream(markers, Sample::descriptor(), collect), 3u);
+    ASSERT_EQ(documents.size(), 3u);
+    EXPECT_EQ(documents[0].first, "a");
+    EXPECT_EQ(documents[1].second.kind, yaml2pb::ERROR_SYNTAX);
+    EXPECT_EQ(documents[1].second.line, 7);
+    EXPECT_EQ(documents[2].first, "d");
+
+    // Messages of a dynamic pool are built with a DynamicMessageFactory.
+    google::protobuf::DescriptorPool pool;
+    google::protobuf::FileDescriptorProto file;
+    Sample::descriptor()->file()->CopyTo(&file);
+    ASSERT_TRUE(pool.BuildFile(file));
+    std::istringstream dynamic("name: a\n---\nname: b\n");
+    size_t count = 0;
+    EXPECT_EQ(yaml2pb::decode_stream(dynamic, pool.FindMessageTypeByName("Sample"), [&count](google::protobuf::Message &message, const yaml2pb::Error &error) {
+        EXPECT_EQ(error.kind, yaml2pb::ERROR_NONE);
+        EXPECT_EQ(message.ShortDebugString(), std::string("name: \"") + char('a' + count++) + "\"");
+        return true;
+    }),
+              2u);
+    yaml2pb::release_pool(&pool);
+}
+
+TEST(yaml2pb, elements)
+{
+    Sample expected;
+    yaml2pb::yaml2pb(expected, test_yaml);
+
+    const char *engines[] = {"event", "tree", "generated"};
+    for (int engine = yaml2pb::ENGINE_EVENT; engine <= yaml2pb::ENGINE_GENERATED; engine++)
+    {
+        SCOPED_TRACE(engines[engine]);
+        yaml2pb::DecodeOptions options;
+        options.engine = yaml2pb::Engine(engine);
+        options.element_path = "processors";
+        std::vector<std::string> elements;
+        std::vector<google::protobuf::Message *> addresses;
+        options.on_element = [&elements, &addresses](google::protobuf::Message &element, size_t index) {
+            EXPECT_EQ(index, elements.size());
+            elements.push_back(element.SerializeAsString());
+            addresses.push_back(&element);
+        };
+
+        Sample sample;
+        sample.add_processors()->set_name("kept");
+        yaml2pb::yaml2pb(sample, test_yaml, options);
+        ASSERT_EQ(elements.size(), 3u);
+        for (int i = 0; i < 3; i++)
+            EXPECT_EQ(elements[i], expected.processors(i).SerializeAsString());
+        // The field keeps what it held; everything else decodes as usual.
+        ASSERT_EQ(sample.processors_size(), 1);
+        EXPECT_EQ(sample.processors(0).name(), "kept");
+        EXPECT_EQ(sample.drains_size(), 3);
+        // The event engine reuses a single element message.
+        if (engine == yaml2pb::ENGINE_EVENT)
+        {
+            EXPECT_TRUE(addresses[0] == addresses[1] && addresses[1] == addresses[2]);
+        }
+
+        // Null and empty elements, and an alias forcing a fallback after the
+        // first element went out.
+        elements.clear();
+        Sample aliased;
+        yaml2pb::yaml2pb(aliased, "processors:\n  - name: a\n  -\n  - &p {name: b}\n  - *p\n", options);
+        ASSERT_EQ(elements.size(), 4u);
+        Processor processor;
+        EXPECT_TRUE(processor.ParseFromString(elements[0]) && processor.name() == "a");
+        EXPECT_EQ(elements[1], "");
+        EXPECT_EQ(elements[2], elements[3]);
+        EXPECT_EQ(aliased.processors_size(), 0);
+
+        // Callback exceptions reach the caller.
+        options.on_element = [](google::protobuf::Message &, size_t) { throw std::runtime_error("stop"); };
+        EXPECT_THROW(yaml2pb::yaml2pb(sample, test_yaml, options), std::runtime_error);
+    }
+
+    yaml2pb::DecodeOptions options;
+    const char *invalid[] = {"name", "metadata", "metadata.info", "processors.modules", "drain", "metadata."};
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(*invalid); i++)
+    {
+        Sample sample;
+        yaml2pb::Error error;
+        options.element_path = invalid[i];
+        EXPECT_FALSE(yaml2pb::try_yaml2pb(sample, test_yaml, options, &error));
+        EXPECT_EQ(error.kind, yaml2pb::ERROR_UNKNOWN_FIELD);
+        EXPECT_EQ(error.path, invalid[i]);
+    }
+}
+
+TEST(yaml2pb, generated)
+{
+    yaml2pb::DecodeOptions generated;
+    generated.engine = yaml2pb::ENGINE_GENERATED;
+
+    Sample by_codec, by_reflection, direct;
+    yaml2pb::yaml2pb(by_codec, test_yaml, generated);
+    yaml2pb::yaml2pb(by_reflection, test_yaml);
+    FromYaml(direct, YAML::Load(test_yaml));
+    EXPECT_EQ(by_codec.SerializeAsString(), by_reflection.SerializeAsString());
+    EXPECT_EQ(direct.SerializeAsString(), by_reflection.SerializeAsString());
+
+    yaml2pb::EncodeOptions encode;
+    encode.generated = true;
+    EXPECT_EQ(yaml2pb::pb2yaml(by_codec, encode), test_yaml);
+
+    // Large maps take linear time, as through reflection.
+    Sample labels;
+    for (int i = 0; i < 10000; i++)
+        (*labels.mutable_metadata()->mutable_info())["key_" + std::to_string(i)] = "value_" + std::to_string(i);
+    EXPECT_EQ(yaml2pb::pb2yaml(labels, encode), yaml2pb::pb2yaml(labels));
+
+    Sample invalid;
+    EXPECT_THROW(yaml2pb::yaml2pb(invalid, "drains:\n  - type: flac\n", generated), std::exception);
+
+    // Same descriptor, but not the generated class: reflection takes over.
+    google::protobuf::DynamicMessageFactory factory;
+    std::unique_ptr<google::protobuf::Message> dynamic(factory.GetPrototype(Sample::descriptor())->New());
+    yaml2pb::yaml2pb(*dynamic, test_yaml, generated);
+    EXPECT_EQ(dynamic->SerializeAsString(), by_reflection.SerializeAsString());
+}
+
 TEST(pb2yaml, sample)
 {
     Sample sample;
@@ -134,4 +753,98 @@ TEST(pb2yaml, sample)
     std::string out = yaml2pb::pb2yaml(sample);
     EXPECT_TRUE(out == test_yaml);
     std::cout << out;
-}
\ No newline at end of file
+}
+
+TEST(pb2yaml, sink)
+{
+    Sample sample;
+    yaml2pb::yaml2pb(sample, test_yaml);
+
+    std::string buffer;
+    yaml2pb::BufferSink buffer_sink(buffer);
+    yaml2pb::pb2yaml(sample, buffer_sink);
+    EXPECT_EQ(buffer, test_yaml);
+
+    std::ostringstream oss;
+    yaml2pb::OstreamSink ostream_sink(oss);
+    yaml2pb::pb2yaml(sample, ostream_sink);
+    EXPECT_EQ(oss.str(), test_yaml);
+
+    FILE *file = tmpfile();
+    ASSERT_TRUE(file != NULL);
+    {
+        yaml2pb::FdSink fd_sink(fileno(file));
+        yaml2pb::pb2yaml(sample, fd_sink);
+    }
+    std::string written(buffer.size() + 1, '\0');
+    rewind(file);
+    written.resize(fread(&written[0], 1, written.size(), file));
+    fclose(file);
+    EXPECT_EQ(written, test_yaml);
+
+    buffer.clear();
+    yaml2pb::pb2yaml(Sample(), buffer_sink);
+    EXPECT_EQ(buffer, "{}\n");
+}
+
+// Map keys of every scalar type are written the same way by both encoders.
+TEST(pb2yaml, unknown_enum)
+{
+    // A number the enum does not define is written as that number by every
+    // encoder, not as the name protobuf makes up for it.
+    Processor processor;
+    processor.set_name("future");
+    processor.add_modules()->set_type(Module_ModuleType(14));
+    processor.add_modules()->set_type(Module_ModuleType_h264);
+
+    const std::string reflection = yaml2pb::pb2yaml(processor);
+    yaml2pb::EncodeOptions options;
+    options.generated = true;
+    EXPECT_EQ(yaml2pb::pb2yaml(processor, options), reflection);
+    std::string streamed;
+    yaml2pb::BufferSink sink(streamed);
+    yaml2pb::pb2yaml(processor, sink);
+    EXPECT_EQ(streamed, reflection);
+    EXPECT_NE(reflection.find("type: 14\n"), std::string::npos) << reflection;
+    EXPECT_NE(reflection.find("type: h264\n"), std::string::npos) << reflection;
+    EXPECT_EQ(reflection.find("UNKNOWN"), std::string::npos) << reflection;
+}
+
+TEST(pb2yaml, map_keys)
+{
+    google::protobuf::FileDescriptorProto file;
+    ASSERT_TRUE(google::protobuf::TextFormat::ParseFromString("name: 'keys.proto' syntax: 'proto3' "
+                                                              "message_type { name: 'Keys' "
+                                                              "field { name: 'ints' number: 1 label: LABEL_REPEATED type: TYPE_MESSAGE type_name: '.Keys.IntsEntry' } "
+                                                              "field { name: 'flags' number: 2 label: LABEL_REPEATED type: TYPE_MESSAGE type_name: '.Keys.FlagsEntry' } "
+                                                              "nested_type { name: 'IntsEntry' options { map_entry: true } "
+                                                              "field { name: 'key' number: 1 label: LABEL_OPTIONAL type: TYPE_SINT64 } "
+                                                              "field { name: 'value' number: 2 label: LABEL_OPTIONAL type: TYPE_STRING } } "
+                                                              "nested_type { name: 'FlagsEntry' options { map_entry: true } "
+                                                              "field { name: 'key' number: 1 label: LABEL_OPTIONAL type: TYPE_BOOL } "
+                                                              "field { name: 'value' number: 2 label: LABEL_OPTIONAL type: TYPE_UINT32 } } }",
+                                                              &file));
+    google::protobuf::DescriptorPool pool;
+    const google::protobuf::FileDescriptor *keys = pool.BuildFile(file);
+    ASSERT_TRUE(keys);
+    {
+        google::protobuf::DynamicMessageFactory factory(&pool);
+        const google::protobuf::Message *prototype = factory.GetPrototype(keys->message_type(0));
+        std::unique_ptr<google::protobuf::Message> message(prototype->New());
+        yaml2pb::yaml2pb(*message, "ints: {-7: minus, 0: zero, 9000000000: big}\nflags: {true: 1, false: 0}\n");
+        ASSERT_EQ(message->GetReflection()->FieldSize(*message, keys->message_type(0)->field(0)), 3);
+
+        std::string streamed;
+        yaml2pb::BufferSink sink(streamed);
+        yaml2pb::pb2yaml(*message, sink);
+        const std::string tree = yaml2pb::pb2yaml(*message);
+        EXPECT_EQ(tree, streamed);
+        EXPECT_NE(tree.find("9000000000: big"), std::string::npos) << tree;
+        EXPECT_NE(tree.find("true: 1"), std::string::npos) << tree;
+
+        std::unique_ptr<google::protobuf::Message> decoded(prototype->New());
+        yaml2pb::yaml2pb(*decoded, tree);
+        EXPECT_EQ(decoded->SerializeAsString(), message->SerializeAsString());
+    }
+    yaml2pb::release_pool(&pool);
+}
@@ -0,0 +1,521 @@
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/descriptor.pb.h"
+#include "google/protobuf/io/printer.h"
+
+#include "generator.h"
+
+namespace yaml2pb
+{
+    namespace plugin
+    {
+        typedef std::map<std::string, std::string> Vars;
+
+        // Must match yaml2pb::generated::hash().
+        static uint32_t hash(const std::string &name)
+        {
+            uint32_t h = 2166136261u;
+            for (size_t i = 0; i < name.size(); i++)
+            {
+                h ^= (unsigned char)name[i];
+                h *= 16777619u;
+            }
+            return h;
+        }
+
+        static std::string replace_all(std::string str, const std::string &from, const std::string &to)
+        {
+            for (size_t pos = str.find(from); pos != std::string::npos; pos = str.find(from, pos + to.size()))
+                str.replace(pos, from.size(), to);
+            return str;
+        }
+
+        static std::string namespace_of(const google::protobuf::FileDescriptor *file)
+        {
+            return (file->package().empty()) ? "" : "::" + replace_all(file->package(), ".", "::");
+        }
+
+        // Generated C++ names, following protoc's cpp generator: nested types
+        // are flattened with '_', field accessors are lowercased and suffixed
+        // with '_' when they clash with a keyword.
+        static std::string class_name(const google::protobuf::Descriptor *d)
+        {
+            return (d->containing_type()) ? class_name(d->containing_type()) + "_" + d->name() : d->name();
+        }
+
+        static std::string qualified_name(const google::protobuf::Descriptor *d)
+        {
+            return namespace_of(d->file()) + "::" + class_name(d);
+        }
+
+        static std::string qualified_name(const google::protobuf::EnumDescriptor *e)
+        {
+            std::string name = (e->containing_type()) ? class_name(e->containing_type()) + "_" + e->name() : e->name();
+            return namespace_of(e->file()) + "::" + name;
+        }
+
+        static std::string field_name(const google::protobuf::FieldDescriptor *field)
+        {
+            static const char *const keywords[] = {
+                "NULL", "alignas", "alignof", "and", "and_eq", "asm", "auto", "bitand", "bitor", "bool",
+                "break", "case", "catch", "char", "class", "compl", "const", "constexpr", "const_cast",
+                "continue", "decltype", "default", "delete", "do", "double", "dynamic_cast", "else", "enum",
+                "explicit", "export", "extern", "false", "float", "for", "friend", "goto", "if", "inline",
+                "int", "long", "mutable", "namespace", "new", "noexcept", "not", "not_eq", "nullptr",
+                "operator", "or", "or_eq", "private", "protected", "public", "register", "reinterpret_cast",
+                "return", "short", "signed", "sizeof", "static", "static_assert", "static_cast", "struct",
+                "switch", "template", "this", "thread_local", "throw", "true", "try", "typedef", "typeid",
+                "typename", "union", "unsigned", "using", "virtual", "void", "volatile", "wchar_t", "while",
+                "xor", "xor_eq",
+            };
+            static const std::set<std::string> reserved(keywords, keywords + sizeof(keywords) / sizeof(keywords[0]));
+
+            std::string name = field->name();
+            std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+            if (reserved.count(name))
+                name += "_";
+            return name;
+        }
+
+        static void collect(const google::protobuf::Descriptor *d, std::vector<const google::protobuf::Descriptor *> *messages)
+        {
+            if (d->options().map_entry())
+                return;
+            messages->push_back(d);
+            for (int i = 0; i < d->nested_type_count(); i++)
+                collect(d->nested_type(i), messages);
+        }
+
+        static std::vector<const google::protobuf::Descriptor *> messages_of(const google::protobuf::FileDescriptor *file)
+        {
+            std::vector<const google::protobuf::Descriptor *> messages;
+            for (int i = 0; i < file->message_type_count(); i++)
+                collect(file->message_type(i), &messages);
+            return messages;
+        }
+
+        static std::vector<const google::protobuf::FieldDescriptor *> fields_by_number(const google::protobuf::Descriptor *d)
+        {
+            std::vector<const google::protobuf::FieldDescriptor *> fields;
+            for (int i = 0; i < d->field_count(); i++)
+                fields.push_back(d->field(i));
+            std::sort(fields.begin(), fields.end(), [](const google::protobuf::FieldDescriptor *a, const google::protobuf::FieldDescriptor *b) {
+                return a->number() < b->number();
+            });
+            return fields;
+        }
+
+        static void open_namespace(const google::protobuf::FileDescriptor *file, google::protobuf::io::Printer *printer)
+        {
+            std::string package = file->package();
+            for (size_t begin = 0; !package.empty() && begin <= package.size();)
+            {
+                size_t end = std::min(package.find('.', begin), package.size());
+                printer->Print("namespace $ns$ {\n", "ns", package.substr(begin, end - begin));
+                begin = end + 1;
+            }
+            if (!package.empty())
+                printer->Print("\n");
+        }
+
+        static void close_namespace(const google::protobuf::FileDescriptor *file, google::protobuf::io::Printer *printer)
+        {
+            std::string package = file->package();
+            if (package.empty())
+                return;
+            printer->Print("\n");
+            for (size_t i = 0; i <= (size_t)std::count(package.begin(), package.end(), '.'); i++)
+                printer->Print("}\n");
+        }
+
+        // C++ expression converting the YAML::Node `node` into a value of
+        // the (non-message) type of `field`.
+        static std::string from_yaml_expr(const google::protobuf::FieldDescriptor *field, const std::string &node)
+        {
+            const std::string args = "(" + node + ")";
+            switch (field->cpp_type())
+            {
+            case google::protobuf::FieldDescriptor::CPPTYPE_DOUBLE:
+                return "::yaml2pb::generated::as_double" + args;
+            case google::protobuf::FieldDescriptor::CPPTYPE_FLOAT:
+                return "::yaml2pb::generated::as_float" + args;
+            case google::protobuf::FieldDescriptor::CPPTYPE_INT64:
+                return "::yaml2pb::generated::as_int64" + args;
+            case google::protobuf::FieldDescriptor::CPPTYPE_UINT64:
+                return "::yaml2pb::generated::as_uint64" + args;
+            case google::protobuf::FieldDescriptor::CPPTYPE_INT32:
+                return "::yaml2pb::generated::as_int32" + args;
+            case google::protobuf::FieldDescriptor::CPPTYPE_UINT32:
+                return "::yaml2pb::generated::as_uint32" + args;
+            case google::protobuf::FieldDescriptor::CPPTYPE_BOOL:
+                return "::yaml2pb::generated::as_bool" + args;
+            case google::protobuf::FieldDescriptor::CPPTYPE_STRING:
+                if (field->type() == google::protobuf::FieldDescriptor::TYPE_BYTES)
+                    return "::yaml2pb::generated::as_bytes" + args;
+                return "::yaml2pb::generated::as_string" + args;
+            case google::protobuf::FieldDescriptor::CPPTYPE_ENUM: {
+                const std::string name = qualified_name(field->enum_type());
+                return "::yaml2pb::generated::as_enum(" + node + ", &" + name + "_Parse, &" + name + "_IsValid)";
+            }
+            default:
+                return "";
+            }
+        }
+
+        // C++ expression turning `value`, of the (non-message) type of
+        // `field`, into something YAML::Node can be assigned from.
+        static std::string to_yaml_expr(const google::protobuf::FieldDescriptor *field, const std::string &value)
+        {
+            switch (field->cpp_type())
+            {
+            case google::protobuf::FieldDescriptor::CPPTYPE_STRING:
+                if (field->type() == google::protobuf::FieldDescriptor::TYPE_BYTES)
+                    return "::yaml2pb::generated::bytes_to_yaml(" + value + ")";
+                return value;
+            case google::protobuf::FieldDescriptor::CPPTYPE_ENUM:
+                return "::yaml2pb::generated::enum_to_yaml(" + qualified_name(field->enum_type()) + "_Name(" + value + "), " + value + ")";
+            case google::protobuf::FieldDescriptor::CPPTYPE_BOOL:
+                return value;
+            default:
+                return "::yaml2pb::generated::number_to_yaml(" + value + ")";
+            }
+        }
+
+        // Message types of the same file are decoded by direct calls; others
+        // may or may not have generated codecs and go through the registry.
+        static std::string from_yaml_call(const google::protobuf::FieldDescriptor *field)
+        {
+            return (field->message_type()->file() == field->file()) ? "FromYaml" : "::yaml2pb::generated::from_yaml";
+        }
+
+        static std::string to_yaml_call(const google::protobuf::FieldDescriptor *field)
+        {
+            return (field->message_type()->file() == field->file()) ? "ToYaml" : "::yaml2pb::generated::to_yaml";
+        }
+
+        static bool is_message(const google::protobuf::FieldDescriptor *field)
+        {
+            return field->cpp_type() == google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE;
+        }
+
+        // Failures within elements and entries are passed on with their
+        // index or key; see generated::fail().
+        static void generate_field_decoder(const google::protobuf::FieldDescriptor *field, google::protobuf::io::Printer *printer)
+        {
+            Vars vars;
+            vars["field"] = field_name(field);
+
+            if (field->is_map())
+            {
+                const google::protobuf::FieldDescriptor *key = field->message_type()->map_key();
+                const google::protobuf::FieldDescriptor *value = field->message_type()->map_value();
+                vars["key"] = from_yaml_expr(key, "item->first");
+                printer->Print(vars,
+                               "if (!value.IsMap())\n"
+                               "  ::yaml2pb::generated::fail(value.Mark(), ::yaml2pb::ERROR_TYPE, \"invalid map\");\n"
+                               "auto entries = ::yaml2pb::generated::map_entries(*message.mutable_$field$());\n"
+                               "YAML::const_iterator item = value.begin();\n"
+                               "try\n"
+                               "{\n"
+                               "  for (; item != value.end(); ++item)\n");
+                if (is_message(value))
+                {
+                    vars["call"] = from_yaml_call(value);
+                    printer->Print(vars,
+                                   "  {\n"
+                                   "    auto &entry = entries(item->first, $key$);\n"
+                                   "    entry.Clear();\n"
+                                   "    $call$(entry, item->second);\n"
+                                   "  }\n");
+                }
+                else
+                {
+                    vars["value"] = from_yaml_expr(value, "item->second");
+                    printer->Print(vars, "    entries(item->first, $key$) = $value$;\n");
+                }
+                printer->Print("}\n"
+                               "catch (...)\n"
+                               "{\n"
+                               "  ::yaml2pb::generated::rethrow_key(item->first);\n"
+                               "}\n");
+            }
+            else if (field->is_repeated())
+            {
+                printer->Print(vars,
+                               "if (!value.IsSequence())\n"
+                               "  ::yaml2pb::generated::fail(value.Mark(), ::yaml2pb::ERROR_TYPE, \"invalid array\");\n"
+                               "message.mutable_$field$()->Reserve(message.$field$_size() + int(value.size()));\n"
+                               "size_t index = 0;\n"
+                               "try\n"
+                               "{\n"
+                               "  for (YAML::const_iterator item = value.begin(); item != value.end(); ++item, ++index)\n");
+                if (is_message(field))
+                {
+                    vars["call"] = from_yaml_call(field);
+                    printer->Print(vars, "    $call$(*message.add_$field$(), *item);\n");
+                }
+                else
+                {
+                    vars["value"] = from_yaml_expr(field, "*item");
+                    printer->Print(vars, "    message.add_$field$($value$);\n");
+                }
+                printer->Print("}\n"
+                               "catch (...)\n"
+                               "{\n"
+                               "  ::yaml2pb::generated::rethrow_index(index);\n"
+                               "}\n");
+            }
+            else if (is_message(field))
+            {
+                vars["call"] = from_yaml_call(field);
+                printer->Print(vars, "$call$(*message.mutable_$field$(), value);\n");
+            }
+            else
+            {
+                vars["value"] = from_yaml_expr(field, "value");
+                printer->Print(vars, "message.set_$field$($value$);\n");
+            }
+        }
+
+        static void generate_decoder(const google::protobuf::Descriptor *d, google::protobuf::io::Printer *printer)
+        {
+            // Fields grouped by name hash, so colliding names share a label.
+            std::map<uint32_t, std::vector<const google::protobuf::FieldDescriptor *>> buckets;
+            for (int i = 0; i < d->field_count(); i++)
+                buckets[hash(d->field(i)->name())].push_back(d->field(i));
+
+            // Like the reflection decoders, a scalar or null leaves the
+            // message empty. Failures within a field are passed on with its
+            // name; the reflection fallback names the field itself.
+            printer->Print("void FromYaml($class$ &message, const YAML::Node &node)\n"
+                           "{\n",
+                           "class", qualified_name(d));
+            printer->Indent();
+            printer->Print("if (node.IsSequence())\n"
+                           "  ::yaml2pb::generated::fail(node.Mark(), ::yaml2pb::ERROR_TYPE, \"invalid value\");\n"
+                           "for (YAML::const_iterator it = node.begin(); it != node.end(); ++it)\n"
+                           "{\n");
+            printer->Indent();
+            printer->Print("const std::string name = it->first.as<std::string>();\n"
+                           "const YAML::Node value = it->second;\n");
+            if (!buckets.empty())
+            {
+                printer->Print("try\n"
+                               "{\n");
+                printer->Indent();
+                printer->Print("switch (::yaml2pb::generated::hash(name))\n"
+                               "{\n");
+                for (std::map<uint32_t, std::vector<const google::protobuf::FieldDescriptor *>>::const_iterator bucket = buckets.begin(); bucket != buckets.end(); ++bucket)
+                {
+                    printer->Print("case ::yaml2pb::generated::hash(\"$name$\"):\n", "name", bucket->second[0]->name());
+                    printer->Indent();
+                    for (size_t i = 0; i < bucket->second.size(); i++)
+                    {
+                        printer->Print("if (name == \"$name$\")\n"
+                                       "{\n",
+                                       "name", bucket->second[i]->name());
+                        printer->Indent();
+                        generate_field_decoder(bucket->second[i], printer);
+                        printer->Print("continue;\n");
+                        printer->Outdent();
+                        printer->Print("}\n");
+                    }
+                    printer->Print("break;\n");
+                    printer->Outdent();
+                }
+                printer->Print("}\n");
+                printer->Outdent();
+                printer->Print("}\n"
+                               "catch (...)\n"
+                               "{\n"
+                               "  ::yaml2pb::generated::rethrow_field(name);\n"
+                               "}\n");
+            }
+            printer->Print("::yaml2pb::generated::field_from_yaml(message, name, it->first.Mark(), value);\n");
+            printer->Outdent();
+            printer->Print("}\n");
+            printer->Outdent();
+            printer->Print("}\n\n");
+        }
+
+        static void generate_field_encoder(const google::protobuf::FieldDescriptor *field, google::protobuf::io::Printer *printer)
+        {
+            Vars vars;
+            vars["name"] = field->name();
+            vars["field"] = field_name(field);
+
+            if (field->is_map())
+            {
+                // Same as the reflection encoder: keys of a protobuf map are
+                // unique already, and items[key] would scan every entry
+                // inserted so far. force_insert() does not mark the node
+                // defined, so it is given its type up front.
+                const google::protobuf::FieldDescriptor *value = field->message_type()->map_value();
+                vars["key"] = to_yaml_expr(field->message_type()->map_key(), "entry->first");
+                printer->Print(vars,
+                               "if (message.$field$_size())\n"
+                               "{\n"
+                               "  YAML::Node items = node[\"$name$\"];\n"
+                               "  items = YAML::Node(YAML::NodeType::Map);\n"
+                               "  for (auto entry = message.$field$().begin(); entry != message.$field$().end(); ++entry)\n");
+                if (is_message(value))
+                {
+                    vars["call"] = to_yaml_call(value);
+                    printer->Print(vars,
+                                   "  {\n"
+                                   "    YAML::Node item(YAML::NodeType::Map);\n"
+                                   "    $call$(item, entry->second);\n"
+                                   "    items.force_insert($key$, item);\n"
+                                   "  }\n");
+                }
+                else
+                {
+                    vars["value"] = to_yaml_expr(value, "entry->second");
+                    printer->Print(vars, "    items.force_insert($key$, $value$);\n");
+                }
+                printer->Print("}\n");
+            }
+            else if (field->is_repeated())
+            {
+                printer->Print(vars,
+                               "if (message.$field$_size())\n"
+                               "{\n"
+                               "  YAML::Node items(YAML::NodeType::Sequence);\n"
+                               "  for (int i = 0; i < message.$field$_size(); i++)\n");
+                if (is_message(field))
+                {
+                    vars["call"] = to_yaml_call(field);
+                    printer->Print(vars,
+                                   "  {\n"
+                                   "    YAML::Node item(YAML::NodeType::Map);\n"
+                                   "    $call$(item, message.$field$(i));\n"
+                                   "    items.push_back(item);\n"
+                                   "  }\n");
+                }
+                else
+                {
+                    vars["value"] = to_yaml_expr(field, "message." + field_name(field) + "(i)");
+                    printer->Print(vars, "    items.push_back($value$);\n");
+                }
+                printer->Print(vars,
+                               "  node[\"$name$\"] = items;\n"
+                               "}\n");
+            }
+            else
+            {
+                // Same presence rules as Reflection::ListFields.
+                if (field->has_presence())
+                    vars["present"] = "message.has_" + field_name(field) + "()";
+                else if (field->cpp_type() == google::protobuf::FieldDescriptor::CPPTYPE_STRING)
+                    vars["present"] = "!message." + field_name(field) + "().empty()";
+                else if (field->cpp_type() == google::protobuf::FieldDescriptor::CPPTYPE_DOUBLE || field->cpp_type() == google::protobuf::FieldDescriptor::CPPTYPE_FLOAT)
+                    vars["present"] = "::yaml2pb::generated::is_set(message." + field_name(field) + "())";
+                else if (field->cpp_type() == google::protobuf::FieldDescriptor::CPPTYPE_BOOL)
+                    vars["present"] = "message." + field_name(field) + "()";
+                else
+                    vars["present"] = "message." + field_name(field) + "() != 0";
+
+                if (is_message(field))
+                {
+                    vars["call"] = to_yaml_call(field);
+                    printer->Print(vars,
+                                   "if ($present$)\n"
+                                   "{\n"
+                                   "  YAML::Node item(YAML::NodeType::Map);\n"
+                                   "  $call$(item, message.$field$());\n"
+                                   "  node[\"$name$\"] = item;\n"
+                                   "}\n");
+                }
+                else
+                {
+                    vars["value"] = to_yaml_expr(field, "message." + field_name(field) + "()");
+                    printer->Print(vars,
+                                   "if ($present$)\n"
+                                   "  node[\"$name$\"] = $value$;\n");
+                }
+            }
+        }
+
+        static void generate_encoder(const google::protobuf::Descriptor *d, google::protobuf::io::Printer *printer)
+        {
+            printer->Print("void ToYaml(YAML::Node &node, const $class$ &message)\n"
+                           "{\n",
+                           "class", qualified_name(d));
+            printer->Indent();
+            std::vector<const google::protobuf::FieldDescriptor *> fields = fields_by_number(d);
+            for (size_t i = 0; i < fields.size(); i++)
+                generate_field_encoder(fields[i], printer);
+            if (d->extension_range_count())
+                printer->Print("::yaml2pb::generated::extensions_to_yaml(node, message);\n");
+            printer->Outdent();
+            printer->Print("}\n\n");
+        }
+
+        std::string basename(const google::protobuf::FileDescriptor *file)
+        {
+            std::string name = file->name();
+            const std::string suffix = ".proto";
+            if (name.size() > suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0)
+                name.erase(name.size() - suffix.size());
+            return name;
+        }
+
+        void generate_header(const google::protobuf::FileDescriptor *file, google::protobuf::io::Printer *printer)
+        {
+            printer->Print("// Generated by protoc-gen-yaml2pb.  DO NOT EDIT!\n"
+                           "// source: $source$\n"
+                           "\n"
+                           "#pragma once\n"
+                           "\n"
+                           "#include \"yaml-cpp/yaml.h\"\n"
+                           "#include \"$basename$.pb.h\"\n"
+                           "\n",
+                           "source", file->name(), "basename", basename(file));
+
+            open_namespace(file, printer);
+            std::vector<const google::protobuf::Descriptor *> messages = messages_of(file);
+            for (size_t i = 0; i < messages.size(); i++)
+                printer->Print("void FromYaml($class$ &message, const YAML::Node &node);\n"
+                               "void ToYaml(YAML::Node &node, const $class$ &message);\n",
+                               "class", qualified_name(messages[i]));
+            close_namespace(file, printer);
+        }
+
+        void generate_source(const google::protobuf::FileDescriptor *file, google::protobuf::io::Printer *printer)
+        {
+            printer->Print("// Generated by protoc-gen-yaml2pb.  DO NOT EDIT!\n"
+                           "// source: $source$\n"
+                           "\n"
+                           "#include <string>\n"
+                           "\n"
+                           "#include \"yaml2pb/generated.h\"\n"
+                           "#include \"$basename$.yaml2pb.h\"\n"
+                           "\n",
+                           "source", file->name(), "basename", basename(file));
+
+            open_namespace(file, printer);
+            std::vector<const google::protobuf::Descriptor *> messages = messages_of(file);
+            for (size_t i = 0; i < messages.size(); i++)
+            {
+                generate_decoder(messages[i], printer);
+                generate_encoder(messages[i], printer);
+            }
+
+            printer->Print("namespace {\n"
+                           "\n"
+                           "const bool registered = (\n");
+            for (size_t i = 0; i < messages.size(); i++)
+                printer->Print("  ::yaml2pb::generated::register_codec<$class$>(),\n", "class", qualified_name(messages[i]));
+            printer->Print("  true);\n"
+                           "\n"
+                           "}  // namespace\n");
+            close_namespace(file, printer);
+        }
+    } // namespace plugin
+} // namespace yaml2pb
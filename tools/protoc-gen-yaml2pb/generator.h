@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/io/printer.h"
+
+namespace yaml2pb
+{
+    namespace plugin
+    {
+        // "dir/name.proto" -> "dir/name", the prefix of every generated file.
+        std::string basename(const google::protobuf::FileDescriptor *file);
+
+        // Emit <basename>.yaml2pb.h and <basename>.yaml2pb.cc: a FromYaml /
+        // ToYaml pair per message of `file`, calling the generated accessors.
+        void generate_header(const google::protobuf::FileDescriptor *file, google::protobuf::io::Printer *printer);
+        void generate_source(const google::protobuf::FileDescriptor *file, google::protobuf::io::Printer *printer);
+    } // namespace plugin
+} // namespace yaml2pb
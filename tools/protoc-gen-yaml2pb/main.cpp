@@ -0,0 +1,35 @@
+#include <memory>
+#include <string>
+
+#include "google/protobuf/compiler/code_generator.h"
+#include "google/protobuf/compiler/plugin.h"
+#include "google/protobuf/io/printer.h"
+#include "google/protobuf/io/zero_copy_stream.h"
+
+#include "generator.h"
+
+class Generator : public google::protobuf::compiler::CodeGenerator
+{
+public:
+    virtual bool Generate(const google::protobuf::FileDescriptor *file, const std::string &, google::protobuf::compiler::GeneratorContext *context, std::string *) const
+    {
+        const std::string basename = yaml2pb::plugin::basename(file);
+        {
+            std::unique_ptr<google::protobuf::io::ZeroCopyOutputStream> output(context->Open(basename + ".yaml2pb.h"));
+            google::protobuf::io::Printer printer(output.get(), '$');
+            yaml2pb::plugin::generate_header(file, &printer);
+        }
+        {
+            std::unique_ptr<google::protobuf::io::ZeroCopyOutputStream> output(context->Open(basename + ".yaml2pb.cc"));
+            google::protobuf::io::Printer printer(output.get(), '$');
+            yaml2pb::plugin::generate_source(file, &printer);
+        }
+        return true;
+    }
+};
+
+int main(int argc, char *argv[])
+{
+    Generator generator;
+    return google::protobuf::compiler::PluginMain(argc, argv, &generator);
+}
@@ -0,0 +1,281 @@
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/dynamic_message.h"
+#include "google/protobuf/message.h"
+#include "google/protobuf/reflection.h"
+
+#include "yaml2pb/sink.h"
+#include "yaml2pb/yaml2pb.h"
+#include "corpus.h"
+
+namespace yaml2pb
+{
+    namespace corpus
+    {
+        // Root collections are written once their batch holds about this much YAML.
+        static const size_t batch_size = 1 << 20;
+
+        // Draws everything from splitmix64 with plain modulo arithmetic, so
+        // the output does not depend on the standard library's distributions.
+        class Generator
+        {
+            const Options &_options;
+            uint64_t _state;
+
+            uint64_t next()
+            {
+                uint64_t z = (_state += 0x9e3779b97f4a7c15ull);
+                z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+                z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+                return z ^ (z >> 31);
+            }
+
+            uint64_t below(uint64_t n) { return (n) ? next() % n : 0; }
+            bool chance(int percent) { return int(below(100)) < percent; }
+            size_t length(int mean) { return 1 + below(2 * std::max(mean, 1) - 1); }
+
+            // Letters, digits, '_' and inner spaces, never reading back as a
+            // YAML null or bool.
+            std::string word(int mean)
+            {
+                static const char alphabet[] = "abcdefghijklmnopqrstuvwxyz0123456789_ ";
+                static const char *const keywords[] = {"y", "n", "yes", "no", "on", "off", "true", "false", "null"};
+                for (;;)
+                {
+                    std::string word(length(mean), ' ');
+                    word[0] = alphabet[below(26)];
+                    for (size_t i = 1; i < word.size(); i++)
+                        word[i] = alphabet[below((i + 1 < word.size()) ? sizeof(alphabet) - 1 : sizeof(alphabet) - 2)];
+                    if (std::find(keywords, keywords + sizeof(keywords) / sizeof(*keywords), word) == keywords + sizeof(keywords) / sizeof(*keywords))
+                        return word;
+                }
+            }
+
+            std::string bytes(int mean)
+            {
+                std::string bytes(length(mean), '\0');
+                for (size_t i = 0; i < bytes.size(); i++)
+                    bytes[i] = char(next());
+                return bytes;
+            }
+
+            // Half small values, half anywhere in the type's range.
+            uint64_t integer() { return (chance(50)) ? below(1000) : next(); }
+
+            // Multiples of 1/16 or 1/4, which print exactly in few digits.
+            double real() { return double(int64_t(below(1 << 21)) - (1 << 20)) / 16; }
+            float single() { return float(int64_t(below(1 << 21)) - (1 << 20)) / 4; }
+
+            void value(google::protobuf::Message &message, const google::protobuf::FieldDescriptor *field, int depth)
+            {
+                const google::protobuf::Reflection *ref = message.GetReflection();
+                const bool repeated = field->is_repeated();
+
+                switch (field->cpp_type())
+                {
+#define _CONVERT(type, setfunc, addfunc, draw)          \
+    case google::protobuf::FieldDescriptor::type:       \
+        if (repeated)                                   \
+            ref->addfunc(&message, field, draw);        \
+        else                                            \
+            ref->setfunc(&message, field, draw);        \
+        break;
+
+                    _CONVERT(CPPTYPE_DOUBLE, SetDouble, AddDouble, real());
+                    _CONVERT(CPPTYPE_FLOAT, SetFloat, AddFloat, single());
+                    _CONVERT(CPPTYPE_INT64, SetInt64, AddInt64, int64_t(integer()));
+                    _CONVERT(CPPTYPE_UINT64, SetUInt64, AddUInt64, integer());
+                    _CONVERT(CPPTYPE_INT32, SetInt32, AddInt32, int32_t(integer()));
+                    _CONVERT(CPPTYPE_UINT32, SetUInt32, AddUInt32, uint32_t(integer()));
+                    _CONVERT(CPPTYPE_BOOL, SetBool, AddBool, chance(50));
+                    _CONVERT(CPPTYPE_STRING, SetString, AddString, (field->type() == google::protobuf::FieldDescriptor::TYPE_BYTES) ? bytes(_options.string) : word(_options.string));
+                    _CONVERT(CPPTYPE_ENUM, SetEnum, AddEnum, field->enum_type()->value(below(field->enum_type()->value_count())));
+#undef _CONVERT
+
+                case google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE:
+                    fill((repeated) ? *ref->AddMessage(&message, field) : *ref->MutableMessage(&message, field), depth + 1, true);
+                    break;
+                }
+            }
+
+        public:
+            explicit Generator(const Options &options)
+                : _options(options), _state(options.seed)
+            {
+            }
+
+            uint64_t weight() { return 1 + below(100); }
+
+            bool supported(const google::protobuf::FieldDescriptor *field, int depth) const
+            {
+                if (field->is_map())
+                    return true;
+                if (field->cpp_type() == google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE)
+                    return depth < _options.depth || field->is_required();
+                return true;
+            }
+
+            // How many elements `field` can hold: a map with bool keys has
+            // only two distinct ones.
+            static size_t capacity(const google::protobuf::FieldDescriptor *field)
+            {
+                if (field->is_map() && field->message_type()->map_key()->cpp_type() == google::protobuf::FieldDescriptor::CPPTYPE_BOOL)
+                    return 2;
+                return SIZE_MAX;
+            }
+
+            // Appends one element to a repeated or map field, which must
+            // hold fewer than capacity() elements. Map keys are derived from
+            // `index`, which keeps them unique: string keys end in it,
+            // integer keys are it, and bool keys are index != 0.
+            void add(google::protobuf::Message &message, const google::protobuf::FieldDescriptor *field, int depth, size_t index)
+            {
+                if (!field->is_map())
+                {
+                    value(message, field, depth);
+                    return;
+                }
+
+                google::protobuf::Message *entry = message.GetReflection()->AddMessage(&message, field);
+                const google::protobuf::Reflection *ref = entry->GetReflection();
+                const google::protobuf::FieldDescriptor *key = entry->GetDescriptor()->map_key();
+                switch (key->cpp_type())
+                {
+                case google::protobuf::FieldDescriptor::CPPTYPE_INT64:
+                    ref->SetInt64(entry, key, int64_t(index));
+                    break;
+                case google::protobuf::FieldDescriptor::CPPTYPE_UINT64:
+                    ref->SetUInt64(entry, key, uint64_t(index));
+                    break;
+                case google::protobuf::FieldDescriptor::CPPTYPE_INT32:
+                    ref->SetInt32(entry, key, int32_t(index));
+                    break;
+                case google::protobuf::FieldDescriptor::CPPTYPE_UINT32:
+                    ref->SetUInt32(entry, key, uint32_t(index));
+                    break;
+                case google::protobuf::FieldDescriptor::CPPTYPE_BOOL:
+                    ref->SetBool(entry, key, index != 0);
+                    break;
+                default:
+                    ref->SetString(entry, key, word(_options.string) + "_" + std::to_string(index));
+                    break;
+                }
+                value(*entry, entry->GetDescriptor()->map_value(), depth);
+            }
+
+            // Sets a random subset of the fields of `message`, leaving its
+            // repeated and map fields alone unless `collections` is set.
+            void fill(google::protobuf::Message &message, int depth, bool collections)
+            {
+                const google::protobuf::Descriptor *d = message.GetDescriptor();
+                for (int i = 0; i < d->field_count(); i++)
+                {
+                    const google::protobuf::FieldDescriptor *field = d->field(i);
+                    if (field->real_containing_oneof() || !supported(field, depth))
+                        continue;
+
+                    if (!field->is_repeated())
+                    {
+                        if (field->is_required() || chance(_options.fill))
+                            value(message, field, depth);
+                    }
+                    else if (collections)
+                    {
+                        for (size_t j = 0, count = std::min<size_t>(below(2 * _options.repeat + 1), capacity(field)); j < count; j++)
+                            add(message, field, depth, j);
+                    }
+                }
+
+                for (int i = 0; i < d->real_oneof_decl_count(); i++)
+                {
+                    const google::protobuf::OneofDescriptor *oneof = d->oneof_decl(i);
+                    if (!chance(_options.fill))
+                        continue;
+                    const google::protobuf::FieldDescriptor *field = oneof->field(below(oneof->field_count()));
+                    if (supported(field, depth))
+                        value(message, field, depth);
+                }
+            }
+        };
+
+        size_t generate(const google::protobuf::Descriptor *descriptor, const Options &options, std::ostream &yaml, std::ostream &binary)
+        {
+            google::protobuf::DynamicMessageFactory factory(descriptor->file()->pool());
+            factory.SetDelegateToGeneratedFactory(true);
+            std::unique_ptr<google::protobuf::Message> message(factory.GetPrototype(descriptor)->New());
+            Generator generator(options);
+
+            std::vector<const google::protobuf::FieldDescriptor *> roots;
+            for (int i = 0; i < descriptor->field_count(); i++)
+            {
+                const google::protobuf::FieldDescriptor *field = descriptor->field(i);
+                if (field->is_repeated() && generator.supported(field, 0))
+                    roots.push_back(field);
+            }
+
+            std::string text;
+            BufferSink sink(text);
+            size_t written = 0;
+
+            // Singular fields first, as one document of their own.
+            generator.fill(*message, 0, false);
+            if (roots.empty() || message->ByteSizeLong())
+            {
+                pb2yaml(*message, sink);
+                yaml.write(text.data(), text.size());
+                message->SerializeToOstream(&binary);
+                written += text.size();
+            }
+
+            std::vector<uint64_t> weights;
+            uint64_t total = 0;
+            for (size_t i = 0; i < roots.size(); i++)
+            {
+                weights.push_back(generator.weight());
+                total += weights.back();
+            }
+
+            const size_t budget = (options.size > written) ? options.size - written : 0;
+            for (size_t i = 0; i < roots.size(); i++)
+            {
+                const google::protobuf::FieldDescriptor *field = roots[i];
+                const std::string header = field->name() + ":\n";
+                const size_t share = size_t(double(budget) * weights[i] / total);
+
+                size_t produced = 0, count = 0;
+                const size_t capacity = Generator::capacity(field);
+                while (produced < share && count < capacity)
+                {
+                    // As many elements as should fit the batch by their mean
+                    // size so far, at most doubling the count so that a few
+                    // small first elements do not skew the estimate.
+                    size_t batch = 1;
+                    if (count)
+                        batch = std::max<size_t>(1, std::min(count, std::min(share - produced, batch_size) / std::max<size_t>(1, produced / count)));
+                    batch = std::min(batch, capacity - count);
+
+                    message->Clear();
+                    for (size_t j = 0; j < batch; j++)
+                        generator.add(*message, field, 0, count++);
+
+                    text.clear();
+                    pb2yaml(*message, sink);
+                    if (text.compare(0, header.size(), header) != 0)
+                        throw std::runtime_error("unexpected YAML layout for " + field->full_name());
+                    // Later batches continue the collection the first one opened.
+                    const size_t skip = (produced) ? header.size() : 0;
+                    yaml.write(text.data() + skip, text.size() - skip);
+                    message->SerializeToOstream(&binary);
+                    produced += text.size() - skip;
+                }
+                written += produced;
+            }
+            return written;
+        }
+    } // namespace corpus
+} // namespace yaml2pb
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+#include "google/protobuf/descriptor.h"
+
+namespace yaml2pb
+{
+    namespace corpus
+    {
+        struct Options
+        {
+            Options()
+                : seed(1), size(1 << 20), depth(8), repeat(4), string(16), fill(80)
+            {
+            }
+
+            // The same seed, options and schema always give the same bytes.
+            uint64_t seed;
+            // Approximate YAML size to reach. The bulk of it goes into the
+            // repeated and map fields of the root message, split between
+            // them in random proportions.
+            size_t size;
+            // Message fields nested deeper than this are left unset.
+            int depth;
+            // Mean element count of nested repeated and map fields.
+            int repeat;
+            // Mean length of strings, bytes and map keys.
+            int string;
+            // Percentage of singular fields and oneofs that get a value.
+            int fill;
+        };
+
+        // Writes a random but valid YAML document for `descriptor` to `yaml`,
+        // and the same message in protobuf wire format to `binary`. Repeated
+        // and map fields of the root are written in batches, so memory stays
+        // bounded whatever the size. Maps with bool keys get at most their
+        // two entries. Returns the number of YAML bytes written.
+        size_t generate(const google::protobuf::Descriptor *descriptor, const Options &options, std::ostream &yaml, std::ostream &binary);
+    } // namespace corpus
+} // namespace yaml2pb
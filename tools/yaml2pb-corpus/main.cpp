@@ -0,0 +1,188 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/descriptor.pb.h"
+#include "google/protobuf/dynamic_message.h"
+#include "google/protobuf/util/message_differencer.h"
+
+#include "yaml2pb/yaml2pb.h"
+#include "corpus.h"
+
+static const char usage[] =
+    "usage: yaml2pb-corpus [options] OUT.yaml OUT.pb\n"
+    "\n"
+    "Writes a random YAML document and the same message in binary form.\n"
+    "\n"
+    "  --message=NAME         root message type (default Sample)\n"
+    "  --descriptor_set=FILE  look NAME up in a FileDescriptorSet written by\n"
+    "                         protoc --include_imports --descriptor_set_out\n"
+    "                         instead of the types linked into the tool\n"
+    "  --size=N[K|M|G]        approximate YAML size (default 1M)\n"
+    "  --seed=N               random seed (default 1)\n"
+    "  --depth=N              deepest nested message (default 8)\n"
+    "  --repeat=N             mean size of nested repeated fields (default 4)\n"
+    "  --string=N             mean string and bytes length (default 16)\n"
+    "  --fill=PERCENT         share of singular fields set (default 80)\n"
+    "  --verify               decode OUT.yaml again and compare with OUT.pb\n";
+
+static bool option(const char *arg, const char *name, const char **value)
+{
+    const size_t length = strlen(name);
+    if (strncmp(arg, name, length) != 0 || arg[length] != '=')
+        return false;
+    *value = arg + length + 1;
+    return true;
+}
+
+static unsigned long long number(const char *value)
+{
+    char *end;
+    unsigned long long n = strtoull(value, &end, 10);
+    switch (*end)
+    {
+    case 'G':
+        n <<= 10;
+        // fall through
+    case 'M':
+        n <<= 10;
+        // fall through
+    case 'K':
+        n <<= 10;
+        end++;
+    }
+    if (end == value || *end)
+    {
+        fprintf(stderr, "yaml2pb-corpus: invalid number '%s'\n", value);
+        exit(2);
+    }
+    return n;
+}
+
+static bool read_file(const char *path, std::string &content)
+{
+    std::ifstream in(path, std::ios::binary);
+    content.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    return !in.bad() && in.is_open();
+}
+
+int main(int argc, char *argv[])
+{
+    yaml2pb::corpus::Options options;
+    std::string name = "Sample";
+    const char *descriptor_set = 0;
+    bool verify = false;
+    const char *paths[2] = {0, 0};
+    int path_count = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *value;
+        if (option(argv[i], "--message", &value))
+            name = value;
+        else if (option(argv[i], "--descriptor_set", &value))
+            descriptor_set = value;
+        else if (option(argv[i], "--size", &value))
+            options.size = number(value);
+        else if (option(argv[i], "--seed", &value))
+            options.seed = number(value);
+        else if (option(argv[i], "--depth", &value))
+            options.depth = number(value);
+        else if (option(argv[i], "--repeat", &value))
+            options.repeat = number(value);
+        else if (option(argv[i], "--string", &value))
+            options.string = number(value);
+        else if (option(argv[i], "--fill", &value))
+            options.fill = number(value);
+        else if (strcmp(argv[i], "--verify") == 0)
+            verify = true;
+        else if (argv[i][0] != '-' && path_count < 2)
+            paths[path_count++] = argv[i];
+        else
+        {
+            fputs(usage, stderr);
+            return 2;
+        }
+    }
+    if (path_count != 2)
+    {
+        fputs(usage, stderr);
+        return 2;
+    }
+
+    google::protobuf::DescriptorPool pool;
+    const google::protobuf::Descriptor *descriptor;
+    if (descriptor_set)
+    {
+        std::string content;
+        google::protobuf::FileDescriptorSet files;
+        if (!read_file(descriptor_set, content) || !files.ParseFromString(content))
+        {
+            fprintf(stderr, "yaml2pb-corpus: cannot read descriptor set %s\n", descriptor_set);
+            return 1;
+        }
+        for (int i = 0; i < files.file_size(); i++)
+            pool.BuildFile(files.file(i));
+        descriptor = pool.FindMessageTypeByName(name);
+    }
+    else
+        descriptor = google::protobuf::DescriptorPool::generated_pool()->FindMessageTypeByName(name);
+    if (!descriptor)
+    {
+        fprintf(stderr, "yaml2pb-corpus: unknown message type %s\n", name.c_str());
+        return 1;
+    }
+
+    try
+    {
+        std::ofstream yaml(paths[0], std::ios::binary);
+        std::ofstream binary(paths[1], std::ios::binary);
+        size_t size = yaml2pb::corpus::generate(descriptor, options, yaml, binary);
+        yaml.close();
+        binary.close();
+        if (!yaml || !binary)
+        {
+            fprintf(stderr, "yaml2pb-corpus: cannot write %s or %s\n", paths[0], paths[1]);
+            return 1;
+        }
+        fprintf(stderr, "%s: %zu bytes of %s\n", paths[0], size, descriptor->full_name().c_str());
+
+        if (verify)
+        {
+            google::protobuf::DynamicMessageFactory factory(descriptor->file()->pool());
+            factory.SetDelegateToGeneratedFactory(true);
+            const google::protobuf::Message *prototype = factory.GetPrototype(descriptor);
+            std::unique_ptr<google::protobuf::Message> decoded(prototype->New()), expected(prototype->New());
+
+            std::string content;
+            yaml2pb::Error error;
+            if (!read_file(paths[0], content) || !yaml2pb::try_yaml2pb(*decoded, content, &error))
+            {
+                fprintf(stderr, "%s: %s\n", paths[0], error.to_string().c_str());
+                return 1;
+            }
+            if (!read_file(paths[1], content) || !expected->ParseFromString(content))
+            {
+                fprintf(stderr, "%s: not a valid %s\n", paths[1], descriptor->full_name().c_str());
+                return 1;
+            }
+            if (!google::protobuf::util::MessageDifferencer::Equals(*decoded, *expected))
+            {
+                fprintf(stderr, "%s: decodes to a different message than %s\n", paths[0], paths[1]);
+                return 1;
+            }
+            fprintf(stderr, "%s: verified\n", paths[0]);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        fprintf(stderr, "yaml2pb-corpus: %s\n", e.what());
+        return 1;
+    }
+    return 0;
+}